@@ -0,0 +1,283 @@
+#include "anytime_probe.h"
+#include "encoder_bench.h"
+#include "encoders_info.h"
+#include "trace.h"
+#include "usdt.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace CODEC_INFO
+{
+    static const char *stage_name(int stage)
+    {
+        static const char *names[] = { "open", "quick", "full" };
+        return names[stage];
+    }
+
+    AnytimeProbe::AnytimeProbe(MEDIA_TYPE media_type, std::chrono::milliseconds budget)
+        : media_type_(media_type), budget_(budget)
+    {
+    }
+
+    AnytimeProbe::~AnytimeProbe()
+    {
+        Cancel();
+        if (thread_.joinable())
+            thread_.join();
+    }
+
+    void AnytimeProbe::Start(ProbeEventCallback callback)
+    {
+        callback_ = std::move(callback);
+        start_ = std::chrono::steady_clock::now();
+        thread_ = std::thread(
+            [this]()
+            {
+                Trace::SetThreadName("anytime probe");
+                run();
+            });
+    }
+
+    void AnytimeProbe::Cancel() { cancel_ = true; }
+
+    bool AnytimeProbe::WaitBest(CodecPerformance &best)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cv_.wait_until(lock, start_ + budget_, [this]() { return done_; });
+        if (best_ < 0) {
+            lock.unlock();
+            std::ostringstream line;
+            line << "{\"event\":\"deadline\",\"encoder\":null" << std::fixed
+                 << std::setprecision(3) << ",\"t_ms\":" << elapsed_ms() << "}";
+            emit(line.str());
+            return false;
+        }
+
+        const Candidate candidate = candidates_[best_];
+        lock.unlock();
+        emit(candidate_json("deadline", candidate));
+        best = candidate.encoder;
+        return true;
+    }
+
+    std::vector<CodecPerformance> AnytimeProbe::Wait()
+    {
+        if (thread_.joinable())
+            thread_.join();
+        std::lock_guard<std::mutex> lock(mutex_);
+        return ranked();
+    }
+
+    void AnytimeProbe::run()
+    {
+        const auto deadline = start_ + budget_;
+        EncodersInfo encoders;
+
+        // Opening is cheap next to encoding and already gives a usable answer, but a slow device
+        // init can still take the whole budget: whatever isn't opened by then waits.
+        std::vector<std::string> names;
+        std::vector<std::tuple<std::string, AVCodecID>> pending;
+        for (const auto &item : encoders.GetHwEncoders(AVMediaType::AVMEDIA_TYPE_VIDEO)) {
+            const auto &name = std::get<0>(item);
+            if (cancel_ || std::find(names.begin(), names.end(), name) != names.end())
+                continue;
+            names.push_back(name);
+
+            if (std::chrono::steady_clock::now() >= deadline) {
+                pending.push_back(item);
+                std::ostringstream line;
+                line << "{\"event\":\"pending\",\"encoder\":\"" << name << "\"" << std::fixed
+                     << std::setprecision(3) << ",\"t_ms\":" << elapsed_ms() << "}";
+                emit(line.str());
+                continue;
+            }
+            open(name, std::get<1>(item));
+        }
+
+        // Short benchmarks while they fit, estimated from open time plus the last frame time.
+        double frame_ms = 0.0;
+        std::vector<size_t> deferred;
+        for (size_t i = 0; i < candidates_.size() && !cancel_; i++) {
+            const double estimate = candidates_[i].open_ms + frame_ms * ANYTIME_QUICK_FRAMES;
+            if (std::chrono::steady_clock::now() + std::chrono::duration<double, std::milli>(
+                                                       estimate) > deadline) {
+                deferred.push_back(i);
+                continue;
+            }
+            const auto before = elapsed_ms();
+            benchmark(i, STAGE::QUICK, ANYTIME_QUICK_FRAMES);
+            frame_ms = std::max(0.0, elapsed_ms() - before - candidates_[i].open_ms) /
+                       ANYTIME_QUICK_FRAMES;
+        }
+
+        for (const auto &item : pending) {
+            if (cancel_)
+                break;
+            if (open(std::get<0>(item), std::get<1>(item)))
+                deferred.push_back(candidates_.size() - 1);
+        }
+
+        // Refine the most promising encoders first, the ones without a short run last.
+        std::vector<size_t> order;
+        for (const auto &encoder : ranked()) {
+            for (size_t i = 0; i < candidates_.size(); i++) {
+                if (candidates_[i].encoder.name == encoder.name &&
+                    std::find(deferred.begin(), deferred.end(), i) == deferred.end())
+                    order.push_back(i);
+            }
+        }
+        order.insert(order.end(), deferred.begin(), deferred.end());
+        for (const auto i : order) {
+            if (cancel_)
+                break;
+            benchmark(i, STAGE::FULL, TEST_FRAMES);
+        }
+
+        std::ostringstream line;
+        line << "{\"event\":\"done\",\"encoders\":" << candidates_.size()
+             << ",\"cancelled\":" << (cancel_ ? "true" : "false") << std::fixed
+             << std::setprecision(3) << ",\"t_ms\":" << elapsed_ms() << "}";
+        emit(line.str());
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_ = true;
+        done_cv_.notify_all();
+    }
+
+    bool AnytimeProbe::open(const std::string &name, AVCodecID codec_id)
+    {
+        Candidate candidate;
+        candidate.encoder.name = name;
+        candidate.encoder.codec_id = codec_id;
+        candidate.encoder.hw_type = EncodersInfo::GetEncoderDeviceType(name);
+
+        EncoderTestConfig config;
+        config.media_type = media_type_;
+        const auto open_start = std::chrono::steady_clock::now();
+        AVCodecContext *c = OpenTestEncoder(name, config);
+        candidate.open_ms = std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - open_start)
+                                .count();
+        std::ostringstream line;
+        line << "{\"event\":\"open\",\"encoder\":\"" << name << "\",\"ok\":"
+             << (c ? "true" : "false") << std::fixed << std::setprecision(3)
+             << ",\"open_ms\":" << candidate.open_ms << ",\"t_ms\":" << elapsed_ms() << "}";
+        emit(line.str());
+        if (!c)
+            return false;
+        USDT_PROBE2(encoder_close, name.c_str(), 0);
+        avcodec_free_context(&c);
+
+        Candidate best;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            candidates_.push_back(candidate);
+            if (!update_best(candidates_.size() - 1, best))
+                return true;
+        }
+        emit(candidate_json("best", best));
+        return true;
+    }
+
+    void AnytimeProbe::benchmark(size_t index, STAGE stage, int frames)
+    {
+        EncoderTestConfig config;
+        config.media_type = media_type_;
+        config.frames = frames;
+        const auto result = RunEncoderTest(candidates_[index].encoder.name, config);
+
+        Candidate candidate;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (result.opened) {
+                candidates_[index].encoder.performance = result.performance;
+                candidates_[index].stage = stage;
+            }
+            candidate = candidates_[index];
+        }
+        emit(candidate_json("benchmark", candidate));
+
+        Candidate best;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!update_best(index, best))
+                return;
+        }
+        emit(candidate_json("best", best));
+    }
+
+    // NOTE::call with mutex_ held, emit the copy in `best` after unlocking; the callback may wait
+    // on the probe.
+    bool AnytimeProbe::update_best(size_t index, Candidate &best_candidate)
+    {
+        const auto better = [](const Candidate &a, const Candidate &b)
+        {
+            // measured beats merely opened, then fps
+            if ((a.stage != STAGE::OPENED) != (b.stage != STAGE::OPENED))
+                return a.stage != STAGE::OPENED;
+            return a.encoder.performance > b.encoder.performance;
+        };
+
+        int best = best_;
+        if (best == static_cast<int>(index)) {
+            // the best one was re-measured, it may have dropped below another
+            for (size_t i = 0; i < candidates_.size(); i++) {
+                if (better(candidates_[i], candidates_[best]))
+                    best = static_cast<int>(i);
+            }
+        }
+        else if (best < 0 || better(candidates_[index], candidates_[best])) {
+            best = static_cast<int>(index);
+        }
+
+        if (best == best_)
+            return false;
+        best_ = best;
+        best_candidate = candidates_[best];
+        return true;
+    }
+
+    std::vector<CodecPerformance> AnytimeProbe::ranked() const
+    {
+        std::vector<Candidate> sorted = candidates_;
+        std::stable_sort(sorted.begin(),
+                         sorted.end(),
+                         [](const Candidate &a, const Candidate &b)
+                         { return a.encoder.performance > b.encoder.performance; });
+
+        std::vector<CodecPerformance> encoders;
+        for (const auto &candidate : sorted)
+            encoders.push_back(candidate.encoder);
+        return encoders;
+    }
+
+    double AnytimeProbe::elapsed_ms() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                         start_)
+            .count();
+    }
+
+    std::string AnytimeProbe::candidate_json(const char *event, const Candidate &candidate) const
+    {
+        const char *hw_type = av_hwdevice_get_type_name(candidate.encoder.hw_type);
+        std::ostringstream line;
+        line << "{\"event\":\"" << event << "\",\"stage\":\""
+             << stage_name(static_cast<int>(candidate.stage)) << "\",\"encoder\":\""
+             << candidate.encoder.name << "\",\"codec_id\":" << candidate.encoder.codec_id
+             << ",\"hw_type\":\"" << (hw_type ? hw_type : "none") << "\"" << std::fixed
+             << std::setprecision(3) << ",\"fps\":" << candidate.encoder.performance
+             << ",\"t_ms\":" << elapsed_ms() << "}";
+        return line.str();
+    }
+
+    void AnytimeProbe::emit(const std::string &line)
+    {
+        if (!callback_)
+            return;
+        std::lock_guard<std::mutex> lock(emit_mutex_);
+        callback_(line);
+    }
+
+} // namespace CODEC_INFO
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "codec_info.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Frames of the short benchmark that ranks encoders before the budget runs out.
+#define ANYTIME_QUICK_FRAMES 8
+
+namespace CODEC_INFO
+{
+    // Receives one NDJSON line per result, e.g.
+    // {"event":"benchmark","stage":"quick","encoder":"h264_nvenc","hw_type":"cuda","fps":612.5,...}
+    // Events: open, pending (not opened before the budget ran out), benchmark, best, deadline,
+    // done.
+    using ProbeEventCallback = std::function<void(const std::string &line)>;
+
+    // Encoder selection against a deadline. Hw encoders are opened while the budget lasts, then
+    // each one gets a short benchmark while it still fits the budget, then the encoders left
+    // pending are opened and full benchmarks refine the ranking in the background. WaitBest()
+    // answers with whatever is best when the budget expires.
+    class AnytimeProbe
+    {
+    public:
+        AnytimeProbe(MEDIA_TYPE media_type, std::chrono::milliseconds budget);
+        // cancels the refinement and waits for the running benchmark
+        ~AnytimeProbe();
+
+        // the budget starts now, callback runs on the probe thread
+        void Start(ProbeEventCallback callback);
+        // block until the budget expires or probing is done, false if nothing opened by then
+        bool WaitBest(CodecPerformance &best);
+        // block until the refinement is done, encoders best first
+        std::vector<CodecPerformance> Wait();
+        // skip the benchmarks that haven't started yet
+        void Cancel();
+
+    private:
+        enum class STAGE { OPENED, QUICK, FULL };
+
+        struct Candidate {
+            CodecPerformance encoder;
+            STAGE stage = STAGE::OPENED;
+            double open_ms = 0.0;
+        };
+
+        void run();
+        // false if the encoder doesn't open
+        bool open(const std::string &name, AVCodecID codec_id);
+        void benchmark(size_t index, STAGE stage, int frames);
+        // true and a copy of the new best if it changed
+        bool update_best(size_t index, Candidate &best_candidate);
+        std::vector<CodecPerformance> ranked() const;
+        double elapsed_ms() const;
+        std::string candidate_json(const char *event, const Candidate &candidate) const;
+        void emit(const std::string &line);
+
+        MEDIA_TYPE media_type_;
+        std::chrono::milliseconds budget_;
+        std::chrono::steady_clock::time_point start_;
+        ProbeEventCallback callback_;
+        std::thread thread_;
+        std::atomic<bool> cancel_ { false };
+
+        mutable std::mutex mutex_;
+        std::condition_variable done_cv_;
+        std::vector<Candidate> candidates_;
+        int best_ = -1;
+        bool done_ = false;
+        std::mutex emit_mutex_;
+    };
+
+} // namespace CODEC_INFO
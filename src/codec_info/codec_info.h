@@ -1,16 +1,113 @@
 #pragma once
 
 #include "third_party/ff_include.h"
+#include <cstdint>
 #include <string>
 
 namespace CODEC_INFO
 {
     enum class MEDIA_TYPE { NONE, SDR, HDR };
+
+    // What the best encoder is best at. Anything but THROUGHPUT only picks among the encoders
+    // that keep the required fps (TEST_FRAMES by default), unless none does.
+    enum class SELECTION_OBJECTIVE {
+        THROUGHPUT,  // most fps
+        HOST_CPU,    // least CPU time per frame, driver threads included
+        ENERGY,      // least package + DRAM energy per frame, THROUGHPUT without RAPL
+        LOW_LATENCY, // least encoder delay + reorder depth, or most fps within a delay cap
+    };
+
+    // Hardware counters of one benchmark, including the encoder's worker threads.
+    // Counters the CPU or the kernel doesn't offer stay -1.
+    struct PerfCounters {
+        bool collected = false;
+        int64_t cycles = -1;
+        int64_t instructions = -1;
+        int64_t llc_misses = -1;
+        int64_t branch_misses = -1;
+        int64_t context_switches = -1;
+        double ipc = 0.0;
+        double running = 0.0; // share of the time counted, below 1 when the PMU multiplexed
+        std::string error;    // why nothing or not everything was collected
+    };
+
     struct CodecPerformance {
         std::string name;
-        AVCodecID codec_id;
-        AVHWDeviceType hw_type;
+        AVCodecID codec_id = AV_CODEC_ID_NONE;
+        AVHWDeviceType hw_type = AV_HWDEVICE_TYPE_NONE;
+        double performance = 0.0;
+        PerfCounters counters; // only with EncodersInfo::SetCollectCounters
+        double cpu_per_frame = 0.0;     // host CPU seconds per encoded frame
+        double joules_per_frame = -1.0; // RAPL energy, -1 if it couldn't be read
+        // frames a packet trails its input and a decoder reorders, -1 until measured
+        double delay_frames = -1.0;
+        int reorder_depth = -1;
+    };
+
+    struct ThreadScalingPoint {
+        int thread_count;
+        int thread_type; // FF_THREAD_FRAME, FF_THREAD_SLICE or 0 for codec-internal threading
+        // what libavcodec actually used, 0 with a single thread
+        int active_thread_type;
+        double performance;
+        double speedup;    // relative to thread_count == 1 of the same thread_type
+        double efficiency; // speedup / thread_count
+        double per_thread; // fps per thread
+    };
+
+    struct AsyncDepthPoint {
+        int async_depth; // the encoder's async_depth option, frames it keeps in flight
         double performance;
+        double speedup; // relative to async_depth == 1
+    };
+
+    struct RealtimePoint {
+        double target_fps;
+        int frames;
+        int deadline_misses;
+        double miss_rate;
+        double latency_budget; // seconds from arrival to deadline
+        double max_lateness;   // seconds past the deadline, 0 if no frame missed it
+        double jitter;         // standard deviation of the per-frame lateness, seconds
+        bool sustained;        // miss_rate within the allowed rate
+    };
+
+    struct StreamPackingPoint {
+        int streams;
+        int threads_per_stream;
+        double aggregate_performance;  // sum of all streams' fps
+        double min_stream_performance; // slowest stream's fps
+        double realtime_margin;        // min_stream_performance / target fps
+        bool sustainable;              // every stream keeps the target fps
+    };
+
+    // What one more open session of an encoder costs, a least-squares line over 1..sessions
+    // sessions open at once.
+    struct SessionMemoryModel {
+        int sessions = 0;              // largest number of sessions measured
+        bool session_limit = false;    // the encoder refused to open one more before the maximum
+        double base_bytes = 0.0;       // paid once, e.g. the device context and driver state
+        double per_session_bytes = 0.0;
+        double device_per_session_bytes = -1.0; // -1 where the driver doesn't report it
+        double fit_r2 = 0.0;
+    };
+
+    // Sessions a node can run of one encoder, whichever of memory and throughput runs out first.
+    struct SessionCapacity {
+        int by_memory = 0;
+        int by_throughput = 0;
+        int sessions = 0;
+        bool memory_bound = false;
+    };
+
+    struct RaceStats {
+        int candidates = 0;
+        int rounds = 0;
+        int eliminated = 0;              // dropped after a round, aborted ones included
+        int aborted = 0;                 // trial cut short far behind the round's leader
+        int frames = 0;                  // frames encoded over all trials
+        double seconds = 0.0;            // wall time of the race
+        double exhaustive_seconds = 0.0; // estimate for a full run of every candidate
     };
 
 } // namespace CODEC_INFO
\ No newline at end of file
@@ -0,0 +1,359 @@
+#include "codec_info_c.h"
+#include "device_watcher.h"
+#include "encoders_info.h"
+#include "job_scheduler.h"
+#include "probe_cache.h"
+#include "probe_client.h"
+#include "shm_ranking.h"
+#include <cstring>
+#include <memory>
+
+namespace CODEC_INFO
+{
+    static ProbeCache &c_api_cache()
+    {
+        static ProbeCache cache;
+        return cache;
+    }
+
+    static DeviceWatcher &c_api_device_watcher()
+    {
+        // constructed after the cache so it stops before the cache goes away
+        c_api_cache();
+        static DeviceWatcher watcher;
+        return watcher;
+    }
+
+    static MEDIA_TYPE to_media_type(codec_info_media_type media_type)
+    {
+        switch (media_type) {
+        case CODEC_INFO_MEDIA_TYPE_SDR:
+            return MEDIA_TYPE::SDR;
+        case CODEC_INFO_MEDIA_TYPE_HDR:
+            return MEDIA_TYPE::HDR;
+        default:
+            return MEDIA_TYPE::NONE;
+        }
+    }
+
+    static void copy_name(char (&dst)[CODEC_INFO_NAME_SIZE], const char *src)
+    {
+        std::strncpy(dst, src ? src : "", CODEC_INFO_NAME_SIZE - 1);
+        dst[CODEC_INFO_NAME_SIZE - 1] = '\0';
+    }
+
+    static void copy_device(char (&dst)[CODEC_INFO_NAME_SIZE], AVHWDeviceType hw_type)
+    {
+        copy_name(dst, hw_type == AV_HWDEVICE_TYPE_NONE ? "" : av_hwdevice_get_type_name(hw_type));
+    }
+
+    static codec_info_encoder to_c(const CodecPerformance &performance)
+    {
+        codec_info_encoder encoder;
+        copy_name(encoder.name, performance.name.c_str());
+        copy_device(encoder.device, performance.hw_type);
+        encoder.codec_id = performance.codec_id;
+        encoder.hw_type = performance.hw_type;
+        encoder.performance = performance.performance;
+        return encoder;
+    }
+
+    static codec_info_encoder to_c(const ProbeEntry &entry)
+    {
+        CodecPerformance performance;
+        performance.name = entry.name;
+        performance.codec_id = static_cast<AVCodecID>(entry.codec_id);
+        performance.hw_type = static_cast<AVHWDeviceType>(entry.hw_type);
+        performance.performance = entry.performance;
+        return to_c(performance);
+    }
+
+} // namespace CODEC_INFO
+
+using namespace CODEC_INFO;
+
+// Every entry point catches what the C++ side throws (bad_alloc, system_error from a thread or
+// mutex, ...), an exception crossing into the host's C code would terminate it.
+
+int codec_info_probe(codec_info_media_type media_type)
+{
+    try {
+        c_api_cache().Probe(to_media_type(media_type), false);
+        return 0;
+    }
+    catch (...) {
+        return -1;
+    }
+}
+
+int codec_info_benchmark(codec_info_media_type media_type)
+{
+    try {
+        const auto results = c_api_cache().Probe(to_media_type(media_type), true);
+        return results->encoders.empty() ? -1 : 0;
+    }
+    catch (...) {
+        return -1;
+    }
+}
+
+void codec_info_clear_cache(void)
+{
+    try {
+        c_api_cache().Clear();
+    }
+    catch (...) {
+        // nothing to report, the cache keeps what it had
+    }
+}
+
+int codec_info_watch_devices(int enable)
+{
+    try {
+        auto &watcher = c_api_device_watcher();
+        if (!enable) {
+            watcher.Stop();
+            return 0;
+        }
+        const bool ok = watcher.Start(
+            [](const std::vector<AVHWDeviceType> &hw_types)
+            {
+                // the watcher's thread, a failed re-probe keeps the previous results
+                try {
+                    c_api_cache().UpdateDevices(hw_types);
+                }
+                catch (...) {
+                }
+            });
+        return ok ? 0 : -1;
+    }
+    catch (...) {
+        return -1;
+    }
+}
+
+size_t codec_info_get_ranked_encoders(codec_info_media_type media_type,
+                                      codec_info_encoder *encoders,
+                                      size_t capacity)
+{
+    try {
+        const auto results = c_api_cache().GetOrProbe(to_media_type(media_type), true);
+        for (size_t i = 0; encoders && i < capacity && i < results->encoders.size(); i++)
+            encoders[i] = to_c(results->encoders[i]);
+        return results->encoders.size();
+    }
+    catch (...) {
+        return 0;
+    }
+}
+
+size_t codec_info_get_device_encoders(codec_info_encoder *encoders, size_t capacity)
+{
+    try {
+        const auto results = c_api_cache().GetOrProbe(MEDIA_TYPE::NONE, false);
+        for (size_t i = 0; encoders && i < capacity && i < results->device_encoders.size(); i++) {
+            const auto &item = results->device_encoders[i];
+            CodecPerformance performance;
+            performance.name = std::get<0>(item);
+            performance.codec_id = std::get<1>(item);
+            performance.hw_type = std::get<2>(item);
+            encoders[i] = to_c(performance);
+        }
+        return results->device_encoders.size();
+    }
+    catch (...) {
+        return 0;
+    }
+}
+
+size_t codec_info_get_device_decoders(codec_info_decoder *decoders, size_t capacity)
+{
+    try {
+        const auto results = c_api_cache().GetOrProbe(MEDIA_TYPE::NONE, false);
+        for (size_t i = 0; decoders && i < capacity && i < results->device_decoders.size(); i++) {
+            const auto &item = results->device_decoders[i];
+            copy_name(decoders[i].name, std::get<0>(item).c_str());
+            copy_device(decoders[i].device, std::get<2>(item));
+            decoders[i].codec_id = std::get<1>(item);
+            decoders[i].hw_type = std::get<2>(item);
+        }
+        return results->device_decoders.size();
+    }
+    catch (...) {
+        return 0;
+    }
+}
+
+int codec_info_find_best_encoder(codec_info_media_type media_type, codec_info_encoder *encoder)
+{
+    try {
+        const auto results = c_api_cache().GetOrProbe(to_media_type(media_type), true);
+        if (!encoder || results->encoders.empty() || results->encoders.front().performance <= 0.0)
+            return -1;
+
+        *encoder = to_c(results->encoders.front());
+        return 0;
+    }
+    catch (...) {
+        return -1;
+    }
+}
+
+int codec_info_daemon_get_ranked_encoders(const char *socket_path,
+                                          codec_info_media_type media_type,
+                                          codec_info_encoder *encoders,
+                                          size_t capacity,
+                                          size_t *count)
+{
+    try {
+        ProbeClient client;
+        if (!client.Connect(socket_path ? socket_path : PROBE_DEFAULT_SOCKET))
+            return -1;
+
+        std::vector<ProbeEntry> entries;
+        const auto status =
+            client.Query(PROBE_OP::RANKED_ENCODERS, to_media_type(media_type), entries);
+        if (status != PROBE_STATUS::OK)
+            return static_cast<int>(status);
+
+        for (size_t i = 0; encoders && i < capacity && i < entries.size(); i++)
+            encoders[i] = to_c(entries[i]);
+        if (count)
+            *count = entries.size();
+        return 0;
+    }
+    catch (...) {
+        return -1;
+    }
+}
+
+struct codec_info_shm_reader {
+    ShmRankingReader reader;
+    std::vector<ProbeEntry> entries;
+};
+
+codec_info_shm_reader *codec_info_shm_open(const char *name)
+{
+    try {
+        std::unique_ptr<codec_info_shm_reader> handle(new codec_info_shm_reader);
+        if (!handle->reader.Open(name ? name : SHM_RANKING_DEFAULT_NAME))
+            return nullptr;
+        return handle.release();
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+
+void codec_info_shm_close(codec_info_shm_reader *reader) { delete reader; }
+
+int codec_info_shm_get_ranked_encoders(codec_info_shm_reader *reader,
+                                       codec_info_media_type media_type,
+                                       codec_info_encoder *encoders,
+                                       size_t capacity,
+                                       size_t *count)
+{
+    try {
+        if (!reader)
+            return -1;
+        if (!reader->reader.ReadEncoders(to_media_type(media_type), reader->entries))
+            return reader->reader.IsOpen() ? 1 : CODEC_INFO_SHM_UNAVAILABLE;
+
+        for (size_t i = 0; encoders && i < capacity && i < reader->entries.size(); i++)
+            encoders[i] = to_c(reader->entries[i]);
+        if (count)
+            *count = reader->entries.size();
+        return 0;
+    }
+    catch (...) {
+        return -1;
+    }
+}
+
+struct codec_info_scheduler {
+    std::unique_ptr<JobScheduler> scheduler;
+};
+
+codec_info_scheduler *codec_info_scheduler_open(codec_info_media_type media_type)
+{
+    try {
+        const auto results = c_api_cache().GetOrProbe(to_media_type(media_type), true);
+        std::vector<AVCodecID> codec_ids;
+        for (const auto &encoder : results->encoders)
+            codec_ids.push_back(encoder.codec_id);
+        EncodersInfo encoders;
+        encoders.SetLogStream(nullptr);
+        const auto software = encoders.DetectSwVideoEncoders(to_media_type(media_type), codec_ids);
+
+        auto capacities =
+            JobScheduler::MakeCapacities(results->encoders, software, TEST_WIDTH, TEST_HEIGHT);
+        if (capacities.empty())
+            return nullptr;
+        std::unique_ptr<codec_info_scheduler> handle(new codec_info_scheduler);
+        handle->scheduler.reset(new JobScheduler(std::move(capacities)));
+        return handle.release();
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+
+void codec_info_scheduler_close(codec_info_scheduler *scheduler) { delete scheduler; }
+
+static JobRequest to_request(const codec_info_job &job)
+{
+    return JobRequest { static_cast<AVCodecID>(job.codec_id), job.width, job.height, job.fps };
+}
+
+int codec_info_scheduler_can_admit(codec_info_scheduler *scheduler, const codec_info_job *job)
+{
+    try {
+        if (!scheduler || !job)
+            return -1;
+        return scheduler->scheduler->CanAdmit(to_request(*job)) ? 1 : 0;
+    }
+    catch (...) {
+        return -1;
+    }
+}
+
+int codec_info_scheduler_reserve(codec_info_scheduler *scheduler,
+                                 const codec_info_job *job,
+                                 codec_info_placement *placement)
+{
+    try {
+        if (!scheduler || !job || !placement)
+            return -1;
+        JobPlacement reserved;
+        if (!scheduler->scheduler->Reserve(to_request(*job), reserved))
+            return 1;
+
+        const auto &capacity = scheduler->scheduler->Capacities()[reserved.encoder];
+        CodecPerformance performance;
+        performance.name = capacity.name;
+        performance.codec_id = capacity.codec_id;
+        performance.hw_type = capacity.hw_type;
+        performance.performance = capacity.pixels_per_second / (TEST_WIDTH * TEST_HEIGHT);
+        placement->ticket = reserved.ticket;
+        placement->encoder = to_c(performance);
+        copy_name(placement->device_path, capacity.device.c_str());
+        placement->device_index = capacity.device_index;
+        placement->hardware = reserved.hardware;
+        return 0;
+    }
+    catch (...) {
+        return -1;
+    }
+}
+
+int codec_info_scheduler_release(codec_info_scheduler *scheduler, long long ticket)
+{
+    try {
+        if (!scheduler)
+            return -1;
+        return scheduler->scheduler->Release(ticket) ? 0 : -1;
+    }
+    catch (...) {
+        return -1;
+    }
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+/* C ABI of the codec_info library, for in-process use without parsing ffmpeg_tools output.
+ * Functions returning int give 0 on success and a negative value on failure; list queries
+ * return the total number of entries and fill at most `capacity` of them. No C++ exception
+ * leaves these functions, they fail with a negative value, 0 entries or NULL instead. */
+
+#include <stddef.h>
+
+#if defined(_WIN32) && defined(CODEC_INFO_SHARED)
+#ifdef CODEC_INFO_BUILD
+#define CODEC_INFO_API __declspec(dllexport)
+#else
+#define CODEC_INFO_API __declspec(dllimport)
+#endif
+#elif defined(__GNUC__)
+#define CODEC_INFO_API __attribute__((visibility("default")))
+#else
+#define CODEC_INFO_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CODEC_INFO_NAME_SIZE 64
+
+typedef enum codec_info_media_type {
+    CODEC_INFO_MEDIA_TYPE_NONE = 0,
+    CODEC_INFO_MEDIA_TYPE_SDR = 1,
+    CODEC_INFO_MEDIA_TYPE_HDR = 2,
+} codec_info_media_type;
+
+typedef struct codec_info_encoder {
+    char name[CODEC_INFO_NAME_SIZE];
+    char device[CODEC_INFO_NAME_SIZE]; /* av_hwdevice_get_type_name(), empty when unknown */
+    int codec_id;                      /* AVCodecID */
+    int hw_type;                       /* AVHWDeviceType */
+    double performance;                /* fps, 0 when not benchmarked */
+} codec_info_encoder;
+
+typedef struct codec_info_decoder {
+    char name[CODEC_INFO_NAME_SIZE];
+    char device[CODEC_INFO_NAME_SIZE];
+    int codec_id;
+    int hw_type;
+} codec_info_decoder;
+
+/* Enumerate the encoders and decoders the devices can open, replacing cached results. */
+CODEC_INFO_API int codec_info_probe(codec_info_media_type media_type);
+/* Probe and benchmark the hardware encoders, replacing cached results. */
+CODEC_INFO_API int codec_info_benchmark(codec_info_media_type media_type);
+/* Drop all cached results. */
+CODEC_INFO_API void codec_info_clear_cache(void);
+/* Re-probe cached results of hot-plugged or reset devices in the background (Linux).
+ * Returns 0 on success, -1 if device changes can't be watched. */
+CODEC_INFO_API int codec_info_watch_devices(int enable);
+
+/* Benchmarked hardware encoders, best first. Benchmarks on first use, cached afterwards. */
+CODEC_INFO_API size_t codec_info_get_ranked_encoders(codec_info_media_type media_type,
+                                                     codec_info_encoder *encoders,
+                                                     size_t capacity);
+/* Encoders each device can open. Probes on first use, cached afterwards. */
+CODEC_INFO_API size_t codec_info_get_device_encoders(codec_info_encoder *encoders,
+                                                     size_t capacity);
+CODEC_INFO_API size_t codec_info_get_device_decoders(codec_info_decoder *decoders,
+                                                     size_t capacity);
+CODEC_INFO_API int codec_info_find_best_encoder(codec_info_media_type media_type,
+                                                codec_info_encoder *encoder);
+
+/* Ranked encoders from a running `ffmpeg_tools --daemon`, NULL socket_path for the default.
+ * Returns 0, 1 while the daemon's first probe is still running, or a negative error. */
+CODEC_INFO_API int codec_info_daemon_get_ranked_encoders(const char *socket_path,
+                                                         codec_info_media_type media_type,
+                                                         codec_info_encoder *encoders,
+                                                         size_t capacity,
+                                                         size_t *count);
+
+/* Zero-syscall reads of the shared-memory ranking table a daemon started with --shm publishes.
+ * Keep the reader open for the life of the process; reads only touch mapped memory. */
+typedef struct codec_info_shm_reader codec_info_shm_reader;
+
+/* NULL name for the default segment, returns NULL if it doesn't exist */
+CODEC_INFO_API codec_info_shm_reader *codec_info_shm_open(const char *name);
+CODEC_INFO_API void codec_info_shm_close(codec_info_shm_reader *reader);
+/* Returned while no table is published under the reader's name, e.g. the daemon is restarting
+ * or gone: ask the daemon socket instead. Later calls pick up a new table by themselves. */
+#define CODEC_INFO_SHM_UNAVAILABLE (-2)
+/* Returns 0, 1 if nothing was published for the media type yet, or a negative error. */
+CODEC_INFO_API int codec_info_shm_get_ranked_encoders(codec_info_shm_reader *reader,
+                                                      codec_info_media_type media_type,
+                                                      codec_info_encoder *encoders,
+                                                      size_t capacity,
+                                                      size_t *count);
+
+/* Places encode jobs on the benchmarked encoders by weighted bin-packing, one bin per device,
+ * hardware first and a software encoder per codec for the spill. Reservations are lock-free
+ * and may be made from any thread. */
+typedef struct codec_info_scheduler codec_info_scheduler;
+
+typedef struct codec_info_job {
+    int codec_id; /* AVCodecID */
+    int width;
+    int height;
+    double fps;
+} codec_info_job;
+
+typedef struct codec_info_placement {
+    long long ticket;
+    codec_info_encoder encoder;
+    /* device string for av_hwdevice_ctx_create, empty for the default device */
+    char device_path[CODEC_INFO_NAME_SIZE];
+    int device_index; /* among devices of encoder.hw_type */
+    int hardware;
+} codec_info_placement;
+
+/* Capacities from the cached benchmarks of media_type (benchmarking on first use) and of the
+ * software encoders for the same codecs. NULL if nothing could be benchmarked. */
+CODEC_INFO_API codec_info_scheduler *codec_info_scheduler_open(codec_info_media_type media_type);
+CODEC_INFO_API void codec_info_scheduler_close(codec_info_scheduler *scheduler);
+/* Returns 1 if the job fits somewhere right now, 0 if not, or a negative error. */
+CODEC_INFO_API int codec_info_scheduler_can_admit(codec_info_scheduler *scheduler,
+                                                  const codec_info_job *job);
+/* Returns 0 and fills placement, 1 if no device has room for the job, or a negative error. */
+CODEC_INFO_API int codec_info_scheduler_reserve(codec_info_scheduler *scheduler,
+                                                const codec_info_job *job,
+                                                codec_info_placement *placement);
+/* Returns 0, or a negative error for an unknown ticket. */
+CODEC_INFO_API int codec_info_scheduler_release(codec_info_scheduler *scheduler, long long ticket);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,4 +1,6 @@
 #include "decoders_info.h"
+#include "trace.h"
+#include "usdt.h"
 
 namespace CODEC_INFO
 {
@@ -33,42 +35,74 @@ namespace CODEC_INFO
         AVHWDeviceType hw_type = AV_HWDEVICE_TYPE_NONE;
 
         while ((hw_type = av_hwdevice_iterate_types(hw_type)) != AV_HWDEVICE_TYPE_NONE) {
-            AVBufferRef *hw_device_ctx = nullptr;
-            if (av_hwdevice_ctx_create(&hw_device_ctx, hw_type, nullptr, nullptr, 0) < 0) {
+            const auto device_decoders = GetDeviceHwDecoders(media_type, hw_type);
+            supported_decoders.insert(
+                supported_decoders.end(), device_decoders.begin(), device_decoders.end());
+        }
+
+        return supported_decoders;
+    }
+
+    std::vector<std::tuple<std::string, AVCodecID, AVHWDeviceType>>
+    DecodersInfo::GetDeviceHwDecoders(AVMediaType media_type, AVHWDeviceType hw_type)
+    {
+        std::vector<std::tuple<std::string, AVCodecID, AVHWDeviceType>> supported_decoders;
+        const char *hw_name = av_hwdevice_get_type_name(hw_type);
+        TRACE_SCOPE("GetDeviceHwDecoders", hw_name);
+        USDT_PROBE2(phase_begin, "GetDeviceHwDecoders", hw_name);
+
+        AVBufferRef *hw_device_ctx = nullptr;
+        int ret = 0;
+        {
+            TRACE_SCOPE("av_hwdevice_ctx_create", hw_name);
+            ret = av_hwdevice_ctx_create(&hw_device_ctx, hw_type, nullptr, nullptr, 0);
+        }
+        USDT_PROBE2(device_init, hw_name, ret);
+        if (ret < 0) {
+            USDT_PROBE2(phase_end, "GetDeviceHwDecoders", 0);
+            return supported_decoders;
+        }
+
+        const AVCodec *codec = nullptr;
+        void *opaque = nullptr;
+        while ((codec = av_codec_iterate(&opaque))) {
+            if (!av_codec_is_decoder(codec) || codec->type != media_type) {
                 continue;
             }
 
-            const AVCodec *codec = nullptr;
-            void *opaque = nullptr;
-            while ((codec = av_codec_iterate(&opaque))) {
-                if (!av_codec_is_decoder(codec) || codec->type != media_type) {
-                    continue;
+            for (int i = 0;; i++) {
+                const AVCodecHWConfig *config = avcodec_get_hw_config(codec, i);
+                if (!config) {
+                    break;
                 }
 
-                for (int i = 0;; i++) {
-                    const AVCodecHWConfig *config = avcodec_get_hw_config(codec, i);
-                    if (!config) {
-                        break;
+                if (config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX &&
+                    config->device_type == hw_type) {
+                    AVCodecContext *ctx = avcodec_alloc_context3(codec);
+                    if (!ctx) {
+                        continue;
                     }
 
-                    if (config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX &&
-                        config->device_type == hw_type) {
-                        AVCodecContext *ctx = avcodec_alloc_context3(codec);
-                        if (!ctx) {
-                            continue;
-                        }
-
-                        ctx->hw_device_ctx = av_buffer_ref(hw_device_ctx);
-                        if (avcodec_open2(ctx, codec, nullptr) == 0) {
-                            supported_decoders.emplace_back(codec->name, codec->id, hw_type);
-                        }
-                        avcodec_free_context(&ctx);
-                        break;
+                    ctx->hw_device_ctx = av_buffer_ref(hw_device_ctx);
+                    bool opened = false;
+                    {
+                        TRACE_SCOPE("avcodec_open2", codec->name);
+                        ret = avcodec_open2(ctx, codec, nullptr);
+                        opened = ret == 0;
+                    }
+                    USDT_PROBE3(decoder_open, codec->name, hw_name, ret);
+                    if (opened) {
+                        supported_decoders.emplace_back(codec->name, codec->id, hw_type);
                     }
+                    TRACE_SCOPE("avcodec_free_context", codec->name);
+                    avcodec_free_context(&ctx);
+                    break;
                 }
             }
-            av_buffer_unref(&hw_device_ctx);
         }
+        TRACE_SCOPE("av_hwdevice_ctx_free", hw_name);
+        av_buffer_unref(&hw_device_ctx);
+        USDT_PROBE2(phase_end, "GetDeviceHwDecoders", static_cast<int>(supported_decoders.size()));
 
         return supported_decoders;
     }
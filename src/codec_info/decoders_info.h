@@ -19,6 +19,8 @@ namespace CODEC_INFO
         // NOTE::Obtain the hardware devices supported by the current computer.
         std::vector<std::tuple<std::string, AVCodecID, AVHWDeviceType>>
         GetDeviceHwDecoders(AVMediaType media_type);
+        std::vector<std::tuple<std::string, AVCodecID, AVHWDeviceType>>
+        GetDeviceHwDecoders(AVMediaType media_type, AVHWDeviceType hw_type);
         std::vector<std::tuple<std::string, AVCodecID>> GetSwDecoders(AVMediaType media_type);
 
     private:
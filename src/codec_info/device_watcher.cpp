@@ -0,0 +1,191 @@
+#include "device_watcher.h"
+#include "trace.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/netlink.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+// Events usually come in bursts (card + renderD + uevents), re-probe once they settle.
+#define DEVICE_SETTLE_MS 500
+
+namespace CODEC_INFO
+{
+    static bool starts_with(const std::string &text, const char *prefix)
+    {
+        return text.compare(0, std::strlen(prefix), prefix) == 0;
+    }
+
+    std::vector<AVHWDeviceType> DeviceWatcher::DeviceTypesFor(const std::string &name)
+    {
+        std::vector<const char *> type_names;
+        if (starts_with(name, "nvidia")) {
+            type_names = { "cuda", "vdpau", "vulkan", "opencl" };
+        }
+        else if (starts_with(name, "renderD") || starts_with(name, "card") ||
+                 starts_with(name, "dri") || name == "i915" || name == "xe" ||
+                 name == "amdgpu" || name == "radeon" || name == "nouveau") {
+            type_names = { "vaapi", "qsv", "drm", "vdpau", "vulkan", "opencl" };
+        }
+
+        // Only types this FFmpeg build knows about.
+        std::vector<AVHWDeviceType> hw_types;
+        for (const auto type_name : type_names) {
+            const auto hw_type = av_hwdevice_find_type_by_name(type_name);
+            if (hw_type != AV_HWDEVICE_TYPE_NONE)
+                hw_types.push_back(hw_type);
+        }
+        return hw_types;
+    }
+
+    DeviceWatcher::DeviceWatcher() {}
+
+    DeviceWatcher::~DeviceWatcher() { Stop(); }
+
+#if defined(__linux__)
+    bool DeviceWatcher::Start(ChangeCallback callback)
+    {
+        Stop();
+        callback_ = std::move(callback);
+
+        inotify_fd_ = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+        if (inotify_fd_ >= 0) {
+            // /dev catches nvidia* nodes and /dev/dri itself appearing on a headless box.
+            inotify_add_watch(inotify_fd_, "/dev", IN_CREATE | IN_DELETE);
+            dri_watch_ =
+                inotify_add_watch(inotify_fd_, "/dev/dri", IN_CREATE | IN_DELETE | IN_ATTRIB);
+        }
+
+        netlink_fd_ = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                             NETLINK_KOBJECT_UEVENT);
+        if (netlink_fd_ >= 0) {
+            sockaddr_nl addr {};
+            addr.nl_family = AF_NETLINK;
+            addr.nl_groups = 1; // kernel uevents
+            if (bind(netlink_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+                close(netlink_fd_);
+                netlink_fd_ = -1;
+            }
+        }
+
+        if (inotify_fd_ < 0 && netlink_fd_ < 0)
+            return false;
+
+        stop_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        thread_ = std::thread(
+            [this]()
+            {
+                Trace::SetThreadName("device watcher");
+                watch_loop();
+            });
+        return true;
+    }
+
+    void DeviceWatcher::Stop()
+    {
+        if (thread_.joinable()) {
+            const uint64_t one = 1;
+            (void)!write(stop_fd_, &one, sizeof(one));
+            thread_.join();
+        }
+        for (int *fd : { &inotify_fd_, &netlink_fd_, &stop_fd_ }) {
+            if (*fd >= 0)
+                close(*fd);
+            *fd = -1;
+        }
+        dri_watch_ = -1;
+    }
+
+    void DeviceWatcher::watch_loop()
+    {
+        std::vector<AVHWDeviceType> pending;
+        const auto add = [&](const std::string &name)
+        {
+            for (const auto hw_type : DeviceTypesFor(name)) {
+                if (std::find(pending.begin(), pending.end(), hw_type) == pending.end())
+                    pending.push_back(hw_type);
+            }
+        };
+
+        alignas(inotify_event) char buffer[8192];
+        for (;;) {
+            pollfd fds[3] = { { stop_fd_, POLLIN, 0 },
+                              { inotify_fd_, POLLIN, 0 },
+                              { netlink_fd_, POLLIN, 0 } };
+            const int ready = poll(fds, 3, pending.empty() ? -1 : DEVICE_SETTLE_MS);
+            if (ready < 0 && errno != EINTR)
+                return;
+            if (fds[0].revents)
+                return;
+
+            if (ready == 0) {
+                TRACE_SCOPE("device_change");
+                callback_(pending);
+                pending.clear();
+                continue;
+            }
+
+            if (fds[1].revents & POLLIN) {
+                ssize_t size = 0;
+                while ((size = read(inotify_fd_, buffer, sizeof(buffer))) > 0) {
+                    for (char *p = buffer; p < buffer + size;) {
+                        const auto *event = reinterpret_cast<inotify_event *>(p);
+                        const std::string name = event->len ? event->name : "";
+                        if (event->wd == dri_watch_ || starts_with(name, "nvidia")) {
+                            add(event->wd == dri_watch_ ? "dri" : name);
+                        }
+                        else if (name == "dri" && (event->mask & IN_CREATE)) {
+                            dri_watch_ = inotify_add_watch(
+                                inotify_fd_, "/dev/dri", IN_CREATE | IN_DELETE | IN_ATTRIB);
+                            add(name);
+                        }
+                        p += sizeof(inotify_event) + event->len;
+                    }
+                }
+            }
+
+            if (fds[2].revents & POLLIN) {
+                ssize_t size = 0;
+                while ((size = recv(netlink_fd_, buffer, sizeof(buffer) - 1, 0)) > 0) {
+                    // "action@devpath\0KEY=value\0..."
+                    buffer[size] = '\0';
+                    std::string subsystem, driver, devname, devpath;
+                    for (char *p = buffer; p < buffer + size; p += std::strlen(p) + 1) {
+                        const std::string field = p;
+                        if (starts_with(field, "SUBSYSTEM="))
+                            subsystem = field.substr(10);
+                        else if (starts_with(field, "DRIVER="))
+                            driver = field.substr(7);
+                        else if (starts_with(field, "DEVNAME="))
+                            devname = field.substr(8);
+                        else if (starts_with(field, "DEVPATH="))
+                            devpath = field.substr(8);
+                    }
+
+                    if (subsystem == "drm")
+                        add(devname.empty() ? "dri" : devname.substr(devname.rfind('/') + 1));
+                    else if (subsystem == "module")
+                        add(devpath.substr(devpath.rfind('/') + 1));
+                    else if (!driver.empty())
+                        add(driver);
+                }
+            }
+        }
+    }
+#else
+    // NOTE::inotify and uevent netlink are Linux only.
+    bool DeviceWatcher::Start(ChangeCallback) { return false; }
+
+    void DeviceWatcher::Stop() {}
+
+    void DeviceWatcher::watch_loop() {}
+#endif
+
+} // namespace CODEC_INFO
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "codec_info.h"
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace CODEC_INFO
+{
+    // Watches device nodes (inotify on /dev/dri and /dev/nvidia*) and kernel uevents (driver
+    // bind, unbind, reset, module load) and reports which hw device types need re-probing.
+    class DeviceWatcher
+    {
+    public:
+        using ChangeCallback = std::function<void(const std::vector<AVHWDeviceType> &)>;
+
+        DeviceWatcher();
+        ~DeviceWatcher();
+
+        // callback runs on the watcher thread once events settle, false if nothing can be watched
+        bool Start(ChangeCallback callback);
+        void Stop();
+
+        // hw device types backed by a device node or kernel driver name, e.g. renderD128, nvidia
+        static std::vector<AVHWDeviceType> DeviceTypesFor(const std::string &name);
+
+    private:
+        void watch_loop();
+
+        ChangeCallback callback_;
+        std::thread thread_;
+        int inotify_fd_ = -1;
+        int dri_watch_ = -1;
+        int netlink_fd_ = -1;
+        int stop_fd_ = -1;
+    };
+
+} // namespace CODEC_INFO
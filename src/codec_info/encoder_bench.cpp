@@ -0,0 +1,516 @@
+#include "encoder_bench.h"
+#include "energy_meter.h"
+#include "perf_counters.h"
+#include "process_stats.h"
+#include "trace.h"
+#include "usdt.h"
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <time.h>
+#endif
+
+// Wider than any codec's reorder buffer, H.264 and HEVC hold at most 16 frames.
+#define MAX_REORDER_DEPTH 32
+// How often a paced run looks for packets while it waits for the next frame.
+#define PACE_POLL_MICROSECONDS 250
+
+namespace CODEC_INFO
+{
+    // absolute sleep, so the schedule doesn't drift with the time spent encoding
+    static void pace_until(std::chrono::steady_clock::time_point when)
+    {
+#if defined(__linux__)
+        // steady_clock is CLOCK_MONOTONIC with glibc and libc++
+        const auto since_epoch = when.time_since_epoch();
+        const auto sec = std::chrono::duration_cast<std::chrono::seconds>(since_epoch);
+        timespec ts;
+        ts.tv_sec = static_cast<time_t>(sec.count());
+        ts.tv_nsec = static_cast<long>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch - sec).count());
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+        }
+#else
+        std::this_thread::sleep_until(when);
+#endif
+    }
+
+    // most packets ahead of one in decode order with a higher pts, MAX_REORDER_DEPTH back
+    static int reorder_depth(const std::vector<int64_t> &pts)
+    {
+        int depth = 0;
+        for (size_t i = 0; i < pts.size(); i++) {
+            int later = 0;
+            for (size_t j = i > MAX_REORDER_DEPTH ? i - MAX_REORDER_DEPTH : 0; j < i; j++)
+                later += pts[j] > pts[i];
+            depth = std::max(depth, later);
+        }
+        return depth;
+    }
+
+    AVCodecContext *OpenTestEncoder(const std::string &name, const EncoderTestConfig &config)
+    {
+        const AVCodec *codec = avcodec_find_encoder_by_name(name.c_str());
+        if (!codec)
+            return nullptr;
+
+        AVCodecContext *c = avcodec_alloc_context3(codec);
+        if (!c)
+            return nullptr;
+
+        c->bit_rate = 5000000;
+        c->width = config.width;
+        c->height = config.height;
+        c->time_base = { 1, TEST_FRAMES };
+        c->framerate = { TEST_FRAMES, 1 };
+        c->gop_size = config.gop_size;
+        c->max_b_frames = config.max_b_frames;
+        c->flags |= config.codec_flags;
+        c->pix_fmt = config.media_type == CODEC_INFO::MEDIA_TYPE::HDR ? AV_PIX_FMT_YUV420P10LE
+                                                                      : AV_PIX_FMT_YUV420P;
+        if (config.thread_count > 0)
+            c->thread_count = config.thread_count;
+        if (config.thread_type > 0)
+            c->thread_type = config.thread_type;
+
+        if (config.media_type != CODEC_INFO::MEDIA_TYPE::NONE) {
+            if (config.media_type == CODEC_INFO::MEDIA_TYPE::HDR) {
+                c->color_primaries = AVCOL_PRI_BT2020;
+                c->color_trc = AVCOL_TRC_SMPTE2084;
+                c->colorspace = AVCOL_SPC_BT2020_NCL;
+            }
+            else {
+                c->color_primaries = AVCOL_PRI_BT709;
+                c->color_trc = AVCOL_TRC_BT709;
+                c->colorspace = AVCOL_SPC_BT709;
+            }
+        }
+
+        // the encoder's own queue, explicit codec_options still override it
+        if (config.async_depth > 1)
+            av_opt_set_int(c, "async_depth", config.async_depth, AV_OPT_SEARCH_CHILDREN);
+        for (const auto &option : config.codec_options)
+            av_opt_set(c, option.first.c_str(), option.second.c_str(), AV_OPT_SEARCH_CHILDREN);
+
+        TRACE_SCOPE("avcodec_open2", name.c_str());
+        const int ret = avcodec_open2(c, codec, NULL);
+        USDT_PROBE4(encoder_open, name.c_str(), c->width, c->height, ret);
+        if (ret < 0) {
+            avcodec_free_context(&c);
+            return nullptr;
+        }
+        return c;
+    }
+
+    bool EncoderHasOption(const std::string &name, const char *option)
+    {
+        const AVCodec *codec = avcodec_find_encoder_by_name(name.c_str());
+        if (!codec)
+            return false;
+        // an unopened context already carries the private options
+        AVCodecContext *c = avcodec_alloc_context3(codec);
+        if (!c)
+            return false;
+        const bool found = av_opt_find(c, option, nullptr, 0, AV_OPT_SEARCH_CHILDREN) != nullptr;
+        avcodec_free_context(&c);
+        return found;
+    }
+
+    AVFrame *AllocTestFrame(const AVCodecContext *c)
+    {
+        AVFrame *frame = av_frame_alloc();
+        if (!frame)
+            return nullptr;
+
+        frame->format = c->pix_fmt;
+        frame->width = c->width;
+        frame->height = c->height;
+        frame->color_primaries = c->color_primaries;
+        frame->color_trc = c->color_trc;
+        frame->colorspace = c->colorspace;
+        if (av_frame_get_buffer(frame, 0) < 0)
+            av_frame_free(&frame);
+        return frame;
+    }
+
+    void FillTestFrame(AVFrame *frame, int index, bool is_hdr)
+    {
+        // Frame-threaded encoders may still hold a reference to the previous picture.
+        av_frame_make_writable(frame);
+
+        const int i = index;
+        int max_value = is_hdr ? 1023 : 255;
+        for (int y = 0; y < frame->height; y++) {
+            for (int x = 0; x < frame->width; x++) {
+                if (is_hdr) {
+                    ((uint16_t *)frame->data[0])[y * frame->linesize[0] / 2 + x] =
+                        ((x + y + i * 3) * 4) & max_value;
+                }
+                else {
+                    frame->data[0][y * frame->linesize[0] + x] = (x + y + i * 3) & max_value;
+                }
+            }
+        }
+        for (int y = 0; y < frame->height / 2; y++) {
+            for (int x = 0; x < frame->width / 2; x++) {
+                if (is_hdr) {
+                    ((uint16_t *)frame->data[1])[y * frame->linesize[1] / 2 + x] =
+                        ((512 + y + i * 2) * 4) & max_value;
+                    ((uint16_t *)frame->data[2])[y * frame->linesize[2] / 2 + x] =
+                        ((256 + x + i * 5) * 4) & max_value;
+                }
+                else {
+                    frame->data[1][y * frame->linesize[1] + x] = (128 + y + i * 2) & max_value;
+                    frame->data[2][y * frame->linesize[2] + x] = (64 + x + i * 5) & max_value;
+                }
+            }
+        }
+    }
+
+    double PacketPsnrY(const AVCodecContext *c, const AVPacket *pkt)
+    {
+        // AV_PKT_DATA_QUALITY_STATS: u32 quality, u8 pict_type, u8 error count, u16 reserved,
+        // then one u64 sum of squared errors per plane.
+        int size = 0;
+        const uint8_t *stats = av_packet_get_side_data(pkt, AV_PKT_DATA_QUALITY_STATS, &size);
+        if (!stats || size < 16 || stats[5] < 1)
+            return 0.0;
+
+        uint64_t sse = 0;
+        for (int i = 0; i < 8; i++)
+            sse |= static_cast<uint64_t>(stats[8 + i]) << (8 * i);
+        if (sse == 0)
+            return 100.0;
+
+        const double max_value = c->pix_fmt == AV_PIX_FMT_YUV420P10LE ? 1023.0 : 255.0;
+        return 10.0 * std::log10(max_value * max_value * c->width * c->height / sse);
+    }
+
+    EncoderTestResult RunEncoderTest(const std::string &name, const EncoderTestConfig &config)
+    {
+        EncoderTestResult result;
+        TRACE_SCOPE("RunEncoderTest", name.c_str());
+
+        // opened before the encoder so its worker threads inherit the counters
+        PerfCounterGroup counters;
+        if (config.perf_counters)
+            counters.Open();
+        // NOTE::threads that exist now aren't the encoder's, concurrent benchmarks (stream
+        // packing) still count each other's threads
+        const auto threads_before = GetThreadUsage();
+        const int64_t rss_before = GetResidentBytes();
+        ResetPeakResidentBytes();
+        EnergyMeter energy;
+        const bool measure_energy = energy.Open();
+
+        AVCodecContext *c = OpenTestEncoder(name, config);
+        if (!c)
+            return result;
+
+        result.opened = true;
+        result.thread_count = c->thread_count;
+        result.thread_type = c->active_thread_type;
+
+        AVFrame *frame = nullptr;
+        {
+            TRACE_SCOPE("alloc_frame");
+            frame = AllocTestFrame(c);
+        }
+        if (!frame) {
+            avcodec_free_context(&c);
+            return result;
+        }
+
+        AVPacket *pkt = av_packet_alloc();
+        if (!pkt) {
+            av_frame_free(&frame);
+            avcodec_free_context(&c);
+            return result;
+        }
+
+        if (config.before_timing)
+            config.before_timing();
+
+        const bool is_hdr = config.media_type == CODEC_INFO::MEDIA_TYPE::HDR;
+        result.frame_seconds.reserve(config.frames);
+        double psnr_sum = 0.0;
+        int psnr_packets = 0;
+        int sent = 0;
+        int packets = 0;
+        bool failed = false;
+        bool flushing = false;
+        std::vector<int64_t> packet_pts; // decode order
+        packet_pts.reserve(config.frames);
+        double delay_sum = 0.0;
+        int delay_packets = 0;
+        std::vector<double> send_seconds; // by pts, only for the frame trace
+        double last_receive = 0.0;
+        if (config.frame_trace) {
+            send_seconds.reserve(config.frames);
+            result.frame_trace.reserve(config.frames);
+        }
+
+        counters.Enable();
+        const auto energy_start = measure_energy ? energy.Sample() : std::vector<uint64_t>();
+        const auto threads_start = GetThreadUsage();
+        const auto self_start = GetCurrentThreadUsage();
+        const auto start = std::chrono::high_resolution_clock::now();
+        auto frame_start = start;
+        const bool paced = config.pace_fps > 0.0;
+        const auto pace_start = std::chrono::steady_clock::now();
+        std::vector<double> completed; // by pts, when its packet came out, -1 until then
+        if (paced)
+            completed.assign(config.frames, -1.0);
+
+        // true if a packet came out, EAGAIN and EOF just end the draining
+        const auto receive = [&]()
+        {
+            const int ret = avcodec_receive_packet(c, pkt);
+            USDT_PROBE4(receive_packet,
+                        name.c_str(),
+                        ret >= 0 ? pkt->pts : -1,
+                        ret >= 0 ? pkt->size : 0,
+                        ret);
+            if (ret < 0) {
+                failed = failed || (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF);
+                return false;
+            }
+            if (config.codec_flags & AV_CODEC_FLAG_PSNR) {
+                const double psnr = PacketPsnrY(c, pkt);
+                if (psnr > 0.0) {
+                    psnr_sum += psnr;
+                    psnr_packets++;
+                }
+            }
+            if (config.frame_trace) {
+                FrameTraceEntry entry;
+                entry.pts = pkt->pts;
+                entry.receive_seconds = std::chrono::duration<double>(
+                                            std::chrono::high_resolution_clock::now() - start)
+                                            .count();
+                if (pkt->pts >= 0 && pkt->pts < static_cast<int64_t>(send_seconds.size()))
+                    entry.send_seconds = send_seconds[pkt->pts];
+                entry.encode_seconds =
+                    entry.receive_seconds - std::max(entry.send_seconds, last_receive);
+                last_receive = entry.receive_seconds;
+                entry.size = pkt->size;
+                entry.key = pkt->flags & AV_PKT_FLAG_KEY;
+                int stats_size = 0;
+                const uint8_t *stats =
+                    av_packet_get_side_data(pkt, AV_PKT_DATA_QUALITY_STATS, &stats_size);
+                if (stats && stats_size >= 5)
+                    entry.pict_type = av_get_picture_type_char(static_cast<AVPictureType>(stats[4]));
+                result.frame_trace.push_back(entry);
+            }
+            if (paced && pkt->pts >= 0 && pkt->pts < static_cast<int64_t>(completed.size()))
+                completed[pkt->pts] =
+                    std::chrono::duration<double>(std::chrono::steady_clock::now() - pace_start)
+                        .count();
+            if (packets == 0)
+                result.first_packet_frames = sent;
+            if (pkt->pts != AV_NOPTS_VALUE) {
+                packet_pts.push_back(pkt->pts);
+                // at the flush nothing newer comes in, the distance would only shrink
+                if (!flushing) {
+                    delay_sum += static_cast<double>(sent - 1 - pkt->pts);
+                    delay_packets++;
+                }
+            }
+            av_packet_unref(pkt);
+            packets++;
+            return true;
+        };
+
+        for (int i = 0; i < config.frames; i++) {
+            {
+                TRACE_SCOPE("fill_frame");
+                FillTestFrame(frame, i, is_hdr);
+                frame->pts = i;
+            }
+            if (paced) {
+                {
+                    TRACE_SCOPE("pace");
+                    // behind schedule this returns at once, frames queue up like a live feed;
+                    // packets that come out meanwhile are stamped then, not at the next send
+                    const auto arrival =
+                        pace_start + std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                         std::chrono::duration<double>(i / config.pace_fps));
+                    for (auto now = std::chrono::steady_clock::now(); now < arrival && !failed;
+                         now = std::chrono::steady_clock::now()) {
+                        pace_until(std::min<std::chrono::steady_clock::time_point>(
+                            arrival, now + std::chrono::microseconds(PACE_POLL_MICROSECONDS)));
+                        while (receive()) {
+                        }
+                    }
+                }
+                frame_start = std::chrono::high_resolution_clock::now();
+            }
+
+            if (config.frame_trace)
+                send_seconds.push_back(std::chrono::duration<double>(
+                                           std::chrono::high_resolution_clock::now() - start)
+                                           .count());
+
+            int ret = 0;
+            {
+                TRACE_SCOPE("send_frame");
+                ret = avcodec_send_frame(c, frame);
+                USDT_PROBE3(send_frame, name.c_str(), i, ret);
+                // input queue full, an async encoder wants packets taken out first
+                while (ret == AVERROR(EAGAIN) && receive()) {
+                    ret = avcodec_send_frame(c, frame);
+                    USDT_PROBE3(send_frame, name.c_str(), i, ret);
+                }
+            }
+            if (ret < 0) {
+                failed = true;
+                break;
+            }
+            sent++;
+
+            {
+                TRACE_SCOPE("receive_packet");
+                // take every packet that is ready, receive doesn't block; holding packets back
+                // until some depth would count this loop's queue as the encoder's delay
+                while (receive()) {
+                }
+            }
+            if (failed)
+                break;
+
+            const auto frame_end = std::chrono::high_resolution_clock::now();
+            result.frame_seconds.push_back(
+                std::chrono::duration<double>(frame_end - frame_start).count());
+            frame_start = frame_end;
+            if (config.max_seconds > 0.0 &&
+                std::chrono::duration<double>(frame_end - start).count() > config.max_seconds)
+                break;
+        }
+
+        if (!failed) {
+            TRACE_SCOPE("flush");
+            flushing = true;
+            const int ret = avcodec_send_frame(c, nullptr);
+            USDT_PROBE3(send_frame, name.c_str(), -1, ret);
+            while (ret >= 0 && receive()) {
+            }
+        }
+
+        const auto end = std::chrono::high_resolution_clock::now();
+        counters.Disable();
+        // with lookahead or delay most of the work can come out here, it isn't any one frame's
+        if (!failed)
+            result.flush_seconds = std::chrono::duration<double>(end - frame_start).count();
+        if (measure_energy)
+            energy.Joules(energy_start, energy.Sample(), result.package_joules, result.dram_joules);
+        std::chrono::duration<double> diff = end - start;
+
+        ThreadUsage usage = GetCurrentThreadUsage() - self_start;
+        for (const auto &thread : GetThreadUsage()) {
+            if (threads_before.count(thread.first))
+                continue;
+            // started before the timed loop, only its share of the loop counts
+            const auto at_start = threads_start.find(thread.first);
+            usage += at_start == threads_start.end() ? thread.second
+                                                     : thread.second - at_start->second;
+            result.encoder_threads++;
+        }
+        result.user_seconds = usage.user_seconds;
+        result.system_seconds = usage.system_seconds;
+        result.cpu_seconds = usage.user_seconds + usage.system_seconds;
+        result.minor_faults = usage.minor_faults;
+        result.major_faults = usage.major_faults;
+        result.rss_bytes = GetResidentBytes();
+        result.rss_delta_bytes = result.rss_bytes - rss_before;
+        result.peak_rss_delta_bytes = std::max<int64_t>(0, GetPeakResidentBytes() - rss_before);
+        result.psnr_y = psnr_packets ? psnr_sum / psnr_packets : 0.0;
+        // everything held back until the flush: the delay is at least the whole input
+        result.delay_frames = delay_packets ? delay_sum / delay_packets
+                                            : std::max(0, result.first_packet_frames - 1);
+        result.reorder_depth = reorder_depth(packet_pts);
+        if (paced) {
+            // a live pipeline plans for the encoder's delay; one that holds everything until
+            // the flush gets no allowance for it
+            result.latency_budget_seconds =
+                config.latency_budget_seconds >= 0.0
+                    ? config.latency_budget_seconds
+                    : (1.0 + (delay_packets ? std::ceil(result.delay_frames) : 0.0)) /
+                          config.pace_fps;
+            double lateness_sum = 0.0, lateness_sq_sum = 0.0;
+            int delivered = 0;
+            for (size_t i = 0; i < result.frame_seconds.size(); i++) {
+                if (completed[i] < 0.0) {
+                    result.deadline_misses++;
+                    continue;
+                }
+                const double lateness =
+                    completed[i] - (i / config.pace_fps + result.latency_budget_seconds);
+                result.deadline_misses += lateness > 0.0;
+                result.max_lateness_seconds = std::max(result.max_lateness_seconds, lateness);
+                lateness_sum += lateness;
+                lateness_sq_sum += lateness * lateness;
+                delivered++;
+            }
+            if (delivered) {
+                const double mean = lateness_sum / delivered;
+                result.jitter_seconds =
+                    std::sqrt(std::max(0.0, lateness_sq_sum / delivered - mean * mean));
+            }
+        }
+        if (config.perf_counters)
+            counters.Read(result.counters);
+
+        TRACE_SCOPE("teardown", name.c_str());
+        av_frame_free(&frame);
+        av_packet_free(&pkt);
+        USDT_PROBE2(encoder_close, name.c_str(), static_cast<int>(result.frame_seconds.size()));
+        avcodec_free_context(&c);
+
+        result.frames = packets;
+        result.seconds = diff.count();
+        result.performance = result.frames / diff.count();
+        if (measure_energy && result.frames)
+            result.joules_per_frame = (result.package_joules + result.dram_joules) / result.frames;
+        return result;
+    }
+
+    std::vector<FrameTypeStats> SummarizeFrameTypes(const std::vector<FrameTraceEntry> &trace)
+    {
+        std::vector<FrameTypeStats> stats;
+        std::vector<std::vector<double>> times;
+        for (const auto &entry : trace) {
+            const std::string type = entry.key ? "IDR" : std::string(1, entry.pict_type);
+            size_t i = 0;
+            while (i < stats.size() && stats[i].type != type)
+                i++;
+            if (i == stats.size()) {
+                stats.emplace_back();
+                stats.back().type = type;
+                times.emplace_back();
+            }
+            stats[i].count++;
+            stats[i].mean_bytes += entry.size;
+            stats[i].max_bytes = std::max(stats[i].max_bytes, entry.size);
+            times[i].push_back(1000.0 * entry.encode_seconds);
+        }
+
+        for (size_t i = 0; i < stats.size(); i++) {
+            auto &ms = times[i];
+            std::sort(ms.begin(), ms.end());
+            double sum = 0.0;
+            for (const auto v : ms)
+                sum += v;
+            stats[i].mean_ms = sum / ms.size();
+            // nearest rank, with a few IDRs per run this is close to the max
+            stats[i].p99_ms = ms[std::min(ms.size() - 1, static_cast<size_t>(0.99 * ms.size()))];
+            stats[i].max_ms = ms.back();
+            stats[i].mean_bytes /= stats[i].count;
+        }
+        return stats;
+    }
+
+} // namespace CODEC_INFO
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "codec_info.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define TEST_FRAMES 30
+#define TEST_WIDTH 1920
+#define TEST_HEIGHT 1080
+
+namespace CODEC_INFO
+{
+    // One packet of a traced benchmark, times in seconds since the timed loop started.
+    struct FrameTraceEntry {
+        int64_t pts = 0;
+        double send_seconds = 0.0;    // avcodec_send_frame of the frame was called
+        double receive_seconds = 0.0; // its packet came out
+        // receive time less the later of the send and the previous packet, the encoder's own
+        // time for the frame even when several are in flight
+        double encode_seconds = 0.0;
+        int size = 0;
+        bool key = false;
+        char pict_type = '?'; // from the quality stats side data, '?' if the encoder has none
+    };
+
+    // encode time and size of one frame type over a traced benchmark
+    struct FrameTypeStats {
+        std::string type; // "IDR" for key packets, else "I", "P", "B" or "?"
+        int count = 0;
+        double mean_ms = 0.0;
+        double p99_ms = 0.0;
+        double max_ms = 0.0;
+        double mean_bytes = 0.0;
+        int max_bytes = 0;
+    };
+
+    // Settings shared by every encoder benchmark. Zero thread values keep the codec defaults.
+    struct EncoderTestConfig {
+        MEDIA_TYPE media_type = MEDIA_TYPE::NONE;
+        int width = TEST_WIDTH;
+        int height = TEST_HEIGHT;
+        int frames = TEST_FRAMES;
+        int gop_size = TEST_FRAMES;
+        int max_b_frames = 0;
+        int codec_flags = 0; // extra AV_CODEC_FLAG_* bits
+        int thread_count = 0;
+        int thread_type = 0;
+        // Stop the timed loop once it ran this long, 0 encodes every frame.
+        double max_seconds = 0.0;
+        // Frames an async encoder (QSV and friends) keeps in flight, set as its private
+        // async_depth option. Encoders without the option ignore it, see EncoderHasOption(); the
+        // loop itself never holds frames back, it takes every packet as soon as it is out.
+        int async_depth = 1;
+        // Submit frame i at i / pace_fps seconds like a live source would, 0 sends as fast as
+        // the encoder takes them. Frame i is due latency_budget_seconds after it arrived.
+        double pace_fps = 0.0;
+        // How long a paced frame may take from arrival to packet. Negative allows one frame
+        // interval plus the encoder's measured pipeline delay (delay_frames), so lookahead,
+        // B-frames and async output aren't missed deadlines by themselves.
+        double latency_budget_seconds = -1.0;
+        // Count cycles, instructions, cache and branch misses of the timed loop, see PerfCounters.
+        bool perf_counters = false;
+        // Record every packet in EncoderTestResult::frame_trace.
+        bool frame_trace = false;
+        // Private encoder options, silently skipped by encoders that don't have them.
+        std::vector<std::pair<std::string, std::string>> codec_options;
+        // Called once the encoder is open, right before the timed loop starts.
+        std::function<void()> before_timing;
+    };
+
+    struct EncoderTestResult {
+        bool opened = false;
+        int frames = 0; // packets delivered, the flush included
+        double seconds = 0.0;
+        double performance = 0.0;
+        int thread_count = 0;
+        int thread_type = 0;
+        // wall time of every frame sent, the flush that drains the frames still in flight is
+        // timed on its own
+        std::vector<double> frame_seconds;
+        double flush_seconds = 0.0;
+        double cpu_seconds = 0.0;          // user + system, see below
+        int64_t rss_bytes = 0;             // resident set size with the encoder still open
+        // CPU time and faults of the timed loop in the calling thread and every thread the
+        // encoder (or its driver) started, e.g. a hw encoder's submission thread
+        double user_seconds = 0.0;
+        double system_seconds = 0.0;
+        int64_t minor_faults = 0;
+        int64_t major_faults = 0;
+        int encoder_threads = 0;
+        // memory the encoder session holds once running, and at most while opening and running
+        int64_t rss_delta_bytes = 0;
+        int64_t peak_rss_delta_bytes = 0;
+        double psnr_y = 0.0;               // mean over packets, needs AV_CODEC_FLAG_PSNR
+        PerfCounters counters;             // needs EncoderTestConfig::perf_counters
+        // Pipeline delay: frames sent when the first packet came out (1 without delay), how many
+        // frames each packet trails the newest input until the flush, and how many packets at
+        // most come before one with a lower pts, the frames a decoder has to hold back.
+        int first_packet_frames = 0;
+        double delay_frames = 0.0;
+        int reorder_depth = 0;
+        std::vector<FrameTraceEntry> frame_trace; // needs EncoderTestConfig::frame_trace
+        // needs EncoderTestConfig::pace_fps; lateness is how long after its deadline a frame's
+        // packet came out, frames sent whose packet never came out count as misses
+        double latency_budget_seconds = 0.0; // the one applied, see EncoderTestConfig
+        int deadline_misses = 0;
+        double max_lateness_seconds = 0.0;
+        double jitter_seconds = 0.0; // standard deviation of the lateness
+        // RAPL energy of the timed loop, -1 where the counters can't be read
+        double package_joules = -1.0;
+        double dram_joules = -1.0;
+        double joules_per_frame = -1.0; // package + DRAM
+    };
+
+    // Allocate and open `name` with the benchmark settings, nullptr if it can't be opened.
+    AVCodecContext *OpenTestEncoder(const std::string &name, const EncoderTestConfig &config);
+
+    // true if `name` has the AVOption, generic or private, without opening it
+    bool EncoderHasOption(const std::string &name, const char *option);
+
+    AVFrame *AllocTestFrame(const AVCodecContext *c);
+
+    // Paint the synthetic test pattern for frame `index`.
+    void FillTestFrame(AVFrame *frame, int index, bool is_hdr);
+
+    // Luma PSNR from the packet's quality stats, 0 if the encoder didn't attach them.
+    double PacketPsnrY(const AVCodecContext *c, const AVPacket *pkt);
+
+    EncoderTestResult RunEncoderTest(const std::string &name, const EncoderTestConfig &config);
+
+    // per frame type, in the order the types first occur
+    std::vector<FrameTypeStats> SummarizeFrameTypes(const std::vector<FrameTraceEntry> &trace);
+
+} // namespace CODEC_INFO
@@ -0,0 +1,109 @@
+#include "encoder_telemetry.h"
+#include <algorithm>
+#include <cmath>
+
+namespace CODEC_INFO
+{
+    // The benchmark counts as this many seconds of observed encoding, so a few early session
+    // reports can't swing the ranking on their own.
+    static constexpr double PRIOR_SECONDS = 1.0;
+    // Tries for a fold to catch a slot between reports, a busier one waits for the next fold.
+    static constexpr int FOLD_ATTEMPTS = 16;
+
+    EncoderTelemetry::EncoderTelemetry(const std::vector<CodecPerformance> &benchmark,
+                                       double half_life_seconds)
+        : benchmark_(benchmark), slots_(new Slot[benchmark.size()]),
+          half_life_(std::max(half_life_seconds, 1e-3)), last_fold_(std::chrono::steady_clock::now())
+    {
+        for (const auto &codec : benchmark_)
+            estimates_.push_back({ codec.performance * PRIOR_SECONDS, PRIOR_SECONDS, 0.0, 0.0 });
+    }
+
+    EncoderTelemetry::~EncoderTelemetry() {}
+
+    int EncoderTelemetry::Find(const std::string &name) const
+    {
+        for (size_t i = 0; i < benchmark_.size(); i++) {
+            if (benchmark_[i].name == name)
+                return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    void EncoderTelemetry::fold()
+    {
+        const auto now = std::chrono::steady_clock::now();
+        const std::chrono::duration<double> elapsed = now - last_fold_;
+        last_fold_ = now;
+        const double decay = std::exp2(-elapsed.count() / half_life_);
+
+        for (size_t i = 0; i < estimates_.size(); i++) {
+            auto &slot = slots_[i];
+            auto &estimate = estimates_[i];
+            // a seqlock with many writers: nothing began after everything had finished
+            int64_t frames = 0, nanoseconds = 0, queue_depth = 0, reports = 0;
+            bool consistent = false;
+            for (int attempt = 0; attempt < FOLD_ATTEMPTS && !consistent; attempt++) {
+                const auto finished = slot.finished.load(std::memory_order_acquire);
+                frames = slot.frames.load(std::memory_order_relaxed);
+                nanoseconds = slot.nanoseconds.load(std::memory_order_relaxed);
+                queue_depth = slot.queue_depth.load(std::memory_order_relaxed);
+                reports = slot.reports.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                consistent = slot.begun.load(std::memory_order_relaxed) == finished;
+            }
+
+            // Idle encoders keep their estimate instead of decaying towards zero.
+            if (!consistent || reports == 0)
+                continue;
+            // reports since the snapshot stay for the next fold
+            slot.frames.fetch_sub(frames, std::memory_order_relaxed);
+            slot.nanoseconds.fetch_sub(nanoseconds, std::memory_order_relaxed);
+            slot.queue_depth.fetch_sub(queue_depth, std::memory_order_relaxed);
+            slot.reports.fetch_sub(reports, std::memory_order_relaxed);
+
+            estimate.frames = estimate.frames * decay + frames;
+            estimate.seconds = estimate.seconds * decay + nanoseconds * 1e-9;
+            estimate.queue_depth = estimate.queue_depth * decay + queue_depth;
+            estimate.reports = estimate.reports * decay + reports;
+        }
+    }
+
+    std::vector<LiveCodecPerformance> EncoderTelemetry::Ranking()
+    {
+        std::vector<LiveCodecPerformance> ranking;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            fold();
+            for (size_t i = 0; i < benchmark_.size(); i++) {
+                const auto &estimate = estimates_[i];
+                LiveCodecPerformance live;
+                live.codec = benchmark_[i];
+                live.benchmark = benchmark_[i].performance;
+                live.codec.performance =
+                    estimate.seconds > 0.0 ? estimate.frames / estimate.seconds : 0.0;
+                live.queue_depth =
+                    estimate.reports > 0.0 ? estimate.queue_depth / estimate.reports : 0.0;
+                live.score = live.codec.performance / (1.0 + live.queue_depth);
+                ranking.emplace_back(live);
+            }
+        }
+
+        std::stable_sort(ranking.begin(),
+                         ranking.end(),
+                         [](const LiveCodecPerformance &a, const LiveCodecPerformance &b)
+                         { return a.score > b.score; });
+        return ranking;
+    }
+
+    bool EncoderTelemetry::FindBestHwVideoEncoder(CODEC_INFO::CodecPerformance &find_codec_info)
+    {
+        const auto ranking = Ranking();
+        if (ranking.empty() || ranking.front().codec.codec_id == AV_CODEC_ID_NONE)
+            return false;
+
+        find_codec_info = ranking.front().codec;
+        return true;
+    }
+
+} // namespace CODEC_INFO
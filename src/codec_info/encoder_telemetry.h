@@ -0,0 +1,83 @@
+#pragma once
+
+#include "codec_info.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace CODEC_INFO
+{
+    struct LiveCodecPerformance {
+        CodecPerformance codec; // performance holds the live throughput estimate in fps
+        double benchmark;       // static benchmark fps the estimate started from
+        double queue_depth;     // decayed mean queue depth reported by sessions
+        double score;           // performance / (1 + queue_depth), the ranking key
+    };
+
+    // Re-ranks benchmarked encoders from in-flight session feedback. Report() is wait-free so it
+    // can be called from encode threads; readers fold pending reports into exponentially decayed
+    // estimates on demand.
+    class EncoderTelemetry
+    {
+    public:
+        EncoderTelemetry(const std::vector<CodecPerformance> &benchmark,
+                         double half_life_seconds = 10.0);
+        ~EncoderTelemetry();
+
+        // index of `name` for Report(), -1 if it wasn't benchmarked
+        int Find(const std::string &name) const;
+
+        // `frames` encoded in `nanoseconds` of encoder time with `queue_depth` frames waiting
+        void Report(int encoder, int64_t frames, int64_t nanoseconds, int queue_depth)
+        {
+            if (encoder < 0 || encoder >= static_cast<int>(benchmark_.size()))
+                return;
+            auto &slot = slots_[encoder];
+            slot.begun.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.frames.fetch_add(frames, std::memory_order_relaxed);
+            slot.nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+            slot.queue_depth.fetch_add(queue_depth, std::memory_order_relaxed);
+            slot.reports.fetch_add(1, std::memory_order_relaxed);
+            slot.finished.fetch_add(1, std::memory_order_release);
+        }
+
+        // best first
+        std::vector<LiveCodecPerformance> Ranking();
+
+        bool FindBestHwVideoEncoder(CODEC_INFO::CodecPerformance &find_codec_info);
+
+    private:
+        // Reports that begun and finished bracket, a fold only takes the counters while no
+        // report is halfway through them.
+        struct alignas(64) Slot {
+            std::atomic<uint64_t> begun { 0 };
+            std::atomic<uint64_t> finished { 0 };
+            std::atomic<int64_t> frames { 0 };
+            std::atomic<int64_t> nanoseconds { 0 };
+            std::atomic<int64_t> queue_depth { 0 };
+            std::atomic<int64_t> reports { 0 };
+        };
+        struct Estimate {
+            double frames;
+            double seconds;
+            double queue_depth;
+            double reports;
+        };
+
+        void fold();
+
+        std::vector<CodecPerformance> benchmark_;
+        std::unique_ptr<Slot[]> slots_;
+        double half_life_;
+
+        std::mutex mutex_;
+        std::vector<Estimate> estimates_;
+        std::chrono::steady_clock::time_point last_fold_;
+    };
+
+} // namespace CODEC_INFO
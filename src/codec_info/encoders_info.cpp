@@ -1,18 +1,68 @@
 #include "encoders_info.h"
+#include "encoder_bench.h"
+#include "process_stats.h"
+#include "trace.h"
+#include "usdt.h"
 #include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
+#include <thread>
 
-#define TEST_FRAMES 30
-#define TEST_WIDTH 1920
-#define TEST_HEIGHT 1080
+// Racing: frames of the first trial, doubled every round up to TEST_FRAMES.
+#define RACE_START_FRAMES 4
+// A trial that runs this many times longer than the round's fastest one is cut short.
+#define RACE_ABORT_RATIO 4.0
+// Normal quantiles of the per-frame time confidence intervals: any encoder clearly behind the
+// leader (99%) drops out, the slower half already when it is behind at about 68%.
+#define RACE_CONFIDENCE_Z 2.576
+#define RACE_HALVING_Z 1.0
+// Frames every session encodes before it is measured, enough for lookahead and reference
+// buffers to be allocated.
+#define SESSION_WARM_FRAMES 4
+// A deeper async queue has to beat a shallower one by this factor to be picked.
+#define ASYNC_DEPTH_GAIN 1.05
+// Bisection of the real-time fps stops once the bracket is this tight, relative to its top.
+#define REALTIME_PRECISION 0.02
+#define REALTIME_MAX_STEPS 8
 
 namespace CODEC_INFO
 {
+    // device type the encoder takes a hw_device_ctx / hw_frames_ctx for, NONE if it declares none
+    static AVHWDeviceType encoder_device_type(const std::string &name)
+    {
+        const AVCodec *codec = avcodec_find_encoder_by_name(name.c_str());
+        if (!codec)
+            return AV_HWDEVICE_TYPE_NONE;
+
+        const AVCodecHWConfig *config = nullptr;
+        for (int i = 0; (config = avcodec_get_hw_config(codec, i)); i++) {
+            if (config->device_type != AV_HWDEVICE_TYPE_NONE)
+                return config->device_type;
+        }
+        return AV_HWDEVICE_TYPE_NONE;
+    }
+
     EncodersInfo::EncodersInfo() {}
 
+    AVHWDeviceType EncodersInfo::GetEncoderDeviceType(const std::string &name)
+    {
+        return encoder_device_type(name);
+    }
+
     EncodersInfo::~EncodersInfo() {}
 
+    CODEC_INFO::EncoderTestResult EncodersInfo::RunTest(const std::string &name,
+                                                        const CODEC_INFO::EncoderTestConfig &config)
+    {
+        auto result = RunEncoderTest(name, config);
+        if (result_listener_)
+            result_listener_(name, config, result);
+        return result;
+    }
+
     std::vector<std::tuple<std::string, AVCodecID>>
     EncodersInfo::GetAllEncoders(AVMediaType media_type)
     {
@@ -51,7 +101,12 @@ namespace CODEC_INFO
                 if (!av_codec_is_encoder(codec) || codec->type != media_type)
                     continue;
 
-                if (codec->capabilities & AV_CODEC_CAP_HARDWARE)
+                // NOTE::the codec list is walked once per device type, keep every encoder once.
+                if ((codec->capabilities & AV_CODEC_CAP_HARDWARE) &&
+                    std::find_if(encoders.begin(),
+                                 encoders.end(),
+                                 [codec](const std::tuple<std::string, AVCodecID> &item)
+                                 { return std::get<0>(item) == codec->name; }) == encoders.end())
                     encoders.emplace_back(std::pair { codec->name, codec->id });
             }
         }
@@ -65,33 +120,77 @@ namespace CODEC_INFO
         AVHWDeviceType hw_type = AV_HWDEVICE_TYPE_NONE;
 
         while ((hw_type = av_hwdevice_iterate_types(hw_type)) != AV_HWDEVICE_TYPE_NONE) {
+            const auto device_encoders = GetDeviceHwEncoders(media_type, hw_type);
+            encoders.insert(encoders.end(), device_encoders.begin(), device_encoders.end());
+        }
+        return encoders;
+    }
 
-            AVBufferRef *hw_device_ctx = nullptr;
-            if (av_hwdevice_ctx_create(&hw_device_ctx, hw_type, nullptr, nullptr, 0) != 0)
-                continue;
+    std::vector<std::tuple<std::string, AVCodecID, AVHWDeviceType>>
+    EncodersInfo::GetDeviceHwEncoders(AVMediaType media_type, AVHWDeviceType hw_type)
+    {
+        std::vector<std::tuple<std::string, AVCodecID, AVHWDeviceType>> encoders;
+        const char *hw_name = av_hwdevice_get_type_name(hw_type);
+        TRACE_SCOPE("GetDeviceHwEncoders", hw_name);
+        USDT_PROBE2(phase_begin, "GetDeviceHwEncoders", hw_name);
 
-            const AVCodec *codec = nullptr;
-            void *opaque = nullptr;
+        AVBufferRef *hw_device_ctx = nullptr;
+        int ret = 0;
+        {
+            TRACE_SCOPE("av_hwdevice_ctx_create", hw_name);
+            ret = av_hwdevice_ctx_create(&hw_device_ctx, hw_type, nullptr, nullptr, 0);
+        }
+        USDT_PROBE2(device_init, hw_name, ret);
+        if (ret != 0) {
+            USDT_PROBE2(phase_end, "GetDeviceHwEncoders", 0);
+            return encoders;
+        }
 
-            while ((codec = av_codec_iterate(&opaque))) {
-                if (!av_codec_is_encoder(codec) || codec->type != media_type)
-                    continue;
+        const AVCodec *codec = nullptr;
+        void *opaque = nullptr;
 
-                AVCodecContext *ctx = avcodec_alloc_context3(codec);
-                if (!ctx)
-                    continue;
+        while ((codec = av_codec_iterate(&opaque))) {
+            if (!av_codec_is_encoder(codec) || codec->type != media_type)
+                continue;
 
-                ctx->bit_rate = 400000;
-                ctx->width = 1920;
-                ctx->height = 1080;
-                ctx->time_base = { 1, 25 };
-                ctx->framerate = { 25, 1 };
-                ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+            // only the encoders that can run on this device type
+            const AVCodecHWConfig *config = nullptr;
+            for (int i = 0; (config = avcodec_get_hw_config(codec, i)); i++) {
+                if (config->device_type == hw_type)
+                    break;
+            }
+            if (!config)
+                continue;
 
-                if (avcodec_open2(ctx, codec, nullptr) == 0)
-                    encoders.emplace_back(codec->name, codec->id, hw_type);
+            AVCodecContext *ctx = avcodec_alloc_context3(codec);
+            if (!ctx)
+                continue;
+
+            ctx->hw_device_ctx = av_buffer_ref(hw_device_ctx);
+            ctx->bit_rate = 400000;
+            ctx->width = 1920;
+            ctx->height = 1080;
+            ctx->time_base = { 1, 25 };
+            ctx->framerate = { 25, 1 };
+            ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+
+            bool opened = false;
+            {
+                TRACE_SCOPE("avcodec_open2", codec->name);
+                ret = avcodec_open2(ctx, codec, nullptr);
+                opened = ret == 0;
             }
+            USDT_PROBE4(encoder_open, codec->name, ctx->width, ctx->height, ret);
+            if (opened)
+                encoders.emplace_back(codec->name, codec->id, hw_type);
+            TRACE_SCOPE("avcodec_free_context", codec->name);
+            if (opened)
+                USDT_PROBE2(encoder_close, codec->name, 0);
+            avcodec_free_context(&ctx);
         }
+        TRACE_SCOPE("av_hwdevice_ctx_free", hw_name);
+        av_buffer_unref(&hw_device_ctx);
+        USDT_PROBE2(phase_end, "GetDeviceHwEncoders", static_cast<int>(encoders.size()));
         return encoders;
     }
 
@@ -143,18 +242,101 @@ namespace CODEC_INFO
     std::vector<CODEC_INFO::CodecPerformance>
     EncodersInfo::DetectHwVideoEncoders(CODEC_INFO::MEDIA_TYPE media_type)
     {
+        return DetectHwVideoEncoders(media_type, AV_HWDEVICE_TYPE_NONE);
+    }
+
+    std::vector<CODEC_INFO::CodecPerformance> EncodersInfo::DetectHwVideoEncoders(
+        CODEC_INFO::MEDIA_TYPE media_type,
+        AVHWDeviceType hw_type,
+        std::vector<std::pair<std::string, CODEC_INFO::EncoderTestResult>> *results)
+    {
+        USDT_PROBE2(phase_begin,
+                    "DetectHwVideoEncoders",
+                    hw_type == AV_HWDEVICE_TYPE_NONE ? "" : av_hwdevice_get_type_name(hw_type));
         std::vector<CODEC_INFO::CodecPerformance> encoders;
         const auto hw_device = GetHwEncoders(AVMediaType::AVMEDIA_TYPE_VIDEO);
         for (const auto &item : hw_device) {
             const auto name = std::get<0>(item);
             const auto codec_id = std::get<1>(item);
+            if (hw_type != AV_HWDEVICE_TYPE_NONE && encoder_device_type(name) != hw_type)
+                continue;
 
-            std::cout << "Testing encoder:" << name << std::endl;
+            if (log_)
+                *log_ << "Testing encoder:" << name << std::endl;
             CODEC_INFO::CodecPerformance encoder;
             encoder.codec_id = codec_id;
             encoder.name = name;
-            encoder.performance = test_encoder_performance(name, media_type);
-            std::cout << "Performance: " << encoder.performance << " fps" << std::endl;
+            encoder.hw_type = encoder_device_type(name);
+            const auto result = test_encoder_performance(name, media_type);
+            encoder.performance = result.performance;
+            encoder.counters = result.counters;
+            encoder.cpu_per_frame = result.frames ? result.cpu_seconds / result.frames : 0.0;
+            encoder.joules_per_frame = result.joules_per_frame;
+            encoder.delay_frames = result.delay_frames;
+            encoder.reorder_depth = result.reorder_depth;
+            if (results)
+                results->emplace_back(name, result);
+            if (log_) {
+                *log_ << "Performance: " << encoder.performance << " fps, "
+                      << 1000.0 * encoder.cpu_per_frame << " ms CPU per frame" << std::endl;
+                *log_ << "Latency: first packet after " << result.first_packet_frames
+                      << " frames, " << encoder.delay_frames << " frames delay, reorder depth "
+                      << encoder.reorder_depth << std::endl;
+                if (encoder.joules_per_frame >= 0.0)
+                    *log_ << "Energy: " << encoder.joules_per_frame << " J per frame, "
+                          << encoder.joules_per_frame * encoder.performance << " W" << std::endl;
+                if (encoder.counters.collected)
+                    *log_ << "Counters: " << encoder.counters.cycles << " cycles, IPC "
+                          << encoder.counters.ipc << ", " << encoder.counters.llc_misses
+                          << " LLC misses, " << encoder.counters.context_switches
+                          << " context switches" << std::endl;
+                if (collect_counters_ && !encoder.counters.error.empty())
+                    *log_ << "Counters: " << encoder.counters.error << std::endl;
+            }
+            encoders.emplace_back(encoder);
+        }
+        USDT_PROBE2(phase_end, "DetectHwVideoEncoders", static_cast<int>(encoders.size()));
+        return encoders;
+    }
+
+    std::vector<CODEC_INFO::CodecPerformance>
+    EncodersInfo::DetectSwVideoEncoders(CODEC_INFO::MEDIA_TYPE media_type,
+                                        const std::vector<AVCodecID> &codec_ids)
+    {
+        std::vector<CODEC_INFO::CodecPerformance> encoders;
+        for (const auto codec_id : codec_ids) {
+            const bool seen = std::any_of(encoders.begin(),
+                                          encoders.end(),
+                                          [&](const CODEC_INFO::CodecPerformance &encoder)
+                                          { return encoder.codec_id == codec_id; });
+            if (seen)
+                continue;
+
+            const AVCodec *codec = nullptr;
+            void *opaque = nullptr;
+            while ((codec = av_codec_iterate(&opaque))) {
+                if (av_codec_is_encoder(codec) && codec->id == codec_id &&
+                    !(codec->capabilities & AV_CODEC_CAP_HARDWARE) &&
+                    !(codec->capabilities & AV_CODEC_CAP_EXPERIMENTAL))
+                    break;
+            }
+            if (!codec)
+                continue;
+
+            if (log_)
+                *log_ << "Testing encoder:" << codec->name << std::endl;
+            CODEC_INFO::CodecPerformance encoder;
+            encoder.codec_id = codec_id;
+            encoder.name = codec->name;
+            const auto result = test_encoder_performance(encoder.name, media_type);
+            encoder.performance = result.performance;
+            encoder.counters = result.counters;
+            encoder.cpu_per_frame = result.frames ? result.cpu_seconds / result.frames : 0.0;
+            encoder.joules_per_frame = result.joules_per_frame;
+            encoder.delay_frames = result.delay_frames;
+            encoder.reorder_depth = result.reorder_depth;
+            if (log_)
+                *log_ << "Performance: " << encoder.performance << " fps" << std::endl;
             encoders.emplace_back(encoder);
         }
         return encoders;
@@ -163,140 +345,689 @@ namespace CODEC_INFO
     bool EncodersInfo::FindBestHwVideoEncoder(CODEC_INFO::MEDIA_TYPE media_type,
                                               CODEC_INFO::CodecPerformance &find_codec_info)
     {
-        std::vector<CODEC_INFO::CodecPerformance> list = DetectHwVideoEncoders(media_type);
+        // Only the winner matters here, no need to benchmark the rest to the end.
+        return FindBestHwVideoEncoder(media_type, {}, find_codec_info);
+    }
+
+    bool EncodersInfo::FindBestHwVideoEncoder(
+        CODEC_INFO::MEDIA_TYPE media_type,
+        const std::vector<CODEC_INFO::CodecPerformance> &priors,
+        CODEC_INFO::CodecPerformance &find_codec_info)
+    {
+        // a race only ranks by fps
+        if (objective_ != CODEC_INFO::SELECTION_OBJECTIVE::THROUGHPUT)
+            return PickBestEncoder(DetectHwVideoEncoders(media_type),
+                                   objective_,
+                                   required_fps_,
+                                   find_codec_info,
+                                   max_delay_frames_);
 
-        const auto best_encoder = std::max_element(
-            list.begin(),
-            list.end(),
-            [](const CODEC_INFO::CodecPerformance &a, const CODEC_INFO::CodecPerformance &b)
-            { return a.performance < b.performance; });
+        CODEC_INFO::RaceStats stats;
+        const auto list = RaceHwVideoEncoders(media_type, priors, stats);
+        if (list.empty() || list.front().performance <= 0.0)
+            return false;
+        find_codec_info = list.front();
+        return true;
+    }
 
-        bool find = false;
-        if (best_encoder == list.end() || best_encoder->codec_id == AV_CODEC_ID_NONE) {
-            find = false;
+    // frames between a frame going in and the decoder showing it, -1 until measured
+    static double latency_frames(const CODEC_INFO::CodecPerformance &encoder)
+    {
+        if (encoder.delay_frames < 0.0 || encoder.reorder_depth < 0)
+            return -1.0;
+        return encoder.delay_frames + encoder.reorder_depth;
+    }
+
+    bool EncodersInfo::PickBestEncoder(const std::vector<CODEC_INFO::CodecPerformance> &encoders,
+                                       CODEC_INFO::SELECTION_OBJECTIVE objective,
+                                       double required_fps,
+                                       CODEC_INFO::CodecPerformance &best,
+                                       double max_delay_frames)
+    {
+        const bool delay_cap =
+            objective == CODEC_INFO::SELECTION_OBJECTIVE::LOW_LATENCY && max_delay_frames >= 0.0;
+        const auto within_cap = [&](const CODEC_INFO::CodecPerformance &encoder)
+        {
+            const double latency = latency_frames(encoder);
+            return !delay_cap || (latency >= 0.0 && latency <= max_delay_frames);
+        };
+
+        // like the fps requirement the cap only narrows the choice when someone meets it
+        bool realtime = false, capped = false;
+        for (const auto &encoder : encoders) {
+            realtime = realtime || encoder.performance >= required_fps;
+            capped = capped || (encoder.performance > 0.0 && within_cap(encoder));
         }
-        else {
-            find = true;
-            find_codec_info = *best_encoder;
+
+        const CODEC_INFO::CodecPerformance *pick = nullptr;
+        for (const auto &encoder : encoders) {
+            if (encoder.performance <= 0.0 || (realtime && encoder.performance < required_fps))
+                continue;
+            if (capped && !within_cap(encoder))
+                continue;
+            if (!pick) {
+                pick = &encoder;
+                continue;
+            }
+            switch (objective) {
+            case CODEC_INFO::SELECTION_OBJECTIVE::HOST_CPU:
+                if (encoder.cpu_per_frame < pick->cpu_per_frame)
+                    pick = &encoder;
+                break;
+            case CODEC_INFO::SELECTION_OBJECTIVE::ENERGY:
+                // measured beats unmeasured, without RAPL at all it comes down to fps
+                if (encoder.joules_per_frame >= 0.0 && pick->joules_per_frame >= 0.0) {
+                    if (encoder.joules_per_frame < pick->joules_per_frame)
+                        pick = &encoder;
+                }
+                else if (encoder.joules_per_frame >= 0.0) {
+                    pick = &encoder;
+                }
+                else if (pick->joules_per_frame < 0.0 &&
+                         encoder.performance > pick->performance) {
+                    pick = &encoder;
+                }
+                break;
+            case CODEC_INFO::SELECTION_OBJECTIVE::LOW_LATENCY: {
+                const double latency = latency_frames(encoder);
+                const double pick_latency = latency_frames(*pick);
+                // within a cap any delay is fine, the fastest wins; measured beats unmeasured
+                if (capped || latency == pick_latency) {
+                    if (encoder.performance > pick->performance)
+                        pick = &encoder;
+                }
+                else if (latency >= 0.0 && (pick_latency < 0.0 || latency < pick_latency)) {
+                    pick = &encoder;
+                }
+                break;
+            }
+            default:
+                if (encoder.performance > pick->performance)
+                    pick = &encoder;
+                break;
+            }
         }
-        return find;
+        if (!pick)
+            return false;
+        best = *pick;
+        return true;
     }
 
-    double EncodersInfo::test_encoder_performance(std::string name,
-                                                  CODEC_INFO::MEDIA_TYPE media_type)
+    std::vector<CODEC_INFO::CodecPerformance>
+    EncodersInfo::RaceHwVideoEncoders(CODEC_INFO::MEDIA_TYPE media_type,
+                                      const std::vector<CODEC_INFO::CodecPerformance> &priors,
+                                      CODEC_INFO::RaceStats &stats)
     {
-        AVCodec *codec = avcodec_find_encoder_by_name(name.c_str());
-        if (!codec)
-            return 0.0;
+        struct Runner {
+            CODEC_INFO::CodecPerformance encoder;
+            double prior = -1.0;
+            double open_seconds = 0.0;
+            // per-frame times of every trial, first frame of each trial left out as warm-up
+            std::vector<double> samples;
+            bool alive = true;
+        };
 
-        AVCodecContext *c = avcodec_alloc_context3(codec);
-        if (!c)
-            return 0.0;
+        // mean per-frame time and the half width of its confidence interval
+        const auto interval = [](const Runner &runner, double z)
+        {
+            const auto &x = runner.samples;
+            if (x.size() < 2)
+                return std::pair<double, double> { x.empty() ? 0.0 : x[0], HUGE_VAL };
+            double mean = 0.0, var = 0.0;
+            for (const auto v : x)
+                mean += v;
+            mean /= x.size();
+            for (const auto v : x)
+                var += (v - mean) * (v - mean);
+            var /= x.size() - 1;
+            return std::pair<double, double> { mean, z * std::sqrt(var / x.size()) };
+        };
 
-        c->bit_rate = 5000000;
-        c->width = TEST_WIDTH;
-        c->height = TEST_HEIGHT;
-        c->time_base = { 1, TEST_FRAMES };
-        c->framerate = { TEST_FRAMES, 1 };
-        c->gop_size = TEST_FRAMES;
-        c->max_b_frames = 0;
-        c->pix_fmt = media_type == CODEC_INFO::MEDIA_TYPE::HDR ? AV_PIX_FMT_YUV420P10LE
-                                                               : AV_PIX_FMT_YUV420P;
-
-        const bool is_hdr = media_type == CODEC_INFO::MEDIA_TYPE::HDR;
-        if (media_type != CODEC_INFO::MEDIA_TYPE::NONE) {
-            if (is_hdr) {
-                c->color_primaries = AVCOL_PRI_BT2020;
-                c->color_trc = AVCOL_TRC_SMPTE2084;
-                c->colorspace = AVCOL_SPC_BT2020_NCL;
+        stats = CODEC_INFO::RaceStats();
+        const auto race_start = std::chrono::steady_clock::now();
+        USDT_PROBE2(phase_begin, "RaceHwVideoEncoders", "");
+
+        std::vector<Runner> runners;
+        for (const auto &item : GetHwEncoders(AVMediaType::AVMEDIA_TYPE_VIDEO)) {
+            Runner runner;
+            runner.encoder.name = std::get<0>(item);
+            runner.encoder.codec_id = std::get<1>(item);
+            runner.encoder.hw_type = encoder_device_type(runner.encoder.name);
+            for (const auto &prior : priors) {
+                if (prior.name == runner.encoder.name)
+                    runner.prior = prior.performance;
             }
-            else {
-                c->color_primaries = AVCOL_PRI_BT709;
-                c->color_trc = AVCOL_TRC_BT709;
-                c->colorspace = AVCOL_SPC_BT709;
+            runners.push_back(runner);
+        }
+        // Likely winners first, so the abort limit tightens early in every round.
+        std::stable_sort(runners.begin(),
+                         runners.end(),
+                         [](const Runner &a, const Runner &b) { return a.prior > b.prior; });
+        stats.candidates = static_cast<int>(runners.size());
+
+        CODEC_INFO::EncoderTestConfig config;
+        config.media_type = media_type;
+        config.perf_counters = collect_counters_;
+        config.async_depth = async_depth_;
+        config.max_b_frames = max_b_frames_;
+        // nothing to race with a single candidate
+        const int start_frames = runners.size() > 1 ? RACE_START_FRAMES : TEST_FRAMES;
+        for (int frames = start_frames;; frames = std::min(frames * 2, TEST_FRAMES)) {
+            stats.rounds++;
+            config.frames = frames;
+
+            double fastest = 0.0;
+            for (auto &runner : runners) {
+                if (!runner.alive)
+                    continue;
+
+                config.max_seconds = fastest > 0.0 ? fastest * RACE_ABORT_RATIO : 0.0;
+                const auto trial_start = std::chrono::steady_clock::now();
+                const auto result = RunTest(runner.encoder.name, config);
+                const double wall = std::chrono::duration<double>(
+                                        std::chrono::steady_clock::now() - trial_start)
+                                        .count();
+                stats.frames += result.frames;
+                if (!result.opened || result.frames == 0) {
+                    runner.alive = false;
+                    runner.encoder.performance = 0.0;
+                    stats.eliminated++;
+                    continue;
+                }
+
+                runner.open_seconds = wall - result.seconds;
+                runner.encoder.performance = result.performance;
+                runner.encoder.counters = result.counters;
+                runner.encoder.cpu_per_frame = result.cpu_seconds / result.frames;
+                runner.encoder.joules_per_frame = result.joules_per_frame;
+                runner.encoder.delay_frames = result.delay_frames;
+                runner.encoder.reorder_depth = result.reorder_depth;
+                // the first frame is warm-up, a run that failed after a packet may have none
+                if (result.frame_seconds.size() > 1)
+                    runner.samples.insert(runner.samples.end(),
+                                          result.frame_seconds.begin() + 1,
+                                          result.frame_seconds.end());
+                // an encoder may drop frames, whether the trial was cut short goes by frames sent
+                const bool aborted = static_cast<int>(result.frame_seconds.size()) < frames;
+                if (log_)
+                    *log_ << "Race round " << stats.rounds << ": " << runner.encoder.name << " "
+                          << result.frames << " frames, " << result.performance << " fps"
+                          << (aborted ? " (aborted)" : "") << std::endl;
+
+                if (aborted) {
+                    runner.alive = false;
+                    stats.aborted++;
+                    stats.eliminated++;
+                }
+                else if (fastest == 0.0 || result.seconds < fastest) {
+                    fastest = result.seconds;
+                }
+            }
+
+            std::vector<Runner *> alive;
+            for (auto &runner : runners) {
+                if (runner.alive)
+                    alive.push_back(&runner);
+            }
+            if (alive.empty() || frames >= TEST_FRAMES)
+                break;
+            // A lone survivor's fps would come from a trial dominated by warm-up, give it the
+            // full benchmark next round.
+            if (alive.size() == 1) {
+                frames = TEST_FRAMES;
+                continue;
+            }
+
+            std::sort(alive.begin(),
+                      alive.end(),
+                      [](const Runner *a, const Runner *b)
+                      { return a->encoder.performance > b->encoder.performance; });
+            const size_t keep = (alive.size() + 1) / 2;
+            for (size_t i = 1; i < alive.size(); i++) {
+                // fastest plausible frame time of the candidate is still slower than the
+                // slowest plausible one of the leader
+                const double z = i < keep ? RACE_CONFIDENCE_Z : RACE_HALVING_Z;
+                const auto leader = interval(*alive.front(), z);
+                const auto candidate = interval(*alive[i], z);
+                if (candidate.first - candidate.second > leader.first + leader.second) {
+                    alive[i]->alive = false;
+                    stats.eliminated++;
+                }
             }
         }
 
-        if (avcodec_open2(c, codec, NULL) < 0) {
-            avcodec_free_context(&c);
-            return 0.0;
+        // steady-state frame time, short trials are dominated by warm-up
+        for (const auto &runner : runners) {
+            if (runner.encoder.performance > 0.0)
+                stats.exhaustive_seconds +=
+                    runner.open_seconds + TEST_FRAMES * (runner.samples.empty()
+                                                             ? 1.0 / runner.encoder.performance
+                                                             : interval(runner, 0.0).first);
         }
+        stats.seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - race_start).count();
 
-        AVFrame *frame = av_frame_alloc();
-        if (!frame) {
-            avcodec_free_context(&c);
-            return 0.0;
+        std::stable_sort(runners.begin(),
+                         runners.end(),
+                         [](const Runner &a, const Runner &b)
+                         {
+                             if (a.alive != b.alive)
+                                 return a.alive;
+                             return a.encoder.performance > b.encoder.performance;
+                         });
+        std::vector<CODEC_INFO::CodecPerformance> encoders;
+        for (const auto &runner : runners)
+            encoders.push_back(runner.encoder);
+        USDT_PROBE2(phase_end, "RaceHwVideoEncoders", stats.candidates - stats.eliminated);
+        return encoders;
+    }
+
+    std::vector<CODEC_INFO::ThreadScalingPoint>
+    EncodersInfo::TestThreadScaling(const std::string &name,
+                                    CODEC_INFO::MEDIA_TYPE media_type,
+                                    int max_threads)
+    {
+        std::vector<CODEC_INFO::ThreadScalingPoint> points;
+
+        const AVCodec *codec = avcodec_find_encoder_by_name(name.c_str());
+        if (!codec || max_threads < 1)
+            return points;
+
+        // Encoders with their own thread pool (x264, x265, ...) ignore thread_type.
+        std::vector<int> thread_types;
+        if (codec->capabilities & AV_CODEC_CAP_FRAME_THREADS)
+            thread_types.push_back(FF_THREAD_FRAME);
+        if (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS)
+            thread_types.push_back(FF_THREAD_SLICE);
+        if (thread_types.empty())
+            thread_types.push_back(0);
+
+        std::vector<int> thread_counts;
+        for (int n = 1; n < max_threads; n *= 2)
+            thread_counts.push_back(n);
+        thread_counts.push_back(max_threads);
+
+        for (const auto thread_type : thread_types) {
+            double single_thread = 0.0;
+            for (const auto thread_count : thread_counts) {
+                CODEC_INFO::EncoderTestConfig config;
+                config.media_type = media_type;
+                config.thread_count = thread_count;
+                config.thread_type = thread_type;
+
+                const auto result = RunTest(name, config);
+                if (!result.opened)
+                    continue;
+
+                CODEC_INFO::ThreadScalingPoint point;
+                point.thread_count = thread_count;
+                point.thread_type = thread_type;
+                point.active_thread_type = result.thread_type;
+                point.performance = result.performance;
+                if (thread_count == 1)
+                    single_thread = result.performance;
+                point.speedup = single_thread > 0.0 ? result.performance / single_thread : 0.0;
+                point.efficiency = point.speedup / thread_count;
+                point.per_thread = result.performance / thread_count;
+                points.emplace_back(point);
+            }
+        }
+        return points;
+    }
+
+    std::vector<CODEC_INFO::AsyncDepthPoint>
+    EncodersInfo::TestAsyncDepth(const std::string &name,
+                                 CODEC_INFO::MEDIA_TYPE media_type,
+                                 int max_depth)
+    {
+        std::vector<CODEC_INFO::AsyncDepthPoint> points;
+        // without the option every depth would be the same run
+        if (max_depth < 1 || !CODEC_INFO::EncoderHasOption(name, "async_depth"))
+            return points;
+
+        std::vector<int> depths;
+        for (int n = 1; n < max_depth; n *= 2)
+            depths.push_back(n);
+        depths.push_back(max_depth);
+
+        double single = 0.0;
+        for (const auto depth : depths) {
+            CODEC_INFO::EncoderTestConfig config;
+            config.media_type = media_type;
+            config.async_depth = depth;
+            // also depth 1, which isn't the default of QSV and friends
+            config.codec_options.emplace_back("async_depth", std::to_string(depth));
+
+            const auto result = RunTest(name, config);
+            if (!result.opened || result.frames == 0)
+                continue;
+
+            CODEC_INFO::AsyncDepthPoint point;
+            point.async_depth = depth;
+            point.performance = result.performance;
+            if (depth == 1)
+                single = result.performance;
+            point.speedup = single > 0.0 ? result.performance / single : 0.0;
+            points.emplace_back(point);
+        }
+        return points;
+    }
+
+    bool EncodersInfo::FindBestAsyncDepth(const std::vector<CODEC_INFO::AsyncDepthPoint> &points,
+                                          CODEC_INFO::AsyncDepthPoint &best)
+    {
+        if (points.empty())
+            return false;
+        best = points.front();
+        for (const auto &point : points) {
+            // deeper queues cost latency and memory, only take them for a real gain
+            if (point.performance > best.performance * ASYNC_DEPTH_GAIN)
+                best = point;
         }
+        return true;
+    }
+
+    CODEC_INFO::RealtimePoint
+    EncodersInfo::TestRealtime(const std::string &name,
+                               const CODEC_INFO::EncoderTestConfig &config,
+                               double target_fps,
+                               double seconds,
+                               double max_miss_rate)
+    {
+        CODEC_INFO::EncoderTestConfig paced = config;
+        paced.pace_fps = target_fps;
+        paced.frames = std::max(1, static_cast<int>(std::lround(target_fps * seconds)));
+        paced.max_seconds = 0.0;
+        const auto result = RunTest(name, paced);
+
+        CODEC_INFO::RealtimePoint point;
+        point.target_fps = target_fps;
+        point.frames = static_cast<int>(result.frame_seconds.size());
+        point.deadline_misses = result.deadline_misses;
+        // frames never sent because the encoder failed count as missed
+        const int missed = result.deadline_misses + paced.frames - point.frames;
+        point.miss_rate = static_cast<double>(missed) / paced.frames;
+        point.latency_budget = result.latency_budget_seconds;
+        point.max_lateness = result.max_lateness_seconds;
+        point.jitter = result.jitter_seconds;
+        point.sustained = result.opened && point.miss_rate <= max_miss_rate;
+        if (log_)
+            *log_ << "Paced " << name << " at " << target_fps << " fps: " << missed << "/"
+                  << paced.frames << " deadlines missed" << std::endl;
+        return point;
+    }
 
-        frame->format = c->pix_fmt;
-        frame->width = c->width;
-        frame->height = c->height;
-        frame->color_primaries = c->color_primaries;
-        frame->color_trc = c->color_trc;
-        frame->colorspace = c->colorspace;
-        av_frame_get_buffer(frame, 0);
-
-        AVPacket *pkt = av_packet_alloc();
-        if (!pkt) {
-            av_frame_free(&frame);
-            avcodec_free_context(&c);
+    double EncodersInfo::FindMaxRealtimeFps(const std::string &name,
+                                            const CODEC_INFO::EncoderTestConfig &config,
+                                            double seconds,
+                                            double max_miss_rate,
+                                            std::vector<CODEC_INFO::RealtimePoint> &points)
+    {
+        points.clear();
+        // nothing sustains more than the burst throughput
+        const auto burst = RunTest(name, config);
+        if (!burst.opened || burst.performance <= 0.0)
             return 0.0;
+
+        double low = 0.0, high = burst.performance;
+        points.push_back(TestRealtime(name, config, high, seconds, max_miss_rate));
+        if (points.back().sustained)
+            return high;
+
+        for (int step = 0; step < REALTIME_MAX_STEPS && high - low > REALTIME_PRECISION * high;
+             step++) {
+            const double fps = (low + high) / 2.0;
+            points.push_back(TestRealtime(name, config, fps, seconds, max_miss_rate));
+            (points.back().sustained ? low : high) = fps;
         }
+        return low;
+    }
+
+    std::vector<CODEC_INFO::StreamPackingPoint>
+    EncodersInfo::TestStreamPacking(const std::string &name,
+                                    const CODEC_INFO::EncoderTestConfig &config,
+                                    double target_fps,
+                                    int cores)
+    {
+        std::vector<CODEC_INFO::StreamPackingPoint> points;
+        if (cores < 1 || target_fps <= 0.0)
+            return points;
 
-        const auto start = std::chrono::high_resolution_clock::now();
-
-        for (int i = 0; i < TEST_FRAMES; i++) {
-            int max_value = is_hdr ? 1023 : 255;
-            for (int y = 0; y < c->height; y++) {
-                for (int x = 0; x < c->width; x++) {
-                    if (is_hdr) {
-                        ((uint16_t *)frame->data[0])[y * frame->linesize[0] / 2 + x] =
-                            ((x + y + i * 3) * 4) & max_value;
-                    }
-                    else {
-                        frame->data[0][y * frame->linesize[0] + x] = (x + y + i * 3) & max_value;
-                    }
+        std::vector<int> thread_counts;
+        for (int n = 1; n < cores; n *= 2)
+            thread_counts.push_back(n);
+        thread_counts.push_back(cores);
+
+        for (const auto threads : thread_counts) {
+            for (int streams = 1; streams * threads <= cores; streams++) {
+                // Hold every instance until all are open so the timed loops overlap.
+                std::mutex mutex;
+                std::condition_variable ready;
+                int waiting = streams;
+                const auto arrive = [&]()
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    if (--waiting == 0)
+                        ready.notify_all();
+                    else
+                        ready.wait(lock, [&]() { return waiting == 0; });
+                };
+
+                std::vector<CODEC_INFO::EncoderTestResult> results(streams);
+                std::vector<std::thread> workers;
+                for (int i = 0; i < streams; i++) {
+                    workers.emplace_back(
+                        [&, i]()
+                        {
+                            Trace::SetThreadName("packing stream");
+                            bool arrived = false;
+                            auto stream_config = config;
+                            stream_config.thread_count = threads;
+                            stream_config.before_timing = [&]()
+                            {
+                                arrived = true;
+                                arrive();
+                            };
+                            results[i] = RunEncoderTest(name, stream_config);
+                            if (!arrived)
+                                arrive();
+                        });
                 }
-            }
-            for (int y = 0; y < c->height / 2; y++) {
-                for (int x = 0; x < c->width / 2; x++) {
-                    if (is_hdr) {
-                        ((uint16_t *)frame->data[1])[y * frame->linesize[1] / 2 + x] =
-                            ((512 + y + i * 2) * 4) & max_value;
-                        ((uint16_t *)frame->data[2])[y * frame->linesize[2] / 2 + x] =
-                            ((256 + x + i * 5) * 4) & max_value;
-                    }
-                    else {
-                        frame->data[1][y * frame->linesize[1] + x] = (128 + y + i * 2) & max_value;
-                        frame->data[2][y * frame->linesize[2] + x] = (64 + x + i * 5) & max_value;
-                    }
+                for (auto &worker : workers)
+                    worker.join();
+
+                CODEC_INFO::StreamPackingPoint point { streams, threads, 0.0, 0.0, 0.0, false };
+                bool opened = true;
+                for (const auto &result : results) {
+                    opened = opened && result.opened;
+                    point.aggregate_performance += result.performance;
+                    if (point.min_stream_performance == 0.0 ||
+                        result.performance < point.min_stream_performance)
+                        point.min_stream_performance = result.performance;
                 }
+                if (!opened)
+                    break;
+
+                point.realtime_margin = point.min_stream_performance / target_fps;
+                point.sustainable = point.realtime_margin >= 1.0;
+                points.emplace_back(point);
+
+                // Adding streams only lowers per-stream fps past this point.
+                if (!point.sustainable)
+                    break;
             }
+        }
+        return points;
+    }
 
-            frame->pts = i;
+    bool
+    EncodersInfo::FindBestStreamPacking(const std::vector<CODEC_INFO::StreamPackingPoint> &points,
+                                        CODEC_INFO::StreamPackingPoint &best)
+    {
+        bool find = false;
+        for (const auto &point : points) {
+            if (!point.sustainable)
+                continue;
+            if (!find || point.streams > best.streams ||
+                (point.streams == best.streams && point.realtime_margin > best.realtime_margin)) {
+                best = point;
+                find = true;
+            }
+        }
+        return find;
+    }
 
-            int ret = avcodec_send_frame(c, frame);
-            if (ret < 0)
-                break;
+    // least-squares line through (x, y), r2 is 1 for fewer than three points
+    static void fit_line(const std::vector<double> &y, double &intercept, double &slope, double &r2)
+    {
+        const size_t n = y.size();
+        intercept = slope = 0.0;
+        r2 = 1.0;
+        if (n == 0)
+            return;
+        if (n == 1) {
+            slope = y[0];
+            return;
+        }
+        double mean_x = 0.0, mean_y = 0.0;
+        for (size_t i = 0; i < n; i++) {
+            mean_x += i + 1;
+            mean_y += y[i];
+        }
+        mean_x /= n;
+        mean_y /= n;
+        double sxx = 0.0, sxy = 0.0, syy = 0.0;
+        for (size_t i = 0; i < n; i++) {
+            sxx += (i + 1 - mean_x) * (i + 1 - mean_x);
+            sxy += (i + 1 - mean_x) * (y[i] - mean_y);
+            syy += (y[i] - mean_y) * (y[i] - mean_y);
+        }
+        slope = sxy / sxx;
+        intercept = mean_y - slope * mean_x;
+        if (n > 2 && syy > 0.0)
+            r2 = sxy * sxy / (sxx * syy);
+    }
 
-            while (ret >= 0) {
-                ret = avcodec_receive_packet(c, pkt);
-                if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
-                    break;
-                if (ret < 0)
-                    break;
-                av_packet_unref(pkt);
+    CODEC_INFO::SessionMemoryModel
+    EncodersInfo::MeasureSessionMemory(const std::string &name,
+                                       const CODEC_INFO::EncoderTestConfig &config,
+                                       int max_sessions)
+    {
+        TRACE_SCOPE("MeasureSessionMemory", name.c_str());
+        struct Session {
+            AVCodecContext *c = nullptr;
+            AVFrame *frame = nullptr;
+            AVPacket *pkt = nullptr;
+        };
+        std::vector<Session> sessions;
+        std::vector<double> host, device;
+
+        // a benchmark of the same encoder usually ran just before, the first sessions would
+        // reuse the heap it freed and seem to cost nothing
+        ReleaseFreeHeap();
+        const int64_t rss_before = GetResidentBytes();
+        const int64_t device_before = std::max<int64_t>(0, GetDeviceMemoryBytes());
+        bool device_seen = false;
+        CODEC_INFO::SessionMemoryModel model;
+
+        const bool is_hdr = config.media_type == CODEC_INFO::MEDIA_TYPE::HDR;
+        while (static_cast<int>(sessions.size()) < max_sessions) {
+            Session session;
+            session.c = OpenTestEncoder(name, config);
+            if (session.c)
+                session.frame = AllocTestFrame(session.c);
+            session.pkt = av_packet_alloc();
+            bool ok = session.c && session.frame && session.pkt;
+            for (int i = 0; ok && i < SESSION_WARM_FRAMES; i++) {
+                FillTestFrame(session.frame, i, is_hdr);
+                session.frame->pts = i;
+                const int ret = avcodec_send_frame(session.c, session.frame);
+                USDT_PROBE3(send_frame, name.c_str(), i, ret);
+                ok = ret >= 0;
+                while (ok && avcodec_receive_packet(session.c, session.pkt) >= 0) {
+                    USDT_PROBE4(receive_packet,
+                                name.c_str(),
+                                session.pkt->pts,
+                                session.pkt->size,
+                                0);
+                    av_packet_unref(session.pkt);
+                }
+            }
+            sessions.push_back(session);
+            if (!ok) {
+                // typically a hw encoder out of sessions, e.g. consumer NVENC's limit
+                model.session_limit = true;
+                break;
             }
+
+            host.push_back(static_cast<double>(GetResidentBytes() - rss_before));
+            const int64_t device_bytes = GetDeviceMemoryBytes();
+            device_seen = device_seen || device_bytes >= 0;
+            device.push_back(
+                static_cast<double>(std::max<int64_t>(0, device_bytes) - device_before));
+        }
+
+        for (auto &session : sessions) {
+            av_packet_free(&session.pkt);
+            av_frame_free(&session.frame);
+            if (session.c)
+                USDT_PROBE2(encoder_close, name.c_str(), SESSION_WARM_FRAMES);
+            avcodec_free_context(&session.c);
         }
 
-        const auto end = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double> diff = end - start;
+        model.sessions = static_cast<int>(host.size());
+        fit_line(host, model.base_bytes, model.per_session_bytes, model.fit_r2);
+        if (model.base_bytes < 0.0) {
+            // a negative intercept is noise, nothing is shared: refit through the origin
+            double sxy = 0.0, sxx = 0.0;
+            for (size_t i = 0; i < host.size(); i++) {
+                sxy += (i + 1) * host[i];
+                sxx += (i + 1) * (i + 1);
+            }
+            model.base_bytes = 0.0;
+            model.per_session_bytes = sxy / sxx;
+        }
+        if (device_seen) {
+            double intercept = 0.0, r2 = 0.0;
+            fit_line(device, intercept, model.device_per_session_bytes, r2);
+        }
+        return model;
+    }
 
-        av_frame_free(&frame);
-        av_packet_free(&pkt);
-        avcodec_free_context(&c);
+    CODEC_INFO::SessionCapacity
+    EncodersInfo::EstimateCapacity(const CODEC_INFO::SessionMemoryModel &model,
+                                   double performance,
+                                   double target_fps,
+                                   int64_t memory_bytes)
+    {
+        CODEC_INFO::SessionCapacity capacity;
+        capacity.by_throughput =
+            target_fps > 0.0 ? static_cast<int>(std::floor(performance / target_fps)) : 0;
+        if (model.per_session_bytes > 0.0)
+            capacity.by_memory = static_cast<int>(std::max(
+                0.0, std::floor((memory_bytes - model.base_bytes) / model.per_session_bytes)));
+        else
+            capacity.by_memory = capacity.by_throughput;
+        // a session limit caps both, more sessions than that won't even open
+        if (model.session_limit) {
+            capacity.by_memory = std::min(capacity.by_memory, model.sessions);
+            capacity.by_throughput = std::min(capacity.by_throughput, model.sessions);
+        }
+        capacity.memory_bound = capacity.by_memory < capacity.by_throughput;
+        capacity.sessions = std::min(capacity.by_memory, capacity.by_throughput);
+        return capacity;
+    }
 
-        return TEST_FRAMES / diff.count();
+    CODEC_INFO::EncoderTestResult
+    EncodersInfo::test_encoder_performance(std::string name, CODEC_INFO::MEDIA_TYPE media_type)
+    {
+        TRACE_SCOPE("test_encoder_performance", name.c_str());
+        CODEC_INFO::EncoderTestConfig config;
+        config.media_type = media_type;
+        config.perf_counters = collect_counters_;
+        config.async_depth = async_depth_;
+        config.max_b_frames = max_b_frames_;
+        return RunTest(name, config);
     }
 
 } // namespace CODEC_INFO
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "codec_info.h"
+#include "encoder_bench.h"
+#include <iostream>
 #include <vector>
 
 namespace CODEC_INFO
@@ -13,23 +15,148 @@ namespace CODEC_INFO
         EncodersInfo();
         ~EncodersInfo();
 
+        // progress output of the benchmarks, nullptr keeps them quiet
+        void SetLogStream(std::ostream *log) { log_ = log; }
+        // attach perf counters to every benchmarked CodecPerformance
+        void SetCollectCounters(bool collect) { collect_counters_ = collect; }
+        // what FindBestHwVideoEncoder optimizes, anything but THROUGHPUT benchmarks every encoder
+        void SetObjective(CODEC_INFO::SELECTION_OBJECTIVE objective) { objective_ = objective; }
+        // fps an encoder has to keep to be picked for anything but throughput
+        void SetRequiredFps(double fps) { required_fps_ = fps; }
+        // LOW_LATENCY only: the most frames of delay + reorder depth allowed, -1 for the least
+        void SetMaxDelayFrames(double frames) { max_delay_frames_ = frames; }
+        // B-frames the benchmarks allow, they show up as reorder depth
+        void SetMaxBFrames(int frames) { max_b_frames_ = frames; }
+        // frames the benchmarks keep in flight, see EncoderTestConfig::async_depth
+        void SetAsyncDepth(int depth) { async_depth_ = depth; }
+        // called with every benchmark the modes run, e.g. to keep a history; the concurrent
+        // sessions of TestStreamPacking aren't benchmarks on their own and aren't reported
+        using ResultListener = std::function<void(const std::string &name,
+                                                  const CODEC_INFO::EncoderTestConfig &config,
+                                                  const CODEC_INFO::EncoderTestResult &result)>;
+        void SetResultListener(ResultListener listener) { result_listener_ = std::move(listener); }
+
+        // RunEncoderTest, reported to the result listener
+        CODEC_INFO::EncoderTestResult RunTest(const std::string &name,
+                                              const CODEC_INFO::EncoderTestConfig &config);
+
         std::vector<std::tuple<std::string, AVCodecID>> GetAllEncoders(AVMediaType media_type);
 
         std::vector<std::tuple<std::string, AVCodecID>> GetHwEncoders(AVMediaType media_type);
         std::vector<std::tuple<std::string, AVCodecID, AVHWDeviceType>>
         GetDeviceHwEncoders(AVMediaType media_type);
+        // only the encoders one device type can open
+        std::vector<std::tuple<std::string, AVCodecID, AVHWDeviceType>>
+        GetDeviceHwEncoders(AVMediaType media_type, AVHWDeviceType hw_type);
         std::vector<std::tuple<std::string, AVCodecID>> GetSwEncoders(AVMediaType media_type);
 
         std::vector<std::tuple<std::string, AVCodecID>> GetHwEncoders(AVHWDeviceType hw_type);
 
+        // device type the encoder needs, AV_HWDEVICE_TYPE_NONE if it declares none
+        static AVHWDeviceType GetEncoderDeviceType(const std::string &name);
+
         // enum all hw encoders and return all device perfomance
         std::vector<CODEC_INFO::CodecPerformance>
         DetectHwVideoEncoders(CODEC_INFO::MEDIA_TYPE media_type);
+        // only the encoders attached to hw_type, all of them for AV_HWDEVICE_TYPE_NONE;
+        // results receives every benchmark's details by encoder name
+        std::vector<CODEC_INFO::CodecPerformance> DetectHwVideoEncoders(
+            CODEC_INFO::MEDIA_TYPE media_type,
+            AVHWDeviceType hw_type,
+            std::vector<std::pair<std::string, CODEC_INFO::EncoderTestResult>> *results = nullptr);
+        // the software encoder libavcodec picks for each codec id, e.g. where hw jobs spill to
+        std::vector<CODEC_INFO::CodecPerformance>
+        DetectSwVideoEncoders(CODEC_INFO::MEDIA_TYPE media_type,
+                              const std::vector<AVCodecID> &codec_ids);
 
         bool FindBestHwVideoEncoder(CODEC_INFO::MEDIA_TYPE media_type,
                                     CODEC_INFO::CodecPerformance &find_codec_info);
+        // priors (e.g. cached results) decide who runs first, see RaceHwVideoEncoders
+        bool FindBestHwVideoEncoder(CODEC_INFO::MEDIA_TYPE media_type,
+                                    const std::vector<CODEC_INFO::CodecPerformance> &priors,
+                                    CODEC_INFO::CodecPerformance &find_codec_info);
+
+        // best of already benchmarked encoders under objective, false if none opened;
+        // max_delay_frames caps LOW_LATENCY the way SetMaxDelayFrames does
+        static bool PickBestEncoder(const std::vector<CODEC_INFO::CodecPerformance> &encoders,
+                                    CODEC_INFO::SELECTION_OBJECTIVE objective,
+                                    double required_fps,
+                                    CODEC_INFO::CodecPerformance &best,
+                                    double max_delay_frames = -1.0);
+
+        // Successive halving: every encoder runs a short trial, the slower half drops out unless
+        // its confidence interval still reaches the leader, survivors run twice the frames.
+        // Survivors come first in the result, eliminated encoders keep their last estimate.
+        std::vector<CODEC_INFO::CodecPerformance>
+        RaceHwVideoEncoders(CODEC_INFO::MEDIA_TYPE media_type,
+                            const std::vector<CODEC_INFO::CodecPerformance> &priors,
+                            CODEC_INFO::RaceStats &stats);
+
+        // measure fps for 1, 2, 4, ... max_threads under every threading mode the codec supports
+        std::vector<CODEC_INFO::ThreadScalingPoint> TestThreadScaling(
+            const std::string &name, CODEC_INFO::MEDIA_TYPE media_type, int max_threads);
+
+        // measure fps with 1, 2, 4, ... max_depth frames in flight, as the encoder's async_depth
+        // option; empty for encoders without one
+        std::vector<CODEC_INFO::AsyncDepthPoint> TestAsyncDepth(
+            const std::string &name, CODEC_INFO::MEDIA_TYPE media_type, int max_depth);
+
+        // pick the depth with the most fps, among near ties the shallowest
+        static bool FindBestAsyncDepth(const std::vector<CODEC_INFO::AsyncDepthPoint> &points,
+                                       CODEC_INFO::AsyncDepthPoint &best);
+
+        // Feed frames at target_fps for `seconds` like a live source and count missed deadlines.
+        CODEC_INFO::RealtimePoint TestRealtime(const std::string &name,
+                                               const CODEC_INFO::EncoderTestConfig &config,
+                                               double target_fps,
+                                               double seconds,
+                                               double max_miss_rate);
+
+        // Bisect the highest paced fps the encoder sustains, starting from its unpaced fps.
+        // Every paced run lands in points, 0 if not even the lowest rate holds.
+        double FindMaxRealtimeFps(const std::string &name,
+                                  const CODEC_INFO::EncoderTestConfig &config,
+                                  double seconds,
+                                  double max_miss_rate,
+                                  std::vector<CODEC_INFO::RealtimePoint> &points);
+
+        // run M concurrent instances with T threads each for every M * T <= cores
+        std::vector<CODEC_INFO::StreamPackingPoint>
+        TestStreamPacking(const std::string &name,
+                          const CODEC_INFO::EncoderTestConfig &config,
+                          double target_fps,
+                          int cores);
+
+        // Open up to max_sessions sessions one after the other, each encoding a few frames so the
+        // lazily allocated buffers exist, and fit the RSS (and device memory) they add.
+        CODEC_INFO::SessionMemoryModel
+        MeasureSessionMemory(const std::string &name,
+                             const CODEC_INFO::EncoderTestConfig &config,
+                             int max_sessions);
+
+        // memory_bytes is what the sessions may use, throughput assumes one session's fps
+        // splits evenly among target_fps streams
+        static CODEC_INFO::SessionCapacity
+        EstimateCapacity(const CODEC_INFO::SessionMemoryModel &model,
+                         double performance,
+                         double target_fps,
+                         int64_t memory_bytes);
+
+        // pick the packing that sustains the most streams, false if none keeps target fps
+        static bool FindBestStreamPacking(const std::vector<CODEC_INFO::StreamPackingPoint> &points,
+                                          CODEC_INFO::StreamPackingPoint &best);
 
     private:
-        double test_encoder_performance(std::string name, CODEC_INFO::MEDIA_TYPE media_type);
+        std::ostream *log_ = &std::cout;
+        bool collect_counters_ = false;
+        CODEC_INFO::SELECTION_OBJECTIVE objective_ = CODEC_INFO::SELECTION_OBJECTIVE::THROUGHPUT;
+        double required_fps_ = TEST_FRAMES;
+        int async_depth_ = 1;
+        double max_delay_frames_ = -1.0;
+        int max_b_frames_ = 0;
+        ResultListener result_listener_;
+
+        CODEC_INFO::EncoderTestResult test_encoder_performance(std::string name,
+                                                               CODEC_INFO::MEDIA_TYPE media_type);
     };
 } // namespace CODEC_INFO
\ No newline at end of file
@@ -0,0 +1,96 @@
+#include "energy_meter.h"
+#include <fstream>
+
+#if defined(__linux__)
+#include <dirent.h>
+#endif
+
+#define POWERCAP_PATH "/sys/class/powercap/"
+
+namespace CODEC_INFO
+{
+    EnergyMeter::EnergyMeter() {}
+
+    EnergyMeter::~EnergyMeter() {}
+
+#if defined(__linux__)
+    static bool read_counter(const std::string &path, uint64_t &value)
+    {
+        std::ifstream file(path);
+        return static_cast<bool>(file >> value);
+    }
+
+    bool EnergyMeter::Open()
+    {
+        zones_.clear();
+        DIR *powercap = opendir(POWERCAP_PATH);
+        if (!powercap) {
+            error_ = "no powercap interface";
+            return false;
+        }
+
+        bool found = false;
+        while (const dirent *entry = readdir(powercap)) {
+            const std::string zone_name = entry->d_name;
+            if (zone_name.compare(0, 11, "intel-rapl:") != 0)
+                continue;
+            found = true;
+            const std::string zone_path = POWERCAP_PATH + zone_name + "/";
+            std::ifstream name_file(zone_path + "name");
+            std::string name;
+            name_file >> name;
+            // core, uncore and psys overlap with the package
+            const bool dram = name == "dram";
+            if (!dram && name.compare(0, 7, "package") != 0)
+                continue;
+
+            Zone zone;
+            zone.path = zone_path + "energy_uj";
+            zone.dram = dram;
+            uint64_t value = 0;
+            if (!read_counter(zone_path + "max_energy_range_uj", zone.range) ||
+                !read_counter(zone.path, value))
+                continue;
+            zones_.push_back(zone);
+        }
+        closedir(powercap);
+
+        if (zones_.empty())
+            error_ = found ? "RAPL energy_uj not readable (root only since Linux 5.10)"
+                           : "no RAPL zones";
+        return !zones_.empty();
+    }
+
+    std::vector<uint64_t> EnergyMeter::Sample() const
+    {
+        std::vector<uint64_t> sample(zones_.size(), 0);
+        for (size_t i = 0; i < zones_.size(); i++)
+            read_counter(zones_[i].path, sample[i]);
+        return sample;
+    }
+#else
+    bool EnergyMeter::Open()
+    {
+        error_ = "RAPL energy needs Linux";
+        return false;
+    }
+
+    std::vector<uint64_t> EnergyMeter::Sample() const { return {}; }
+#endif
+
+    void EnergyMeter::Joules(const std::vector<uint64_t> &begin,
+                             const std::vector<uint64_t> &end,
+                             double &package_joules,
+                             double &dram_joules) const
+    {
+        package_joules = 0.0;
+        dram_joules = 0.0;
+        for (size_t i = 0; i < zones_.size() && i < begin.size() && i < end.size(); i++) {
+            // at most one wrap, the range is minutes of full load even on big sockets
+            const uint64_t delta = end[i] >= begin[i] ? end[i] - begin[i]
+                                                      : zones_[i].range - begin[i] + end[i];
+            (zones_[i].dram ? dram_joules : package_joules) += delta / 1e6;
+        }
+    }
+
+} // namespace CODEC_INFO
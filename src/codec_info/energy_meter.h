@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace CODEC_INFO
+{
+    // Package and DRAM energy from the RAPL powercap zones (/sys/class/powercap/intel-rapl*,
+    // also there on AMD). The counters are socket-wide: other processes and idle power count
+    // too, which is what the power bill sees anyway. Linux only, and since kernel 5.10 the
+    // counters need root or a chmod of energy_uj.
+    class EnergyMeter
+    {
+    public:
+        EnergyMeter();
+        ~EnergyMeter();
+
+        // false if no zone is readable, Error() says why
+        bool Open();
+        const std::string &Error() const { return error_; }
+
+        // counters right now, one per zone, to pass to Joules() later
+        std::vector<uint64_t> Sample() const;
+        // energy between two samples, wraparound of the counters included
+        void Joules(const std::vector<uint64_t> &begin,
+                    const std::vector<uint64_t> &end,
+                    double &package_joules,
+                    double &dram_joules) const;
+
+    private:
+        struct Zone {
+            std::string path;   // energy_uj
+            uint64_t range = 0; // max_energy_range_uj, where the counter wraps
+            bool dram = false;
+        };
+        std::vector<Zone> zones_;
+        std::string error_;
+    };
+
+} // namespace CODEC_INFO
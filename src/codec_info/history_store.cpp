@@ -0,0 +1,247 @@
+#include "history_store.h"
+#include "json_reader.h"
+#include "result_diff.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <map>
+
+// One-sided 99% normal quantile, the limit of the t quantiles below.
+#define REGRESSION_Z 2.326
+// Degrees of freedom the t table covers, a series expansion takes over beyond.
+#define REGRESSION_T_TABLE_DF 30
+
+namespace CODEC_INFO
+{
+    static void mean_variance(const std::vector<double> &values, double &mean, double &variance)
+    {
+        mean = 0.0;
+        variance = 0.0;
+        if (values.empty())
+            return;
+        for (const auto value : values)
+            mean += value;
+        mean /= values.size();
+        if (values.size() < 2)
+            return;
+        for (const auto value : values)
+            variance += (value - mean) * (value - mean);
+        variance /= values.size() - 1;
+    }
+
+    // One-sided 99% quantile of Student's t. Fractional (Welch) df round down, which keeps the
+    // test on the safe side.
+    static double t_quantile_99(double df)
+    {
+        static const double T_99[REGRESSION_T_TABLE_DF] = {
+            31.821, 6.965, 4.541, 3.747, 3.365, 3.143, 2.998, 2.896, 2.821, 2.764,
+            2.718,  2.681, 2.650, 2.624, 2.602, 2.583, 2.567, 2.552, 2.539, 2.528,
+            2.518,  2.508, 2.500, 2.492, 2.485, 2.479, 2.473, 2.467, 2.462, 2.457,
+        };
+        const int whole = static_cast<int>(std::floor(df));
+        if (whole <= REGRESSION_T_TABLE_DF)
+            return T_99[std::max(whole, 1) - 1];
+        // Cornish-Fisher, well within the table's rounding past 30 df
+        const double z = REGRESSION_Z;
+        return z + (z * z * z + z) / (4.0 * df) +
+               (5.0 * std::pow(z, 5) + 16.0 * z * z * z + 3.0 * z) / (96.0 * df * df);
+    }
+
+    HistoryStore::HistoryStore(std::string path) : path_(std::move(path)) {}
+
+    HistoryStore::~HistoryStore() {}
+
+    std::string HistoryStore::NewRunId()
+    {
+        // sortable and unique enough for one host
+        return std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                  std::chrono::system_clock::now().time_since_epoch())
+                                  .count());
+    }
+
+    bool HistoryStore::Load(std::vector<HistoryRecord> &records, std::string *error) const
+    {
+        std::ifstream file(path_);
+        if (!file) {
+            if (error)
+                *error = "can't open " + path_;
+            return false;
+        }
+
+        struct RunEnvironment {
+            int64_t timestamp = 0;
+            std::string host;
+            std::string fingerprint;
+        };
+        std::map<std::string, RunEnvironment> runs;
+
+        std::string line;
+        int line_number = 0;
+        while (std::getline(file, line)) {
+            line_number++;
+            JsonValue value;
+            std::string parse_error;
+            if (line.empty())
+                continue;
+            if (!ParseJson(line, value, &parse_error)) {
+                // a run killed mid-write leaves a torn last line, skip it
+                if (error)
+                    *error = path_ + ":" + std::to_string(line_number) + ": " + parse_error;
+                continue;
+            }
+
+            const auto type = value.String("type");
+            const auto run = value.String("run");
+            if (type == "environment") {
+                auto &environment = runs[run];
+                environment.timestamp = static_cast<int64_t>(value.Number("timestamp"));
+                environment.host = value.String("host");
+                environment.fingerprint = value.String("fingerprint");
+                continue;
+            }
+            if (type != "benchmark" || run.empty())
+                continue;
+
+            HistoryRecord record;
+            record.run = run;
+            const auto environment = runs.find(run);
+            if (environment != runs.end()) {
+                record.timestamp = environment->second.timestamp;
+                record.host = environment->second.host;
+            }
+            record.fingerprint = value.String("fingerprint");
+            record.cell = BenchmarkCell(value);
+            record.fps = value.Number("fps");
+            if (const JsonValue *samples = value.Find("fps_samples")) {
+                for (const auto &sample : samples->array)
+                    record.fps_samples.push_back(sample.number);
+            }
+            if (const JsonValue *samples = value.Find("frame_ms")) {
+                for (const auto &sample : samples->array)
+                    record.frame_ms.push_back(sample.number);
+            }
+            records.emplace_back(std::move(record));
+        }
+        return true;
+    }
+
+    bool HistoryStore::Compare(const std::vector<HistoryRecord> &records,
+                               const RegressionOptions &options,
+                               std::vector<RegressionCheck> &checks)
+    {
+        // runs in the order they were appended
+        std::vector<std::string> order;
+        for (const auto &record : records) {
+            if (std::find(order.begin(), order.end(), record.run) == order.end())
+                order.push_back(record.run);
+        }
+        const std::string run = options.run.empty() && !order.empty() ? order.back() : options.run;
+        const auto current_position = std::find(order.begin(), order.end(), run);
+        if (current_position == order.end())
+            return false;
+
+        std::string host;
+        for (const auto &record : records) {
+            if (record.run == run)
+                host = record.host;
+        }
+
+        std::vector<std::string> baseline_runs;
+        if (!options.baseline_run.empty()) {
+            if (std::find(order.begin(), order.end(), options.baseline_run) == order.end())
+                return false;
+            baseline_runs.push_back(options.baseline_run);
+        }
+        else {
+            for (auto it = current_position; it != order.begin() &&
+                                             static_cast<int>(baseline_runs.size()) <
+                                                 options.last_runs;) {
+                --it;
+                const auto same_host =
+                    std::find_if(records.begin(),
+                                 records.end(),
+                                 [&](const HistoryRecord &record)
+                                 { return record.run == *it && record.host == host; });
+                if (same_host != records.end())
+                    baseline_runs.push_back(*it);
+            }
+        }
+        if (baseline_runs.empty())
+            return false;
+
+        for (const auto &current : records) {
+            if (current.run != run)
+                continue;
+
+            std::vector<const HistoryRecord *> baseline;
+            for (const auto &record : records) {
+                if (record.cell == current.cell &&
+                    std::find(baseline_runs.begin(), baseline_runs.end(), record.run) !=
+                        baseline_runs.end())
+                    baseline.push_back(&record);
+            }
+            if (baseline.empty())
+                continue;
+
+            RegressionCheck check;
+            check.cell = current.cell;
+            check.baseline_runs = static_cast<int>(baseline.size());
+            check.current_fps = current.fps;
+            // file order, the newest baseline run is last
+            check.environment_changed = baseline.back()->fingerprint != current.fingerprint;
+
+            std::vector<double> fps;
+            for (const auto *record : baseline)
+                fps.push_back(record->fps);
+            double mean = 0.0, variance = 0.0;
+            mean_variance(fps, mean, variance);
+            check.baseline_fps = mean;
+            check.change = mean > 0.0 ? current.fps / mean - 1.0 : 0.0;
+
+            double standard_error = 0.0;
+            double df = 0.0;
+            if (baseline.size() >= 2) {
+                // prediction interval of one more run
+                standard_error = std::sqrt(variance * (1.0 + 1.0 / baseline.size()));
+                df = baseline.size() - 1.0;
+                if (standard_error > 0.0)
+                    check.z = (current.fps - mean) / standard_error;
+            }
+            else if (current.fps_samples.size() >= 2 && baseline[0]->fps_samples.size() >= 2) {
+                // Welch on the repetitions, a slower run gives a negative score
+                double current_mean = 0.0, current_variance = 0.0;
+                double base_mean = 0.0, base_variance = 0.0;
+                mean_variance(current.fps_samples, current_mean, current_variance);
+                mean_variance(baseline[0]->fps_samples, base_mean, base_variance);
+                const double current_term = current_variance / current.fps_samples.size();
+                const double base_term = base_variance / baseline[0]->fps_samples.size();
+                standard_error = std::sqrt(current_term + base_term);
+                // Welch-Satterthwaite
+                if (standard_error > 0.0) {
+                    df = std::pow(current_term + base_term, 2) /
+                         (current_term * current_term / (current.fps_samples.size() - 1.0) +
+                          base_term * base_term / (baseline[0]->fps_samples.size() - 1.0));
+                    check.z = (current_mean - base_mean) / standard_error;
+                }
+            }
+            // without any spread, or too few degrees of freedom, only the size of the drop decides
+            if (standard_error <= 0.0 || df < 1.0)
+                check.z = check.change < 0.0 ? -HUGE_VAL : 0.0;
+
+            check.regression = check.z < -t_quantile_99(df) && check.change <= -options.min_drop;
+            checks.push_back(check);
+        }
+
+        std::stable_sort(checks.begin(),
+                         checks.end(),
+                         [](const RegressionCheck &a, const RegressionCheck &b)
+                         {
+                             if (a.regression != b.regression)
+                                 return a.regression;
+                             return a.change < b.change;
+                         });
+        return true;
+    }
+
+} // namespace CODEC_INFO
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace CODEC_INFO
+{
+    // One benchmark cell of a stored run.
+    struct HistoryRecord {
+        std::string run;
+        int64_t timestamp = 0;
+        std::string host;
+        std::string fingerprint;
+        std::string cell; // encoder and configuration, what runs are matched on
+        double fps = 0.0;
+        std::vector<double> fps_samples; // of every repetition, with --repeat
+        std::vector<double> frame_ms;
+    };
+
+    struct RegressionOptions {
+        std::string run;          // run to check, the latest one if empty
+        std::string baseline_run; // pinned baseline, otherwise the last_runs before `run`
+        int last_runs = 5;
+        double min_drop = 0.05; // smaller drops are never flagged, however significant
+    };
+
+    struct RegressionCheck {
+        std::string cell;
+        int baseline_runs = 0;
+        double baseline_fps = 0.0; // mean over the baseline runs
+        double current_fps = 0.0;
+        double change = 0.0; // relative, negative is slower
+        double z = 0.0;      // how far below the baseline in standard errors, negative is slower
+        bool environment_changed = false; // FFmpeg, driver or host fingerprint differs
+        bool regression = false;
+    };
+
+    // Benchmark history as append-only NDJSON: every run is a ReportWriter stream tagged with its
+    // run id and per-frame samples, so the file doubles as a plain report archive.
+    class HistoryStore
+    {
+    public:
+        explicit HistoryStore(std::string path);
+        ~HistoryStore();
+
+        const std::string &Path() const { return path_; }
+        static std::string NewRunId();
+
+        // every benchmark record in file order, false if the file can't be read
+        bool Load(std::vector<HistoryRecord> &records, std::string *error = nullptr) const;
+
+        // Check every cell of the run against its baseline: a one-sided 99% t test on the
+        // baseline runs' fps (n-1 df), or Welch on the repetitions' fps with a single baseline
+        // run. Per-frame times are autocorrelated, a single unrepeated baseline gates on min_drop
+        // alone.
+        // false if the run or its baseline isn't in the history.
+        static bool Compare(const std::vector<HistoryRecord> &records,
+                            const RegressionOptions &options,
+                            std::vector<RegressionCheck> &checks);
+
+    private:
+        std::string path_;
+    };
+
+} // namespace CODEC_INFO
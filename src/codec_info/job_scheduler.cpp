@@ -0,0 +1,242 @@
+#include "job_scheduler.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <utility>
+
+// Devices of one type tried by FindDevices.
+#define SCHEDULER_MAX_DEVICES 16
+
+namespace CODEC_INFO
+{
+    JobScheduler::JobScheduler(std::vector<EncoderCapacity> capacities)
+        : capacities_(std::move(capacities))
+    {
+        slots_.reset(new Slot[capacities_.size()]);
+
+        std::map<std::string, int> device_ids;
+        for (size_t i = 0; i < capacities_.size(); i++) {
+            const auto key = device_key(capacities_[i]);
+            const auto found = device_ids.emplace(key, static_cast<int>(device_ids.size()));
+            slots_[i].device = found.first->second;
+        }
+        devices_.reset(new Device[device_ids.size()]);
+    }
+
+    JobScheduler::~JobScheduler() {}
+
+    std::string JobScheduler::device_key(const EncoderCapacity &capacity)
+    {
+        // All software encoders share the CPU. A hardware encoder that names no device type
+        // (e.g. a V4L2 mem2mem one) gets a device of its own rather than the CPU's budget.
+        if (!capacity.hardware)
+            return "cpu";
+        if (capacity.hw_type == AV_HWDEVICE_TYPE_NONE)
+            return "encoder:" + capacity.name;
+        return std::string(av_hwdevice_get_type_name(capacity.hw_type)) + ":" +
+               std::to_string(capacity.device_index);
+    }
+
+    std::vector<std::string> JobScheduler::FindDevices(AVHWDeviceType hw_type)
+    {
+        std::vector<std::string> devices;
+        for (int i = 0; i < SCHEDULER_MAX_DEVICES; i++) {
+            // DRM based types take a render node, the others an adapter index
+            std::string device = std::to_string(i);
+            switch (hw_type) {
+            case AV_HWDEVICE_TYPE_VAAPI:
+            case AV_HWDEVICE_TYPE_DRM:
+#if !defined(_WIN32)
+            case AV_HWDEVICE_TYPE_QSV:
+#endif
+                device = "/dev/dri/renderD" + std::to_string(128 + i);
+                break;
+            default:
+                break;
+            }
+            AVBufferRef *hw_device_ctx = nullptr;
+            if (av_hwdevice_ctx_create(&hw_device_ctx, hw_type, device.c_str(), nullptr, 0) != 0)
+                break;
+            av_buffer_unref(&hw_device_ctx);
+            devices.push_back(device);
+        }
+        if (devices.empty())
+            devices.emplace_back();
+        return devices;
+    }
+
+    std::vector<EncoderCapacity>
+    JobScheduler::MakeCapacities(const std::vector<CodecPerformance> &hardware,
+                                 const std::vector<CodecPerformance> &software,
+                                 int width,
+                                 int height)
+    {
+        std::vector<EncoderCapacity> capacities;
+        std::map<AVHWDeviceType, std::vector<std::string>> devices;
+        const auto add = [&](const CodecPerformance &performance, bool is_hardware)
+        {
+            if (performance.performance <= 0.0)
+                return;
+            const auto duplicate = std::find_if(capacities.begin(),
+                                                capacities.end(),
+                                                [&](const EncoderCapacity &capacity)
+                                                { return capacity.name == performance.name; });
+            if (duplicate != capacities.end())
+                return;
+
+            EncoderCapacity capacity;
+            capacity.name = performance.name;
+            capacity.codec_id = performance.codec_id;
+            capacity.hw_type = performance.hw_type;
+            capacity.hardware = is_hardware;
+            capacity.pixels_per_second = performance.performance * width * height;
+            if (!is_hardware || capacity.hw_type == AV_HWDEVICE_TYPE_NONE) {
+                capacities.emplace_back(capacity);
+                return;
+            }
+            auto found = devices.find(capacity.hw_type);
+            if (found == devices.end())
+                found = devices.emplace(capacity.hw_type, FindDevices(capacity.hw_type)).first;
+            for (size_t i = 0; i < found->second.size(); i++) {
+                capacity.device_index = static_cast<int>(i);
+                capacity.device = found->second[i];
+                capacities.emplace_back(capacity);
+            }
+        };
+        for (const auto &performance : hardware)
+            add(performance, true);
+        for (const auto &performance : software)
+            add(performance, false);
+        return capacities;
+    }
+
+    int64_t JobScheduler::job_weight(const JobRequest &job, int encoder) const
+    {
+        const auto &capacity = capacities_[encoder];
+        if (capacity.pixels_per_second > 0.0) {
+            const double pixel_rate = static_cast<double>(job.width) * job.height * job.fps;
+            return static_cast<int64_t>(
+                std::ceil(pixel_rate / capacity.pixels_per_second * FULL_LOAD));
+        }
+        return capacity.max_sessions > 0 ? FULL_LOAD / capacity.max_sessions : FULL_LOAD;
+    }
+
+    bool JobScheduler::fits(const JobRequest &job, int encoder, int64_t &weight) const
+    {
+        const auto &capacity = capacities_[encoder];
+        if (capacity.codec_id != job.codec_id)
+            return false;
+        if (capacity.max_sessions > 0 &&
+            slots_[encoder].sessions.load(std::memory_order_relaxed) >= capacity.max_sessions)
+            return false;
+
+        weight = job_weight(job, encoder);
+        const auto &device = devices_[slots_[encoder].device];
+        return device.load.load(std::memory_order_relaxed) + weight <= FULL_LOAD;
+    }
+
+    int JobScheduler::choose(const JobRequest &job, bool hardware, int64_t &weight) const
+    {
+        // Worst fit: the device left with the most headroom wins, so load spreads over devices
+        // instead of piling onto the fastest one.
+        int best = -1;
+        int64_t best_load = FULL_LOAD + 1;
+        for (size_t i = 0; i < capacities_.size(); i++) {
+            int64_t candidate_weight = 0;
+            if (capacities_[i].hardware != hardware ||
+                !fits(job, static_cast<int>(i), candidate_weight))
+                continue;
+
+            const auto &device = devices_[slots_[i].device];
+            const int64_t load = device.load.load(std::memory_order_relaxed) + candidate_weight;
+            if (load < best_load) {
+                best = static_cast<int>(i);
+                best_load = load;
+                weight = candidate_weight;
+            }
+        }
+        return best;
+    }
+
+    bool JobScheduler::try_claim(int encoder, int64_t weight)
+    {
+        const auto &capacity = capacities_[encoder];
+        auto &slot = slots_[encoder];
+        auto &device = devices_[slot.device];
+
+        int64_t load = device.load.load(std::memory_order_relaxed);
+        do {
+            if (load + weight > FULL_LOAD)
+                return false;
+        } while (!device.load.compare_exchange_weak(load, load + weight));
+
+        if (slot.sessions.fetch_add(1) >= capacity.max_sessions && capacity.max_sessions > 0) {
+            slot.sessions.fetch_sub(1);
+            device.load.fetch_sub(weight);
+            return false;
+        }
+        return true;
+    }
+
+    bool JobScheduler::CanAdmit(const JobRequest &job) const
+    {
+        int64_t weight = 0;
+        for (size_t i = 0; i < capacities_.size(); i++) {
+            if (fits(job, static_cast<int>(i), weight))
+                return true;
+        }
+        return false;
+    }
+
+    bool JobScheduler::Reserve(const JobRequest &job, JobPlacement &placement)
+    {
+        for (const bool hardware : { true, false }) {
+            // Another thread may claim the chosen device first, pick again until nothing fits.
+            int64_t weight = 0;
+            int encoder = -1;
+            while ((encoder = choose(job, hardware, weight)) >= 0) {
+                if (!try_claim(encoder, weight))
+                    continue;
+
+                placement.ticket = next_ticket_.fetch_add(1);
+                placement.encoder = encoder;
+                placement.hardware = hardware;
+
+                std::lock_guard<std::mutex> lock(reservations_mutex_);
+                reservations_.emplace(placement.ticket, Reservation { encoder, weight });
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool JobScheduler::Release(int64_t ticket)
+    {
+        Reservation reservation;
+        {
+            std::lock_guard<std::mutex> lock(reservations_mutex_);
+            const auto found = reservations_.find(ticket);
+            if (found == reservations_.end())
+                return false;
+            reservation = found->second;
+            reservations_.erase(found);
+        }
+
+        auto &slot = slots_[reservation.encoder];
+        slot.sessions.fetch_sub(1);
+        devices_[slot.device].load.fetch_sub(reservation.weight);
+        return true;
+    }
+
+    double JobScheduler::DeviceLoad(int encoder) const
+    {
+        const auto &device = devices_[slots_[encoder].device];
+        return static_cast<double>(device.load.load(std::memory_order_relaxed)) / FULL_LOAD;
+    }
+
+    int JobScheduler::Sessions(int encoder) const
+    {
+        return slots_[encoder].sessions.load(std::memory_order_relaxed);
+    }
+
+} // namespace CODEC_INFO
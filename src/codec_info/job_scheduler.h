@@ -0,0 +1,103 @@
+#pragma once
+
+#include "codec_info.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace CODEC_INFO
+{
+    // Measured capacity of one encoder on one device.
+    struct EncoderCapacity {
+        std::string name;
+        AVCodecID codec_id = AV_CODEC_ID_NONE;
+        AVHWDeviceType hw_type = AV_HWDEVICE_TYPE_NONE;
+        int device_index = 0; // among devices of hw_type
+        std::string device;   // av_hwdevice_ctx_create device string, empty for the default
+        bool hardware = false; // software encoders only take jobs hardware can't fit
+        double pixels_per_second = 0.0; // 0 when only a session limit is known
+        int max_sessions = 0;           // 0 for no session limit
+    };
+
+    struct JobRequest {
+        AVCodecID codec_id;
+        int width;
+        int height;
+        double fps;
+    };
+
+    struct JobPlacement {
+        int64_t ticket = 0;
+        int encoder = -1; // index into JobScheduler::Capacities()
+        bool hardware = false;
+    };
+
+    // Places encode jobs on devices by weighted bin-packing. Each device is a bin of capacity 1;
+    // a job weighs its pixel rate over the chosen encoder's capacity, so encoders sharing a
+    // device share its budget. Hardware is tried first, software encoders take the spill.
+    class JobScheduler
+    {
+    public:
+        explicit JobScheduler(std::vector<EncoderCapacity> capacities);
+        ~JobScheduler();
+
+        // Capacities from DetectHwVideoEncoders and DetectSwVideoEncoders results measured at
+        // width x height. A hw encoder gets one capacity per device of its type (FindDevices);
+        // the benchmarks only ran on the default device, the others are taken to be alike.
+        static std::vector<EncoderCapacity>
+        MakeCapacities(const std::vector<CodecPerformance> &hardware,
+                       const std::vector<CodecPerformance> &software,
+                       int width,
+                       int height);
+
+        // device strings of every device of hw_type that opens, {""} (the default device) if
+        // the type can't be enumerated
+        static std::vector<std::string> FindDevices(AVHWDeviceType hw_type);
+
+        // Lock-free, reads only the current reservation counters.
+        bool CanAdmit(const JobRequest &job) const;
+
+        bool Reserve(const JobRequest &job, JobPlacement &placement);
+        bool Release(int64_t ticket);
+
+        const std::vector<EncoderCapacity> &Capacities() const { return capacities_; }
+        // fraction of the device's capacity reserved, 0 ... 1
+        double DeviceLoad(int encoder) const;
+        int Sessions(int encoder) const;
+
+    private:
+        static constexpr int64_t FULL_LOAD = 1000000;
+
+        struct Device {
+            std::atomic<int64_t> load { 0 };
+        };
+        struct Slot {
+            int device = 0;
+            std::atomic<int> sessions { 0 };
+        };
+        struct Reservation {
+            int encoder;
+            int64_t weight;
+        };
+
+        // encoders with the same key share a device bin
+        static std::string device_key(const EncoderCapacity &capacity);
+        int64_t job_weight(const JobRequest &job, int encoder) const;
+        bool fits(const JobRequest &job, int encoder, int64_t &weight) const;
+        int choose(const JobRequest &job, bool hardware, int64_t &weight) const;
+        bool try_claim(int encoder, int64_t weight);
+
+        std::vector<EncoderCapacity> capacities_;
+        std::unique_ptr<Slot[]> slots_;
+        std::unique_ptr<Device[]> devices_;
+
+        std::mutex reservations_mutex_;
+        std::unordered_map<int64_t, Reservation> reservations_;
+        std::atomic<int64_t> next_ticket_ { 1 };
+    };
+
+} // namespace CODEC_INFO
@@ -0,0 +1,211 @@
+#include "json_reader.h"
+#include <cstdlib>
+#include <cstring>
+
+namespace CODEC_INFO
+{
+    const JsonValue *JsonValue::Find(const std::string &key) const
+    {
+        for (const auto &member : object) {
+            if (member.first == key)
+                return &member.second;
+        }
+        return nullptr;
+    }
+
+    double JsonValue::Number(const std::string &key, double fallback) const
+    {
+        const JsonValue *value = Find(key);
+        return value && value->type == TYPE::NUMBER ? value->number : fallback;
+    }
+
+    std::string JsonValue::String(const std::string &key, const std::string &fallback) const
+    {
+        const JsonValue *value = Find(key);
+        return value && value->type == TYPE::STRING ? value->string : fallback;
+    }
+
+    class JsonParser
+    {
+    public:
+        explicit JsonParser(const std::string &text) : text_(text) {}
+
+        bool Parse(JsonValue &value)
+        {
+            if (!parse_value(value, 0))
+                return false;
+            skip_space();
+            return pos_ == text_.size();
+        }
+
+        size_t Position() const { return pos_; }
+
+    private:
+        void skip_space()
+        {
+            while (pos_ < text_.size() && std::strchr(" \t\r\n", text_[pos_]))
+                pos_++;
+        }
+
+        bool literal(const char *word)
+        {
+            const size_t length = std::strlen(word);
+            if (text_.compare(pos_, length, word) != 0)
+                return false;
+            pos_ += length;
+            return true;
+        }
+
+        bool parse_string(std::string &out)
+        {
+            if (text_[pos_] != '"')
+                return false;
+            pos_++;
+            while (pos_ < text_.size() && text_[pos_] != '"') {
+                char ch = text_[pos_++];
+                if (ch == '\\' && pos_ < text_.size()) {
+                    ch = text_[pos_++];
+                    switch (ch) {
+                    case 'n':
+                        ch = '\n';
+                        break;
+                    case 't':
+                        ch = '\t';
+                        break;
+                    case 'r':
+                        ch = '\r';
+                        break;
+                    case 'b':
+                        ch = '\b';
+                        break;
+                    case 'f':
+                        ch = '\f';
+                        break;
+                    case 'u': {
+                        // NOTE::only the control characters ReportWriter escapes, no surrogates.
+                        if (pos_ + 4 > text_.size())
+                            return false;
+                        const unsigned long code =
+                            std::strtoul(text_.substr(pos_, 4).c_str(), nullptr, 16);
+                        pos_ += 4;
+                        if (code < 0x80) {
+                            ch = static_cast<char>(code);
+                        }
+                        else {
+                            out += '?';
+                            continue;
+                        }
+                        break;
+                    }
+                    default:
+                        break;
+                    }
+                }
+                out += ch;
+            }
+            if (pos_ >= text_.size())
+                return false;
+            pos_++;
+            return true;
+        }
+
+        bool parse_value(JsonValue &value, int depth)
+        {
+            skip_space();
+            if (pos_ >= text_.size() || depth > 64)
+                return false;
+
+            const char ch = text_[pos_];
+            if (ch == '{') {
+                value.type = JsonValue::TYPE::OBJECT;
+                pos_++;
+                skip_space();
+                if (pos_ < text_.size() && text_[pos_] == '}') {
+                    pos_++;
+                    return true;
+                }
+                for (;;) {
+                    skip_space();
+                    std::pair<std::string, JsonValue> member;
+                    if (pos_ >= text_.size() || !parse_string(member.first))
+                        return false;
+                    skip_space();
+                    if (pos_ >= text_.size() || text_[pos_++] != ':')
+                        return false;
+                    if (!parse_value(member.second, depth + 1))
+                        return false;
+                    value.object.emplace_back(std::move(member));
+                    skip_space();
+                    if (pos_ >= text_.size())
+                        return false;
+                    if (text_[pos_] == '}') {
+                        pos_++;
+                        return true;
+                    }
+                    if (text_[pos_++] != ',')
+                        return false;
+                }
+            }
+            if (ch == '[') {
+                value.type = JsonValue::TYPE::ARRAY;
+                pos_++;
+                skip_space();
+                if (pos_ < text_.size() && text_[pos_] == ']') {
+                    pos_++;
+                    return true;
+                }
+                for (;;) {
+                    value.array.emplace_back();
+                    if (!parse_value(value.array.back(), depth + 1))
+                        return false;
+                    skip_space();
+                    if (pos_ >= text_.size())
+                        return false;
+                    if (text_[pos_] == ']') {
+                        pos_++;
+                        return true;
+                    }
+                    if (text_[pos_++] != ',')
+                        return false;
+                }
+            }
+            if (ch == '"') {
+                value.type = JsonValue::TYPE::STRING;
+                return parse_string(value.string);
+            }
+            if (literal("true") || literal("false")) {
+                value.type = JsonValue::TYPE::BOOL;
+                value.boolean = ch == 't';
+                return true;
+            }
+            if (literal("null")) {
+                value.type = JsonValue::TYPE::NONE;
+                return true;
+            }
+
+            const char *begin = text_.c_str() + pos_;
+            char *end = nullptr;
+            value.number = std::strtod(begin, &end);
+            if (end == begin)
+                return false;
+            value.type = JsonValue::TYPE::NUMBER;
+            pos_ += end - begin;
+            return true;
+        }
+
+        const std::string &text_;
+        size_t pos_ = 0;
+    };
+
+    bool ParseJson(const std::string &text, JsonValue &value, std::string *error)
+    {
+        value = JsonValue();
+        JsonParser parser(text);
+        if (parser.Parse(value))
+            return true;
+        if (error)
+            *error = "malformed JSON at offset " + std::to_string(parser.Position());
+        return false;
+    }
+
+} // namespace CODEC_INFO
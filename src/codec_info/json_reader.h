@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace CODEC_INFO
+{
+    // Just enough JSON to read back what ReportWriter wrote.
+    struct JsonValue {
+        enum class TYPE { NONE, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+
+        TYPE type = TYPE::NONE;
+        bool boolean = false;
+        double number = 0.0;
+        std::string string;
+        std::vector<JsonValue> array;
+        std::vector<std::pair<std::string, JsonValue>> object;
+
+        // member of an object, nullptr if missing
+        const JsonValue *Find(const std::string &key) const;
+        double Number(const std::string &key, double fallback = 0.0) const;
+        std::string String(const std::string &key, const std::string &fallback = "") const;
+    };
+
+    // false on malformed input, error names the offset
+    bool ParseJson(const std::string &text, JsonValue &value, std::string *error = nullptr);
+
+} // namespace CODEC_INFO
@@ -0,0 +1,290 @@
+#include "metrics_exporter.h"
+#include "encoders_info.h"
+#include "process_stats.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+#define METRICS_STRING(x) #x
+#define METRICS_VALUE(x) METRICS_STRING(x)
+#define TEST_RESOLUTION_LABEL METRICS_VALUE(TEST_WIDTH) "x" METRICS_VALUE(TEST_HEIGHT)
+#define TEST_REALTIME_LABEL TEST_RESOLUTION_LABEL "@" METRICS_VALUE(TEST_FRAMES)
+
+namespace CODEC_INFO
+{
+    static const char *const MEDIA_TYPE_LABELS[] = { "none", "sdr", "hdr" };
+
+    static std::string label_value(const std::string &value)
+    {
+        std::string escaped;
+        for (const char ch : value) {
+            if (ch == '\\' || ch == '"')
+                escaped += '\\';
+            if (ch == '\n')
+                escaped += "\\n";
+            else
+                escaped += ch;
+        }
+        return escaped;
+    }
+
+    static std::string hw_type_label(AVHWDeviceType hw_type)
+    {
+        const char *name = av_hwdevice_get_type_name(hw_type);
+        return name ? name : "none";
+    }
+
+    // nearest-rank percentile of sorted values
+    static double percentile(const std::vector<double> &sorted, double p)
+    {
+        if (sorted.empty())
+            return 0.0;
+        const size_t rank = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+        return sorted[std::min(rank, sorted.size() - 1)];
+    }
+
+    static void metric_header(std::ostream &out,
+                              const char *name,
+                              const char *type,
+                              const char *help)
+    {
+        out << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+    }
+
+    MetricsExporter::MetricsExporter(std::string path) : path_(std::move(path)) {}
+
+    MetricsExporter::~MetricsExporter() {}
+
+    void MetricsExporter::Update(const ProbeResults &results)
+    {
+        const int index = static_cast<int>(results.media_type);
+        results_[index] = results;
+        probed_[index] = true;
+        probes_total_[index]++;
+        failures_total_[index] += results.failures;
+    }
+
+    bool MetricsExporter::Write() const
+    {
+        std::ostringstream out;
+        out.precision(15);
+
+        // per-encoder series, the labels every encoder metric shares
+        const auto encoder_labels = [](const ProbeResults &results, const CodecPerformance &encoder)
+        {
+            return "encoder=\"" + label_value(encoder.name) + "\",codec=\"" +
+                   avcodec_get_name(encoder.codec_id) + "\",hw_type=\"" +
+                   hw_type_label(encoder.hw_type) + "\",media_type=\"" +
+                   MEDIA_TYPE_LABELS[static_cast<int>(results.media_type)] + "\"";
+        };
+        const auto find_benchmark = [](const ProbeResults &results, const std::string &name)
+        {
+            const auto it = std::find_if(results.benchmarks.begin(),
+                                         results.benchmarks.end(),
+                                         [&](const std::pair<std::string, EncoderTestResult> &item)
+                                         { return item.first == name; });
+            return it == results.benchmarks.end() ? nullptr : &it->second;
+        };
+
+        metric_header(out,
+                      "codec_info_encoder_fps",
+                      "gauge",
+                      "Benchmarked frames per second at " TEST_RESOLUTION_LABEL ".");
+        for (int m = 0; m < 3; m++) {
+            for (const auto &encoder : results_[m].encoders)
+                out << "codec_info_encoder_fps{" << encoder_labels(results_[m], encoder) << "} "
+                    << encoder.performance << "\n";
+        }
+
+        metric_header(out,
+                      "codec_info_encoder_pixels_per_second",
+                      "gauge",
+                      "Benchmarked pixel throughput.");
+        for (int m = 0; m < 3; m++) {
+            for (const auto &encoder : results_[m].encoders)
+                out << "codec_info_encoder_pixels_per_second{"
+                    << encoder_labels(results_[m], encoder) << "} "
+                    << encoder.performance * TEST_WIDTH * TEST_HEIGHT << "\n";
+        }
+
+        metric_header(out,
+                      "codec_info_encoder_realtime_sessions",
+                      "gauge",
+                      "Real-time " TEST_REALTIME_LABEL " sessions the benchmark throughput covers.");
+        for (int m = 0; m < 3; m++) {
+            for (const auto &encoder : results_[m].encoders)
+                out << "codec_info_encoder_realtime_sessions{"
+                    << encoder_labels(results_[m], encoder) << "} "
+                    << std::floor(encoder.performance / TEST_FRAMES) << "\n";
+        }
+
+        metric_header(out,
+                      "codec_info_encoder_frame_seconds",
+                      "summary",
+                      "Wall time per benchmarked frame.");
+        for (int m = 0; m < 3; m++) {
+            for (const auto &encoder : results_[m].encoders) {
+                const auto *result = find_benchmark(results_[m], encoder.name);
+                if (!result)
+                    continue;
+                std::vector<double> sorted = result->frame_seconds;
+                std::sort(sorted.begin(), sorted.end());
+                const auto labels = encoder_labels(results_[m], encoder);
+                for (const double q : { 0.5, 0.9, 0.99 })
+                    out << "codec_info_encoder_frame_seconds{" << labels << ",quantile=\"" << q
+                        << "\"} " << percentile(sorted, q) << "\n";
+                out << "codec_info_encoder_frame_seconds_sum{" << labels << "} "
+                    << result->seconds << "\n";
+                out << "codec_info_encoder_frame_seconds_count{" << labels << "} "
+                    << result->frames << "\n";
+            }
+        }
+
+        metric_header(out,
+                      "codec_info_encoder_cpu_seconds",
+                      "gauge",
+                      "Process CPU time of the benchmark run.");
+        for (int m = 0; m < 3; m++) {
+            for (const auto &encoder : results_[m].encoders) {
+                if (const auto *result = find_benchmark(results_[m], encoder.name))
+                    out << "codec_info_encoder_cpu_seconds{" << encoder_labels(results_[m], encoder)
+                        << "} " << result->cpu_seconds << "\n";
+            }
+        }
+
+        // with session memory models only
+        const int64_t available = GetAvailableMemoryBytes();
+        metric_header(out,
+                      "codec_info_encoder_session_memory_bytes",
+                      "gauge",
+                      "Resident memory one more open session adds.");
+        for (int m = 0; m < 3; m++) {
+            for (const auto &item : results_[m].memory_models) {
+                for (const auto &encoder : results_[m].encoders) {
+                    if (encoder.name == item.first)
+                        out << "codec_info_encoder_session_memory_bytes{"
+                            << encoder_labels(results_[m], encoder) << "} "
+                            << item.second.per_session_bytes << "\n";
+                }
+            }
+        }
+        metric_header(out,
+                      "codec_info_encoder_capacity_sessions",
+                      "gauge",
+                      "Real-time " TEST_REALTIME_LABEL
+                      " sessions that fit both throughput and available memory.");
+        for (int m = 0; m < 3; m++) {
+            for (const auto &item : results_[m].memory_models) {
+                for (const auto &encoder : results_[m].encoders) {
+                    if (encoder.name != item.first)
+                        continue;
+                    const auto capacity = EncodersInfo::EstimateCapacity(
+                        item.second, encoder.performance, TEST_FRAMES, available);
+                    out << "codec_info_encoder_capacity_sessions{"
+                        << encoder_labels(results_[m], encoder) << "} " << capacity.sessions
+                        << "\n";
+                }
+            }
+        }
+
+        // per-device series: encoders on one device share its throughput, the fastest one
+        // bounds it
+        metric_header(out,
+                      "codec_info_device_pixels_per_second",
+                      "gauge",
+                      "Pixel throughput of the device's fastest encoder.");
+        for (int m = 0; m < 3; m++) {
+            std::map<std::string, double> devices;
+            for (const auto &encoder : results_[m].encoders) {
+                auto &rate = devices[hw_type_label(encoder.hw_type)];
+                rate = std::max(rate, encoder.performance * TEST_WIDTH * TEST_HEIGHT);
+            }
+            for (const auto &device : devices)
+                out << "codec_info_device_pixels_per_second{hw_type=\"" << device.first
+                    << "\",media_type=\"" << MEDIA_TYPE_LABELS[m] << "\"} " << device.second
+                    << "\n";
+        }
+
+        const auto device_counts = [&](const char *name, const char *help, bool decoders)
+        {
+            metric_header(out, name, "gauge", help);
+            for (int m = 0; m < 3; m++) {
+                if (!probed_[m])
+                    continue;
+                std::map<std::string, int> devices;
+                for (const auto &item :
+                     decoders ? results_[m].device_decoders : results_[m].device_encoders)
+                    devices[hw_type_label(std::get<2>(item))]++;
+                for (const auto &device : devices)
+                    out << name << "{hw_type=\"" << device.first << "\",media_type=\""
+                        << MEDIA_TYPE_LABELS[m] << "\"} " << device.second << "\n";
+            }
+        };
+        device_counts("codec_info_device_encoders", "Encoders the device can open.", false);
+        device_counts("codec_info_device_decoders", "Decoders the device can open.", true);
+
+        // probe health
+        const auto probe_series = [&](const char *name,
+                                      const char *type,
+                                      const char *help,
+                                      const std::function<double(int)> &value)
+        {
+            metric_header(out, name, type, help);
+            for (int m = 0; m < 3; m++) {
+                if (probed_[m])
+                    out << name << "{media_type=\"" << MEDIA_TYPE_LABELS[m] << "\"} " << value(m)
+                        << "\n";
+            }
+        };
+        probe_series("codec_info_probe_duration_seconds",
+                     "gauge",
+                     "Wall time of the last probe.",
+                     [&](int m) { return results_[m].probe_seconds; });
+        probe_series("codec_info_probe_failures",
+                     "gauge",
+                     "Encoders on a present device that failed to encode in the last probe.",
+                     [&](int m) { return static_cast<double>(results_[m].failures); });
+        probe_series("codec_info_probe_timestamp_seconds",
+                     "gauge",
+                     "Unix time of the last probe.",
+                     [&](int m)
+                     {
+                         return std::chrono::duration<double>(
+                                    results_[m].probed_at.time_since_epoch())
+                             .count();
+                     });
+        probe_series("codec_info_probes_total",
+                     "counter",
+                     "Probes since start.",
+                     [&](int m) { return static_cast<double>(probes_total_[m]); });
+        probe_series("codec_info_probe_failures_total",
+                     "counter",
+                     "Failed encoder benchmarks on present devices since start.",
+                     [&](int m) { return static_cast<double>(failures_total_[m]); });
+        out << "# EOF\n";
+
+        const std::string temp_path = path_ + ".tmp";
+        {
+            std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+            file << out.str();
+            file.flush();
+            if (!file)
+                return false;
+        }
+#if defined(_WIN32)
+        return MoveFileExA(temp_path.c_str(), path_.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        return std::rename(temp_path.c_str(), path_.c_str()) == 0;
+#endif
+    }
+
+} // namespace CODEC_INFO
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "probe_cache.h"
+#include <cstdint>
+#include <string>
+
+namespace CODEC_INFO
+{
+    // Writes probe results as a Prometheus textfile for node_exporter's textfile collector.
+    // The file is written next to `path` and renamed over it, so a scrape never sees half of it.
+    // Not thread-safe, feed it from one thread (the daemon serializes its listeners).
+    class MetricsExporter
+    {
+    public:
+        explicit MetricsExporter(std::string path);
+        ~MetricsExporter();
+
+        // keep the latest results of their media type and count the probe
+        void Update(const ProbeResults &results);
+        // false if the file couldn't be written or renamed
+        bool Write() const;
+
+    private:
+        std::string path_;
+        ProbeResults results_[3];
+        bool probed_[3] = {};
+        uint64_t probes_total_[3] = {};
+        uint64_t failures_total_[3] = {};
+    };
+
+} // namespace CODEC_INFO
@@ -0,0 +1,180 @@
+#include "perf_counters.h"
+
+#if defined(__linux__)
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace CODEC_INFO
+{
+#if defined(__linux__)
+    struct PerfEvent {
+        uint32_t type;
+        uint64_t config;
+        int64_t PerfCounters::*value;
+    };
+
+    // the first one that opens leads the group
+    static const PerfEvent PERF_EVENTS[] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, &PerfCounters::cycles },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, &PerfCounters::instructions },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, &PerfCounters::llc_misses },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, &PerfCounters::branch_misses },
+        { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, &PerfCounters::context_switches },
+    };
+
+    static int perf_event_open(perf_event_attr *attr, int group_fd)
+    {
+        return static_cast<int>(syscall(SYS_perf_event_open, attr, 0, -1, group_fd, 0));
+    }
+
+    static std::string paranoid_level()
+    {
+        std::ifstream file("/proc/sys/kernel/perf_event_paranoid");
+        std::string level;
+        file >> level;
+        return level.empty() ? "?" : level;
+    }
+
+    PerfCounterGroup::PerfCounterGroup() {}
+
+    PerfCounterGroup::~PerfCounterGroup() { close_all(); }
+
+    bool PerfCounterGroup::Open()
+    {
+        const size_t events = sizeof(PERF_EVENTS) / sizeof(PERF_EVENTS[0]);
+        // paranoid 2 still allows user space counting of our own threads
+        for (const bool exclude_kernel : { false, true }) {
+            fds_.assign(events, -1);
+            leader_ = -1;
+            size_t opened = 0, skipped = 0;
+            int denied = 0;
+            int last_errno = 0;
+            for (size_t i = 0; i < events; i++) {
+                // switches happen in the kernel, user space only would always count 0
+                if (exclude_kernel && PERF_EVENTS[i].type == PERF_TYPE_SOFTWARE &&
+                    PERF_EVENTS[i].config == PERF_COUNT_SW_CONTEXT_SWITCHES) {
+                    skipped++;
+                    continue;
+                }
+                perf_event_attr attr;
+                std::memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = PERF_EVENTS[i].type;
+                attr.config = PERF_EVENTS[i].config;
+                attr.disabled = leader_ < 0;
+                attr.inherit = 1;
+                attr.exclude_kernel = exclude_kernel;
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                fds_[i] = perf_event_open(&attr, leader_);
+                if (fds_[i] < 0) {
+                    last_errno = errno;
+                    denied += errno == EACCES || errno == EPERM;
+                    continue;
+                }
+                if (leader_ < 0)
+                    leader_ = fds_[i];
+                opened++;
+            }
+            if (denied && !exclude_kernel) {
+                close_all();
+                continue;
+            }
+            if (opened) {
+                // e.g. a VM that passes through some of the PMU
+                if (opened + skipped < events)
+                    error_ = std::string("some counters unavailable: ") + std::strerror(last_errno);
+                if (exclude_kernel) {
+                    error_ += error_.empty() ? "" : "; ";
+                    error_ += "perf_event_paranoid=" + paranoid_level() +
+                              ": user space cycles and misses only, no context switches";
+                }
+                return true;
+            }
+            if (denied)
+                error_ = "perf_event_paranoid=" + paranoid_level() + " forbids perf_event_open";
+            else
+                error_ = std::string("perf_event_open: ") + std::strerror(last_errno);
+            return false;
+        }
+        return false;
+    }
+
+    void PerfCounterGroup::close_all()
+    {
+        for (int &fd : fds_) {
+            if (fd >= 0)
+                close(fd);
+            fd = -1;
+        }
+        leader_ = -1;
+    }
+
+    void PerfCounterGroup::Enable()
+    {
+        if (leader_ >= 0) {
+            ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+
+    void PerfCounterGroup::Disable()
+    {
+        if (leader_ >= 0)
+            ioctl(leader_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    void PerfCounterGroup::Read(PerfCounters &counters) const
+    {
+        counters = PerfCounters();
+        counters.error = error_;
+        if (leader_ < 0)
+            return;
+
+        for (size_t i = 0; i < fds_.size(); i++) {
+            // value, time enabled, time running; summed over the inherited threads
+            uint64_t data[3] = {};
+            if (fds_[i] < 0 || read(fds_[i], data, sizeof(data)) != sizeof(data))
+                continue;
+            double scale = 1.0;
+            if (data[2] > 0 && data[2] < data[1])
+                scale = static_cast<double>(data[1]) / data[2];
+            counters.*PERF_EVENTS[i].value = static_cast<int64_t>(data[0] * scale);
+            if (fds_[i] == leader_ && data[1] > 0)
+                counters.running = static_cast<double>(data[2]) / data[1];
+            counters.collected = true;
+        }
+        if (counters.cycles > 0 && counters.instructions >= 0)
+            counters.ipc = static_cast<double>(counters.instructions) / counters.cycles;
+    }
+#else
+    PerfCounterGroup::PerfCounterGroup() {}
+
+    PerfCounterGroup::~PerfCounterGroup() {}
+
+    bool PerfCounterGroup::Open()
+    {
+        error_ = "perf counters need Linux";
+        return false;
+    }
+
+    void PerfCounterGroup::close_all() {}
+
+    void PerfCounterGroup::Enable() {}
+
+    void PerfCounterGroup::Disable() {}
+
+    void PerfCounterGroup::Read(PerfCounters &counters) const
+    {
+        counters = PerfCounters();
+        counters.error = error_;
+    }
+#endif
+
+} // namespace CODEC_INFO
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "codec_info.h"
+#include <vector>
+
+namespace CODEC_INFO
+{
+    // perf_event_open counters of the calling thread and every thread it creates afterwards,
+    // so Open() must come before the encoder starts its worker threads.
+    // The events form one group so they are scheduled on the PMU together; they are still read
+    // one by one since the kernel can't read an inherited group at once.
+    // Linux only, elsewhere Open() fails and Read() reports why.
+    class PerfCounterGroup
+    {
+    public:
+        PerfCounterGroup();
+        ~PerfCounterGroup();
+
+        // false if no counter could be opened, e.g. perf_event_paranoid forbids it; where it only
+        // allows user space counting the counters leave the kernel out, context switches stay -1
+        // and Read() says so in the error
+        bool Open();
+        void Enable();
+        void Disable();
+        // scaled for multiplexing, counters that didn't open stay -1
+        void Read(PerfCounters &counters) const;
+
+    private:
+        void close_all();
+
+        std::vector<int> fds_; // one per event, -1 if it didn't open
+        int leader_ = -1;
+        std::string error_;
+    };
+
+} // namespace CODEC_INFO
@@ -0,0 +1,252 @@
+#include "probe_cache.h"
+#include "decoders_info.h"
+#include "encoders_info.h"
+#include <algorithm>
+
+namespace CODEC_INFO
+{
+    static std::vector<AVHWDeviceType> create_devices(const std::vector<AVHWDeviceType> &hw_types)
+    {
+        std::vector<AVHWDeviceType> created;
+        for (const auto hw_type : hw_types) {
+            AVBufferRef *hw_device_ctx = nullptr;
+            if (av_hwdevice_ctx_create(&hw_device_ctx, hw_type, nullptr, nullptr, 0) != 0)
+                continue;
+            av_buffer_unref(&hw_device_ctx);
+            created.push_back(hw_type);
+        }
+        return created;
+    }
+
+    // Every compiled-in hw encoder is benchmarked, most of them for hardware the host doesn't
+    // have. Only encoders whose device is there count as failed.
+    static int count_failures(const ProbeResults &results)
+    {
+        return static_cast<int>(std::count_if(
+            results.benchmarks.begin(),
+            results.benchmarks.end(),
+            [&](const std::pair<std::string, EncoderTestResult> &item)
+            {
+                const auto hw_type = EncodersInfo::GetEncoderDeviceType(item.first);
+                return item.second.frames == 0 && hw_type != AV_HWDEVICE_TYPE_NONE &&
+                       std::find(results.device_types.begin(),
+                                 results.device_types.end(),
+                                 hw_type) != results.device_types.end();
+            }));
+    }
+
+    static void measure_memory(EncodersInfo &encoders,
+                               ProbeResults &results,
+                               const std::vector<CodecPerformance> &benchmarked)
+    {
+        EncoderTestConfig config;
+        config.media_type = results.media_type;
+        for (const auto &encoder : benchmarked) {
+            if (encoder.performance > 0.0)
+                results.memory_models.emplace_back(
+                    encoder.name,
+                    encoders.MeasureSessionMemory(encoder.name, config, PROBE_MEMORY_SESSIONS));
+        }
+    }
+
+    std::shared_ptr<const ProbeResults>
+    RunProbe(MEDIA_TYPE media_type, bool benchmark, bool session_memory)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        auto results = std::make_shared<ProbeResults>();
+        results->media_type = media_type;
+        results->benchmarked = benchmark;
+
+        std::vector<AVHWDeviceType> hw_types;
+        AVHWDeviceType hw_type = AV_HWDEVICE_TYPE_NONE;
+        while ((hw_type = av_hwdevice_iterate_types(hw_type)) != AV_HWDEVICE_TYPE_NONE)
+            hw_types.push_back(hw_type);
+        results->device_types = create_devices(hw_types);
+
+        EncodersInfo encoders;
+        encoders.SetLogStream(nullptr);
+        results->device_encoders = encoders.GetDeviceHwEncoders(AVMediaType::AVMEDIA_TYPE_VIDEO);
+        if (benchmark) {
+            const auto benchmarked = encoders.DetectHwVideoEncoders(
+                media_type, AV_HWDEVICE_TYPE_NONE, &results->benchmarks);
+            for (const auto &encoder : benchmarked) {
+                const auto duplicate = std::find_if(
+                    results->encoders.begin(),
+                    results->encoders.end(),
+                    [&](const CodecPerformance &item) { return item.name == encoder.name; });
+                if (duplicate == results->encoders.end())
+                    results->encoders.emplace_back(encoder);
+            }
+            if (session_memory)
+                measure_memory(encoders, *results, results->encoders);
+            std::stable_sort(results->encoders.begin(),
+                             results->encoders.end(),
+                             [](const CodecPerformance &a, const CodecPerformance &b)
+                             { return a.performance > b.performance; });
+        }
+
+        DecodersInfo decoders;
+        results->device_decoders = decoders.GetDeviceHwDecoders(AVMediaType::AVMEDIA_TYPE_VIDEO);
+        results->failures = count_failures(*results);
+        results->probed_at = std::chrono::system_clock::now();
+        results->probe_seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return results;
+    }
+
+    std::shared_ptr<const ProbeResults> RunDeviceProbe(const ProbeResults &previous,
+                                                       const std::vector<AVHWDeviceType> &hw_types,
+                                                       bool session_memory)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        auto results = std::make_shared<ProbeResults>(previous);
+        const auto affected = [&](AVHWDeviceType hw_type)
+        { return std::find(hw_types.begin(), hw_types.end(), hw_type) != hw_types.end(); };
+        const auto remove_affected = [&](auto &list)
+        {
+            list.erase(std::remove_if(list.begin(),
+                                      list.end(),
+                                      [&](const auto &item) { return affected(std::get<2>(item)); }),
+                       list.end());
+        };
+        remove_affected(results->device_encoders);
+        remove_affected(results->device_decoders);
+        results->device_types.erase(std::remove_if(results->device_types.begin(),
+                                                   results->device_types.end(),
+                                                   affected),
+                                    results->device_types.end());
+        const auto created = create_devices(hw_types);
+        results->device_types.insert(results->device_types.end(), created.begin(), created.end());
+        results->encoders.erase(std::remove_if(results->encoders.begin(),
+                                               results->encoders.end(),
+                                               [&](const CodecPerformance &encoder)
+                                               { return affected(encoder.hw_type); }),
+                                results->encoders.end());
+        results->benchmarks.erase(
+            std::remove_if(results->benchmarks.begin(),
+                           results->benchmarks.end(),
+                           [&](const std::pair<std::string, EncoderTestResult> &item)
+                           { return affected(EncodersInfo::GetEncoderDeviceType(item.first)); }),
+            results->benchmarks.end());
+        // re-measured below for the devices that are still there
+        results->memory_models.erase(
+            std::remove_if(results->memory_models.begin(),
+                           results->memory_models.end(),
+                           [&](const std::pair<std::string, SessionMemoryModel> &item)
+                           { return affected(EncodersInfo::GetEncoderDeviceType(item.first)); }),
+            results->memory_models.end());
+
+        EncodersInfo encoders;
+        encoders.SetLogStream(nullptr);
+        DecodersInfo decoders;
+        for (const auto hw_type : hw_types) {
+            const auto device_encoders =
+                encoders.GetDeviceHwEncoders(AVMediaType::AVMEDIA_TYPE_VIDEO, hw_type);
+            results->device_encoders.insert(
+                results->device_encoders.end(), device_encoders.begin(), device_encoders.end());
+
+            const auto device_decoders =
+                decoders.GetDeviceHwDecoders(AVMediaType::AVMEDIA_TYPE_VIDEO, hw_type);
+            results->device_decoders.insert(
+                results->device_decoders.end(), device_decoders.begin(), device_decoders.end());
+
+            // Encoders the device can no longer open drop out of the ranking.
+            if (!results->benchmarked || device_encoders.empty())
+                continue;
+            const auto benchmarked =
+                encoders.DetectHwVideoEncoders(results->media_type, hw_type, &results->benchmarks);
+            for (const auto &encoder : benchmarked) {
+                const auto duplicate = std::find_if(
+                    results->encoders.begin(),
+                    results->encoders.end(),
+                    [&](const CodecPerformance &item) { return item.name == encoder.name; });
+                if (duplicate == results->encoders.end())
+                    results->encoders.emplace_back(encoder);
+            }
+            if (session_memory)
+                measure_memory(encoders, *results, benchmarked);
+        }
+
+        std::stable_sort(results->encoders.begin(),
+                         results->encoders.end(),
+                         [](const CodecPerformance &a, const CodecPerformance &b)
+                         { return a.performance > b.performance; });
+        results->failures = count_failures(*results);
+        results->probed_at = std::chrono::system_clock::now();
+        results->probe_seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return results;
+    }
+
+    ProbeCache::ProbeCache() {}
+
+    ProbeCache::~ProbeCache() {}
+
+    std::shared_ptr<const ProbeResults> ProbeCache::Get(MEDIA_TYPE media_type) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return results_[static_cast<int>(media_type)];
+    }
+
+    void ProbeCache::Store(std::shared_ptr<const ProbeResults> results)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        results_[static_cast<int>(results->media_type)] = std::move(results);
+    }
+
+    std::shared_ptr<const ProbeResults> ProbeCache::GetOrProbe(MEDIA_TYPE media_type,
+                                                               bool benchmark)
+    {
+        auto results = Get(media_type);
+        if (results && (results->benchmarked || !benchmark))
+            return results;
+
+        std::lock_guard<std::mutex> lock(probe_mutex_);
+        // Someone else may have finished the same probe while we waited.
+        results = Get(media_type);
+        if (results && (results->benchmarked || !benchmark))
+            return results;
+
+        results = RunProbe(media_type, benchmark, session_memory_);
+        Store(results);
+        return results;
+    }
+
+    std::shared_ptr<const ProbeResults> ProbeCache::Probe(MEDIA_TYPE media_type, bool benchmark)
+    {
+        std::lock_guard<std::mutex> lock(probe_mutex_);
+        auto results = RunProbe(media_type, benchmark, session_memory_);
+        Store(results);
+        return results;
+    }
+
+    std::vector<std::shared_ptr<const ProbeResults>>
+    ProbeCache::UpdateDevices(const std::vector<AVHWDeviceType> &hw_types)
+    {
+        std::vector<std::shared_ptr<const ProbeResults>> updated;
+        std::lock_guard<std::mutex> lock(probe_mutex_);
+        for (const auto media_type : { MEDIA_TYPE::NONE, MEDIA_TYPE::SDR, MEDIA_TYPE::HDR }) {
+            const auto previous = Get(media_type);
+            if (!previous)
+                continue;
+            auto results = RunDeviceProbe(*previous, hw_types, session_memory_);
+            Store(results);
+            updated.emplace_back(std::move(results));
+        }
+        return updated;
+    }
+
+    void ProbeCache::SetSessionMemory(bool measure)
+    {
+        std::lock_guard<std::mutex> lock(probe_mutex_);
+        session_memory_ = measure;
+    }
+
+    void ProbeCache::Clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto &results : results_)
+            results.reset();
+    }
+
+} // namespace CODEC_INFO
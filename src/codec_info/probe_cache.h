@@ -0,0 +1,76 @@
+#pragma once
+
+#include "codec_info.h"
+#include "encoder_bench.h"
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace CODEC_INFO
+{
+    // One probe of the machine. Immutable once published, readers share it by pointer.
+    struct ProbeResults {
+        MEDIA_TYPE media_type = MEDIA_TYPE::NONE;
+        bool benchmarked = false;
+        // benchmarked hardware encoders, best first
+        std::vector<CodecPerformance> encoders;
+        // benchmark details by encoder name, failed ones included
+        std::vector<std::pair<std::string, EncoderTestResult>> benchmarks;
+        // device types a context could be created for
+        std::vector<AVHWDeviceType> device_types;
+        // encoders on one of device_types that were benchmarked but couldn't encode
+        int failures = 0;
+        // per-session memory of the benchmarked encoders, with ProbeCache::SetSessionMemory
+        std::vector<std::pair<std::string, SessionMemoryModel>> memory_models;
+        double probe_seconds = 0.0;
+        std::vector<std::tuple<std::string, AVCodecID, AVHWDeviceType>> device_encoders;
+        std::vector<std::tuple<std::string, AVCodecID, AVHWDeviceType>> device_decoders;
+        std::chrono::system_clock::time_point probed_at;
+    };
+
+    // Sessions MeasureSessionMemory opens per encoder during a probe.
+    constexpr int PROBE_MEMORY_SESSIONS = 4;
+
+    // Enumerate device encoders and decoders, and benchmark the hardware encoders if asked,
+    // session_memory also models their memory per session.
+    std::shared_ptr<const ProbeResults>
+    RunProbe(MEDIA_TYPE media_type, bool benchmark, bool session_memory = false);
+
+    // Copy of `previous` with only the hw_types' encoders, decoders and benchmarks re-probed,
+    // session_memory as in RunProbe.
+    std::shared_ptr<const ProbeResults> RunDeviceProbe(const ProbeResults &previous,
+                                                       const std::vector<AVHWDeviceType> &hw_types,
+                                                       bool session_memory = false);
+
+    // Latest probe results per media type.
+    class ProbeCache
+    {
+    public:
+        ProbeCache();
+        ~ProbeCache();
+
+        // nullptr until the media type has been probed
+        std::shared_ptr<const ProbeResults> Get(MEDIA_TYPE media_type) const;
+        void Store(std::shared_ptr<const ProbeResults> results);
+        // cached results if they are benchmarked or no benchmark is needed, a fresh probe otherwise
+        std::shared_ptr<const ProbeResults> GetOrProbe(MEDIA_TYPE media_type, bool benchmark);
+        // full probe, stored once done while readers keep the previous results
+        std::shared_ptr<const ProbeResults> Probe(MEDIA_TYPE media_type, bool benchmark);
+        // re-probe the given device types in every cached media type and swap the results in
+        std::vector<std::shared_ptr<const ProbeResults>>
+        UpdateDevices(const std::vector<AVHWDeviceType> &hw_types);
+        void Clear();
+        // model every benchmarked encoder's memory per session in the following probes
+        void SetSessionMemory(bool measure);
+
+    private:
+        mutable std::mutex mutex_;
+        std::mutex probe_mutex_; // one probe at a time, devices don't like concurrent sessions
+        bool session_memory_ = false; // guarded by probe_mutex_
+        std::shared_ptr<const ProbeResults> results_[3];
+    };
+
+} // namespace CODEC_INFO
@@ -0,0 +1,155 @@
+#include "probe_client.h"
+#include <cstring>
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace CODEC_INFO
+{
+    ProbeClient::ProbeClient()
+        : buffer_(sizeof(ProbeResponseHeader) + PROBE_MAX_ENTRIES * sizeof(ProbeEntry))
+    {
+    }
+
+    ProbeClient::~ProbeClient() { Close(); }
+
+#if defined(__linux__)
+    bool ProbeClient::Connect(const std::string &socket_path)
+    {
+        Close();
+
+        sockaddr_un addr {};
+        addr.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof(addr.sun_path))
+            return false;
+        std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+        fd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (fd_ < 0)
+            return false;
+        if (connect(fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void ProbeClient::Close()
+    {
+        if (fd_ >= 0)
+            close(fd_);
+        fd_ = -1;
+    }
+
+    PROBE_STATUS ProbeClient::Query(PROBE_OP op,
+                                    MEDIA_TYPE media_type,
+                                    std::vector<ProbeEntry> &entries,
+                                    uint32_t max_entries)
+    {
+        ProbeRequest request { PROBE_PROTOCOL_MAGIC,
+                               PROBE_PROTOCOL_VERSION,
+                               static_cast<uint16_t>(op),
+                               static_cast<uint32_t>(media_type),
+                               max_entries };
+        return exchange(&request, sizeof(request), entries);
+    }
+
+    PROBE_STATUS ProbeClient::ReportSession(MEDIA_TYPE media_type,
+                                            const std::string &name,
+                                            int64_t frames,
+                                            int64_t nanoseconds,
+                                            int queue_depth)
+    {
+        char message[sizeof(ProbeRequest) + sizeof(ProbeSessionReport)];
+        ProbeRequest request { PROBE_PROTOCOL_MAGIC,
+                               PROBE_PROTOCOL_VERSION,
+                               static_cast<uint16_t>(PROBE_OP::REPORT_SESSION),
+                               static_cast<uint32_t>(media_type),
+                               0 };
+        ProbeSessionReport report {};
+        std::strncpy(report.name, name.c_str(), sizeof(report.name) - 1);
+        report.frames = frames;
+        report.nanoseconds = nanoseconds;
+        report.queue_depth = queue_depth;
+        std::memcpy(message, &request, sizeof(request));
+        std::memcpy(message + sizeof(request), &report, sizeof(report));
+
+        std::vector<ProbeEntry> entries;
+        return exchange(message, sizeof(message), entries);
+    }
+
+    PROBE_STATUS
+    ProbeClient::exchange(const void *message, size_t length, std::vector<ProbeEntry> &entries)
+    {
+        entries.clear();
+        if (fd_ < 0)
+            return PROBE_STATUS::BAD_REQUEST;
+
+        if (send(fd_, message, length, MSG_NOSIGNAL) != static_cast<ssize_t>(length)) {
+            Close();
+            return PROBE_STATUS::BAD_REQUEST;
+        }
+
+        const ssize_t size = recv(fd_, buffer_.data(), buffer_.size(), 0);
+        if (size < static_cast<ssize_t>(sizeof(ProbeResponseHeader))) {
+            Close();
+            return PROBE_STATUS::BAD_REQUEST;
+        }
+
+        ProbeResponseHeader header;
+        std::memcpy(&header, buffer_.data(), sizeof(header));
+        if (header.magic != PROBE_PROTOCOL_MAGIC || header.version != PROBE_PROTOCOL_VERSION ||
+            sizeof(header) + header.count * sizeof(ProbeEntry) > static_cast<size_t>(size))
+            return PROBE_STATUS::BAD_REQUEST;
+
+        generation_ = header.generation;
+        entries.resize(header.count);
+        std::memcpy(entries.data(),
+                    buffer_.data() + sizeof(header),
+                    header.count * sizeof(ProbeEntry));
+        return static_cast<PROBE_STATUS>(header.status);
+    }
+#else
+    // NOTE::The daemon speaks AF_UNIX SOCK_SEQPACKET, which only Linux provides.
+    bool ProbeClient::Connect(const std::string &) { return false; }
+
+    void ProbeClient::Close() { fd_ = -1; }
+
+    PROBE_STATUS ProbeClient::Query(PROBE_OP, MEDIA_TYPE, std::vector<ProbeEntry> &entries,
+                                    uint32_t)
+    {
+        entries.clear();
+        return PROBE_STATUS::BAD_REQUEST;
+    }
+
+    PROBE_STATUS ProbeClient::ReportSession(MEDIA_TYPE, const std::string &, int64_t, int64_t, int)
+    {
+        return PROBE_STATUS::BAD_REQUEST;
+    }
+
+    PROBE_STATUS ProbeClient::exchange(const void *, size_t, std::vector<ProbeEntry> &entries)
+    {
+        entries.clear();
+        return PROBE_STATUS::BAD_REQUEST;
+    }
+#endif
+
+    bool ProbeClient::FindBestHwVideoEncoder(CODEC_INFO::MEDIA_TYPE media_type,
+                                             CODEC_INFO::CodecPerformance &find_codec_info)
+    {
+        std::vector<ProbeEntry> entries;
+        if (Query(PROBE_OP::BEST_ENCODER, media_type, entries, 1) != PROBE_STATUS::OK ||
+            entries.empty())
+            return false;
+
+        find_codec_info.name = entries[0].name;
+        find_codec_info.codec_id = static_cast<AVCodecID>(entries[0].codec_id);
+        find_codec_info.hw_type = static_cast<AVHWDeviceType>(entries[0].hw_type);
+        find_codec_info.performance = entries[0].performance;
+        return true;
+    }
+
+} // namespace CODEC_INFO
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "codec_info.h"
+#include "probe_protocol.h"
+#include <string>
+#include <vector>
+
+namespace CODEC_INFO
+{
+    // Client of the ffmpeg_tools probe daemon. One connection, one thread at a time.
+    class ProbeClient
+    {
+    public:
+        ProbeClient();
+        ~ProbeClient();
+
+        bool Connect(const std::string &socket_path = PROBE_DEFAULT_SOCKET);
+        void Close();
+        bool IsConnected() const { return fd_ >= 0; }
+
+        PROBE_STATUS Query(PROBE_OP op,
+                           MEDIA_TYPE media_type,
+                           std::vector<ProbeEntry> &entries,
+                           uint32_t max_entries = PROBE_MAX_ENTRIES);
+
+        bool FindBestHwVideoEncoder(CODEC_INFO::MEDIA_TYPE media_type,
+                                    CODEC_INFO::CodecPerformance &find_codec_info);
+
+        // feed a running session's throughput into LIVE_RANKED_ENCODERS, NOT_FOUND if the
+        // daemon didn't benchmark `name`
+        PROBE_STATUS ReportSession(MEDIA_TYPE media_type,
+                                   const std::string &name,
+                                   int64_t frames,
+                                   int64_t nanoseconds,
+                                   int queue_depth);
+
+        // generation of the last answer, changes whenever the daemon re-probed
+        uint32_t Generation() const { return generation_; }
+
+    private:
+        PROBE_STATUS exchange(const void *message, size_t length, std::vector<ProbeEntry> &entries);
+
+        int fd_ = -1;
+        uint32_t generation_ = 0;
+        std::vector<char> buffer_;
+    };
+
+} // namespace CODEC_INFO
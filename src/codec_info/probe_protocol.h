@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+
+// Wire format between the ffmpeg_tools probe daemon and ProbeClient. One request and one
+// response per SOCK_SEQPACKET message, host byte order since both ends share the machine.
+namespace CODEC_INFO
+{
+    constexpr uint32_t PROBE_PROTOCOL_MAGIC = 0x46465450; // "PTFF"
+    constexpr uint16_t PROBE_PROTOCOL_VERSION = 1;
+    constexpr uint32_t PROBE_MAX_ENTRIES = 128;
+    constexpr const char *PROBE_DEFAULT_SOCKET = "/tmp/ffmpeg_tools.sock";
+
+    enum class PROBE_OP : uint16_t {
+        RANKED_ENCODERS = 1, // benchmarked hardware encoders, best first
+        BEST_ENCODER = 2,
+        DEVICE_ENCODERS = 3,
+        DEVICE_DECODERS = 4,
+        REPORT_SESSION = 5,       // a ProbeSessionReport follows the request, answers no entries
+        LIVE_RANKED_ENCODERS = 6, // RANKED_ENCODERS re-ranked by the reported session load
+    };
+
+    enum class PROBE_STATUS : int16_t {
+        OK = 0,
+        PENDING = 1, // first probe of this media type still running, retry later
+        BAD_REQUEST = -1,
+        NOT_FOUND = -2,
+    };
+
+#pragma pack(push, 1)
+    struct ProbeRequest {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t op;         // PROBE_OP
+        uint32_t media_type; // MEDIA_TYPE
+        uint32_t max_entries;
+    };
+
+    struct ProbeResponseHeader {
+        uint32_t magic;
+        uint16_t version;
+        int16_t status;       // PROBE_STATUS
+        uint32_t count;       // ProbeEntry records following the header
+        uint32_t generation;  // bumped on every re-probe
+        int64_t probed_at_ms; // unix time of the probe the answer comes from
+    };
+
+    struct ProbeEntry {
+        char name[48];
+        int32_t codec_id; // AVCodecID
+        int32_t hw_type;  // AVHWDeviceType
+        double performance;
+    };
+
+    struct ProbeSessionReport {
+        char name[48];
+        int64_t frames;      // encoded since the last report
+        int64_t nanoseconds; // encoder time spent on them
+        int32_t queue_depth; // frames waiting for the session
+        int32_t reserved;
+    };
+#pragma pack(pop)
+
+    static_assert(sizeof(ProbeRequest) == 16, "ProbeRequest layout");
+    static_assert(sizeof(ProbeResponseHeader) == 24, "ProbeResponseHeader layout");
+    static_assert(sizeof(ProbeEntry) == 64, "ProbeEntry layout");
+    static_assert(sizeof(ProbeSessionReport) == 72, "ProbeSessionReport layout");
+
+} // namespace CODEC_INFO
@@ -0,0 +1,244 @@
+#include "process_stats.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <cstdlib>
+#include <dirent.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace CODEC_INFO
+{
+    ThreadUsage &ThreadUsage::operator+=(const ThreadUsage &other)
+    {
+        user_seconds += other.user_seconds;
+        system_seconds += other.system_seconds;
+        minor_faults += other.minor_faults;
+        major_faults += other.major_faults;
+        return *this;
+    }
+
+    ThreadUsage ThreadUsage::operator-(const ThreadUsage &other) const
+    {
+        ThreadUsage usage;
+        usage.user_seconds = user_seconds - other.user_seconds;
+        usage.system_seconds = system_seconds - other.system_seconds;
+        usage.minor_faults = minor_faults - other.minor_faults;
+        usage.major_faults = major_faults - other.major_faults;
+        return usage;
+    }
+
+#if defined(_WIN32)
+    int64_t GetResidentBytes()
+    {
+        PROCESS_MEMORY_COUNTERS counters;
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+            return 0;
+        return static_cast<int64_t>(counters.WorkingSetSize);
+    }
+
+    int64_t GetPeakResidentBytes()
+    {
+        PROCESS_MEMORY_COUNTERS counters;
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+            return 0;
+        return static_cast<int64_t>(counters.PeakWorkingSetSize);
+    }
+
+    // NOTE::Windows can't reset the peak working set, callers compare against a baseline instead.
+    void ResetPeakResidentBytes() {}
+
+    void ReleaseFreeHeap() {}
+
+    ThreadUsage GetCurrentThreadUsage()
+    {
+        ThreadUsage usage;
+        FILETIME creation, exit, kernel, user;
+        if (GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+            // 100 ns units
+            usage.user_seconds =
+                ((static_cast<uint64_t>(user.dwHighDateTime) << 32) | user.dwLowDateTime) / 1e7;
+            usage.system_seconds =
+                ((static_cast<uint64_t>(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime) /
+                1e7;
+        }
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+            usage.minor_faults = counters.PageFaultCount;
+        return usage;
+    }
+
+    std::map<int, ThreadUsage> GetThreadUsage() { return {}; }
+
+    int64_t GetAvailableMemoryBytes()
+    {
+        MEMORYSTATUSEX status;
+        status.dwLength = sizeof(status);
+        if (!GlobalMemoryStatusEx(&status))
+            return 0;
+        return static_cast<int64_t>(status.ullAvailPhys);
+    }
+
+    int64_t GetDeviceMemoryBytes() { return -1; }
+#else
+    static int64_t read_status_kb(const char *key)
+    {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        const std::string prefix = std::string(key) + ":";
+        while (std::getline(status, line)) {
+            if (line.compare(0, prefix.size(), prefix) == 0)
+                return std::stoll(line.substr(prefix.size()));
+        }
+        return 0;
+    }
+
+    int64_t GetResidentBytes() { return read_status_kb("VmRSS") * 1024; }
+
+    int64_t GetPeakResidentBytes() { return read_status_kb("VmHWM") * 1024; }
+
+    void ResetPeakResidentBytes()
+    {
+        // Writing 5 to clear_refs resets VmHWM to the current RSS (Linux >= 4.0).
+        std::ofstream clear_refs("/proc/self/clear_refs");
+        clear_refs << "5";
+    }
+
+    void ReleaseFreeHeap()
+    {
+#if defined(__GLIBC__)
+        malloc_trim(0);
+#endif
+    }
+
+    int64_t GetAvailableMemoryBytes()
+    {
+        std::ifstream meminfo("/proc/meminfo");
+        std::string line;
+        while (std::getline(meminfo, line)) {
+            if (line.compare(0, 13, "MemAvailable:") == 0)
+                return std::stoll(line.substr(13)) * 1024;
+        }
+        return 0;
+    }
+
+    int64_t GetDeviceMemoryBytes()
+    {
+        DIR *fds = opendir("/proc/self/fdinfo");
+        if (!fds)
+            return -1;
+
+        // one client per drm-client-id, dup'ed fds of the same client report it twice
+        std::map<std::string, int64_t> clients;
+        while (const dirent *entry = readdir(fds)) {
+            if (entry->d_name[0] < '0' || entry->d_name[0] > '9')
+                continue;
+            std::ifstream file(std::string("/proc/self/fdinfo/") + entry->d_name);
+            std::string line, client;
+            int64_t resident = 0, memory = 0;
+            while (std::getline(file, line)) {
+                const size_t colon = line.find(':');
+                if (colon == std::string::npos)
+                    continue;
+                const std::string key = line.substr(0, colon);
+                if (key == "drm-client-id") {
+                    client = line.substr(colon + 1);
+                    continue;
+                }
+                // "drm-resident-<region>: 1234 KiB", older kernels only have drm-memory-<region>
+                const bool is_resident = key.compare(0, 13, "drm-resident-") == 0;
+                if (!is_resident && key.compare(0, 11, "drm-memory-") != 0)
+                    continue;
+                std::istringstream value(line.substr(colon + 1));
+                int64_t amount = 0;
+                std::string unit;
+                value >> amount >> unit;
+                if (unit == "KiB")
+                    amount *= 1024;
+                else if (unit == "MiB")
+                    amount *= 1024 * 1024;
+                else if (unit == "GiB")
+                    amount *= 1024LL * 1024 * 1024;
+                (is_resident ? resident : memory) += amount;
+            }
+            if (!client.empty())
+                clients[client] = resident ? resident : memory;
+        }
+        closedir(fds);
+
+        if (clients.empty())
+            return -1;
+        int64_t total = 0;
+        for (const auto &client : clients)
+            total += client.second;
+        return total;
+    }
+
+    ThreadUsage GetCurrentThreadUsage()
+    {
+        ThreadUsage usage;
+        rusage self {};
+#if defined(RUSAGE_THREAD)
+        if (getrusage(RUSAGE_THREAD, &self) != 0)
+            return usage;
+#else
+        if (getrusage(RUSAGE_SELF, &self) != 0)
+            return usage;
+#endif
+        usage.user_seconds = self.ru_utime.tv_sec + self.ru_utime.tv_usec / 1e6;
+        usage.system_seconds = self.ru_stime.tv_sec + self.ru_stime.tv_usec / 1e6;
+        usage.minor_faults = self.ru_minflt;
+        usage.major_faults = self.ru_majflt;
+        return usage;
+    }
+
+    std::map<int, ThreadUsage> GetThreadUsage()
+    {
+        std::map<int, ThreadUsage> threads;
+        DIR *tasks = opendir("/proc/self/task");
+        if (!tasks)
+            return threads;
+
+        const double ticks = static_cast<double>(sysconf(_SC_CLK_TCK));
+        while (const dirent *entry = readdir(tasks)) {
+            if (entry->d_name[0] < '0' || entry->d_name[0] > '9')
+                continue;
+            std::ifstream file(std::string("/proc/self/task/") + entry->d_name + "/stat");
+            std::string stat;
+            if (!std::getline(file, stat))
+                continue; // exited meanwhile
+            // the name in parentheses may contain spaces, fields count from after it
+            const size_t name_end = stat.rfind(')');
+            if (name_end == std::string::npos)
+                continue;
+            std::istringstream fields(stat.substr(name_end + 2));
+            std::string skip;
+            int64_t minflt = 0, majflt = 0, utime = 0, stime = 0;
+            // state ppid pgrp session tty_nr tpgid flags minflt cminflt majflt cmajflt utime stime
+            for (int i = 0; i < 7; i++)
+                fields >> skip;
+            fields >> minflt >> skip >> majflt >> skip >> utime >> stime;
+            if (!fields)
+                continue;
+
+            ThreadUsage &usage = threads[std::atoi(entry->d_name)];
+            usage.user_seconds = utime / ticks;
+            usage.system_seconds = stime / ticks;
+            usage.minor_faults = minflt;
+            usage.major_faults = majflt;
+        }
+        closedir(tasks);
+        return threads;
+    }
+#endif
+
+} // namespace CODEC_INFO
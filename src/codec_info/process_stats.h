@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+
+namespace CODEC_INFO
+{
+    // Current resident set size of this process in bytes, 0 if the platform doesn't expose it.
+    int64_t GetResidentBytes();
+
+    // Peak resident set size since the last ResetPeakResidentBytes().
+    int64_t GetPeakResidentBytes();
+    void ResetPeakResidentBytes();
+
+    // Hand the allocator's free heap back to the system, so the RSS growth that follows is new
+    // allocations rather than reused pages. glibc only, a no-op elsewhere.
+    void ReleaseFreeHeap();
+
+    // Memory the system can still hand out without swapping (MemAvailable), 0 if unknown.
+    int64_t GetAvailableMemoryBytes();
+
+    // Device memory this process holds, summed over its DRM clients (fdinfo, Linux >= 5.19
+    // for i915 / amdgpu), so VAAPI and QSV sessions show up. -1 if no driver reports any.
+    int64_t GetDeviceMemoryBytes();
+
+    // CPU time and page faults, of one thread or summed over several.
+    struct ThreadUsage {
+        double user_seconds = 0.0;
+        double system_seconds = 0.0;
+        int64_t minor_faults = 0;
+        int64_t major_faults = 0;
+
+        ThreadUsage &operator+=(const ThreadUsage &other);
+        ThreadUsage operator-(const ThreadUsage &other) const;
+    };
+
+    // Calling thread from getrusage(RUSAGE_THREAD) on Linux, the whole process elsewhere.
+    ThreadUsage GetCurrentThreadUsage();
+
+    // Every thread of this process by thread id from /proc/self/task, in clock ticks
+    // resolution. Empty where the platform has no per-thread accounting.
+    std::map<int, ThreadUsage> GetThreadUsage();
+
+} // namespace CODEC_INFO
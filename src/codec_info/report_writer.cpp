@@ -0,0 +1,575 @@
+#include "report_writer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/utsname.h>
+#include <unistd.h>
+#endif
+
+namespace CODEC_INFO
+{
+    // CSV columns, every record type fills the ones it has.
+    static const char *const REPORT_COLUMNS[] = {
+        "schema_version", "type",         "fingerprint",  "name",         "codec",
+        "codec_id",       "hw_type",      "media_type",   "width",        "height",
+        "frames",         "gop_size",     "thread_count", "thread_type",  "seconds",
+        "fps",            "frame_ms_p50", "frame_ms_p90", "frame_ms_p99", "frame_ms_max",
+        "cpu_seconds",    "rss_bytes",    "psnr_y",       "run",          "repetitions",
+        "cycles",         "instructions", "ipc",          "llc_misses",   "branch_misses",
+        "context_switches", "counters_error", "user_seconds", "system_seconds", "minor_faults",
+        "major_faults",   "encoder_threads", "rss_delta_bytes", "peak_rss_delta_bytes",
+        "cpu_ms_per_frame", "package_joules", "dram_joules", "joules_per_frame",
+        "max_b_frames",   "first_packet_frames", "delay_frames", "reorder_depth",
+        "variant",        "best",         "active_thread_type", "speedup", "efficiency",
+        "fps_per_thread", "async_depth",  "target_fps",   "streams",      "threads_per_stream",
+        "aggregate_fps",  "min_stream_fps", "realtime_margin", "sustained", "deadline_misses",
+        "miss_rate",      "max_lateness_ms", "jitter_ms", "frame_type",   "count",
+        "frame_ms_mean",  "mean_bytes",   "max_bytes",    "segments",     "segment_frames",
+        "overlap_frames", "workers",      "bytes",        "boundary_psnr_y", "peak_memory_bytes",
+        "sessions",       "session_limit", "base_bytes",  "per_session_bytes",
+        "device_per_session_bytes", "fit_r2", "memory_budget_bytes", "capacity_by_fps",
+        "capacity_by_memory", "capacity", "memory_bound", "rank", "candidates", "rounds",
+        "eliminated",     "aborted",      "race_seconds", "exhaustive_seconds", "test_frames",
+        "forced_thread_type", "flush_ms", "latency_budget_ms",
+    };
+    static const size_t REPORT_COLUMN_COUNT = sizeof(REPORT_COLUMNS) / sizeof(REPORT_COLUMNS[0]);
+
+    // CSV column of a key, built once
+    static const std::unordered_map<std::string, size_t> &report_column_index()
+    {
+        static const std::unordered_map<std::string, size_t> index = []()
+        {
+            std::unordered_map<std::string, size_t> columns;
+            for (size_t i = 0; i < REPORT_COLUMN_COUNT; i++)
+                columns.emplace(REPORT_COLUMNS[i], i);
+            return columns;
+        }();
+        return index;
+    }
+
+    static const char *media_type_name(MEDIA_TYPE media_type)
+    {
+        switch (media_type) {
+        case MEDIA_TYPE::SDR:
+            return "sdr";
+        case MEDIA_TYPE::HDR:
+            return "hdr";
+        default:
+            return "none";
+        }
+    }
+
+    static std::string hw_type_name(AVHWDeviceType hw_type)
+    {
+        const char *name = av_hwdevice_get_type_name(hw_type);
+        return name ? name : "none";
+    }
+
+    // nearest-rank percentile of sorted values
+    static double percentile(const std::vector<double> &sorted, double p)
+    {
+        if (sorted.empty())
+            return 0.0;
+        const size_t rank = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+        return sorted[std::min(rank, sorted.size() - 1)];
+    }
+
+    EnvironmentInfo GetEnvironmentInfo()
+    {
+        EnvironmentInfo environment;
+        environment.cores = static_cast<int>(std::thread::hardware_concurrency());
+        environment.ffmpeg = av_version_info();
+        environment.avcodec_version = avcodec_version();
+
+#if defined(_WIN32)
+        char host[MAX_COMPUTERNAME_LENGTH + 1] = {};
+        DWORD size = sizeof(host);
+        if (GetComputerNameA(host, &size))
+            environment.host = host;
+        environment.os = "Windows";
+        if (const char *cpu = std::getenv("PROCESSOR_IDENTIFIER"))
+            environment.cpu = cpu;
+#else
+        char host[256] = {};
+        if (gethostname(host, sizeof(host) - 1) == 0)
+            environment.host = host;
+        utsname name {};
+        if (uname(&name) == 0)
+            environment.os = std::string(name.sysname) + " " + name.release + " " + name.machine;
+        std::ifstream cpuinfo("/proc/cpuinfo");
+        std::string line;
+        while (std::getline(cpuinfo, line)) {
+            if (line.compare(0, 10, "model name") == 0) {
+                environment.cpu = line.substr(line.find(':') + 2);
+                break;
+            }
+        }
+#endif
+
+        // FNV-1a over everything above
+        const std::string key = environment.host + "|" + environment.os + "|" + environment.cpu +
+                                "|" + std::to_string(environment.cores) + "|" +
+                                environment.ffmpeg + "|" +
+                                std::to_string(environment.avcodec_version);
+        uint64_t hash = 14695981039346656037ull;
+        for (const unsigned char ch : key) {
+            hash ^= ch;
+            hash *= 1099511628211ull;
+        }
+        char hex[17];
+        std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+        environment.fingerprint = hex;
+        return environment;
+    }
+
+    ReportWriter::ReportWriter(std::ostream &out, REPORT_FORMAT format)
+        : out_(out), format_(format), columns_(REPORT_COLUMN_COUNT)
+    {
+    }
+
+    ReportWriter::~ReportWriter() { End(); }
+
+    void ReportWriter::Begin(const EnvironmentInfo &environment)
+    {
+        environment_ = environment;
+        open_ = true;
+        first_record_ = true;
+
+        if (format_ == REPORT_FORMAT::CSV) {
+            for (size_t i = 0; i < REPORT_COLUMN_COUNT; i++)
+                out_ << (i ? "," : "") << REPORT_COLUMNS[i];
+            out_ << '\n';
+            return;
+        }
+
+        begin_record("environment");
+        if (format_ == REPORT_FORMAT::JSON)
+            field("fingerprint", environment.fingerprint);
+        field("host", environment.host);
+        field("os", environment.os);
+        field("cpu", environment.cpu);
+        field("cores", static_cast<int64_t>(environment.cores));
+        field("ffmpeg", environment.ffmpeg);
+        field("avcodec_version", static_cast<int64_t>(environment.avcodec_version));
+        if (!run_id_.empty())
+            field("timestamp",
+                  static_cast<int64_t>(std::chrono::duration_cast<std::chrono::seconds>(
+                                           std::chrono::system_clock::now().time_since_epoch())
+                                           .count()));
+        if (format_ == REPORT_FORMAT::JSON) {
+            // the environment goes into the header, without the record type
+            line_.erase(1, line_.find(','));
+            out_ << "{\"schema_version\":" << REPORT_SCHEMA_VERSION
+                 << ",\"environment\":" << line_ << "},\"records\":[";
+            line_.clear();
+            return;
+        }
+        end_record();
+    }
+
+    void ReportWriter::WriteBenchmark(const BenchmarkRecord &record)
+    {
+        std::vector<double> sorted = record.result.frame_seconds;
+        std::sort(sorted.begin(), sorted.end());
+
+        begin_record("benchmark");
+        field("name", record.encoder.name);
+        field("codec", std::string(avcodec_get_name(record.encoder.codec_id)));
+        field("codec_id", static_cast<int64_t>(record.encoder.codec_id));
+        field("hw_type", hw_type_name(record.encoder.hw_type));
+        field("media_type", std::string(media_type_name(record.config.media_type)));
+        field("width", static_cast<int64_t>(record.config.width));
+        field("height", static_cast<int64_t>(record.config.height));
+        field("frames", static_cast<int64_t>(record.result.frames));
+        field("test_frames", static_cast<int64_t>(record.config.frames));
+        field("async_depth", static_cast<int64_t>(record.config.async_depth));
+        if (record.config.pace_fps > 0.0)
+            field("target_fps", record.config.pace_fps);
+        field("gop_size", static_cast<int64_t>(record.config.gop_size));
+        field("max_b_frames", static_cast<int64_t>(record.config.max_b_frames));
+        field("thread_count", static_cast<int64_t>(record.result.thread_count));
+        field("thread_type", static_cast<int64_t>(record.result.thread_type));
+        // the threading mode the run asked for, e.g. by the thread scaling sweep
+        if (record.config.thread_type)
+            field("forced_thread_type", static_cast<int64_t>(record.config.thread_type));
+        field("seconds", record.result.seconds);
+        field("fps", record.result.performance);
+        field("frame_ms_p50", 1000.0 * percentile(sorted, 50));
+        field("frame_ms_p90", 1000.0 * percentile(sorted, 90));
+        field("frame_ms_p99", 1000.0 * percentile(sorted, 99));
+        field("frame_ms_max", 1000.0 * (sorted.empty() ? 0.0 : sorted.back()));
+        field("flush_ms", 1000.0 * record.result.flush_seconds);
+        field("cpu_seconds", record.result.cpu_seconds);
+        field("rss_bytes", record.result.rss_bytes);
+        field("user_seconds", record.result.user_seconds);
+        field("system_seconds", record.result.system_seconds);
+        field("minor_faults", record.result.minor_faults);
+        field("major_faults", record.result.major_faults);
+        field("encoder_threads", static_cast<int64_t>(record.result.encoder_threads));
+        field("rss_delta_bytes", record.result.rss_delta_bytes);
+        field("peak_rss_delta_bytes", record.result.peak_rss_delta_bytes);
+        field("cpu_ms_per_frame",
+              record.result.frames ? 1000.0 * record.result.cpu_seconds / record.result.frames
+                                   : 0.0);
+        field("psnr_y", record.result.psnr_y);
+        field("first_packet_frames", static_cast<int64_t>(record.result.first_packet_frames));
+        field("delay_frames", record.result.delay_frames);
+        field("reorder_depth", static_cast<int64_t>(record.result.reorder_depth));
+        field("repetitions",
+              static_cast<int64_t>(std::max<size_t>(1, record.fps_samples.size())));
+        if (record.result.joules_per_frame >= 0.0) {
+            field("package_joules", record.result.package_joules);
+            field("dram_joules", record.result.dram_joules);
+            field("joules_per_frame", record.result.joules_per_frame);
+        }
+        const PerfCounters &counters = record.result.counters;
+        if (counters.collected) {
+            // counters the CPU doesn't have are left out rather than written as -1
+            const std::pair<const char *, int64_t> values[] = {
+                { "cycles", counters.cycles },
+                { "instructions", counters.instructions },
+                { "llc_misses", counters.llc_misses },
+                { "branch_misses", counters.branch_misses },
+                { "context_switches", counters.context_switches },
+            };
+            for (const auto &value : values) {
+                if (value.second >= 0)
+                    field(value.first, value.second);
+            }
+            if (counters.ipc > 0.0)
+                field("ipc", counters.ipc);
+        }
+        if (!counters.error.empty())
+            field("counters_error", counters.error);
+        if (!record.fps_samples.empty() && format_ != REPORT_FORMAT::CSV) {
+            std::string samples = "[";
+            char text[32];
+            for (const double fps : record.fps_samples) {
+                std::snprintf(text, sizeof(text), "%s%.3f", samples.size() > 1 ? "," : "", fps);
+                samples += text;
+            }
+            put("fps_samples", samples + "]");
+        }
+        if (include_samples_ && format_ != REPORT_FORMAT::CSV) {
+            std::string samples = "[";
+            char text[32];
+            for (const double seconds : record.result.frame_seconds) {
+                std::snprintf(text,
+                              sizeof(text),
+                              "%s%.4f",
+                              samples.size() > 1 ? "," : "",
+                              1000.0 * seconds);
+                samples += text;
+            }
+            put("frame_ms", samples + "]");
+        }
+        end_record();
+    }
+
+    void ReportWriter::WriteDevice(const char *type,
+                                   const std::string &name,
+                                   AVCodecID codec_id,
+                                   AVHWDeviceType hw_type)
+    {
+        begin_record(type);
+        field("name", name);
+        field("codec", std::string(avcodec_get_name(codec_id)));
+        field("codec_id", static_cast<int64_t>(codec_id));
+        field("hw_type", hw_type_name(hw_type));
+        end_record();
+    }
+
+    void ReportWriter::WriteThreadScaling(const std::string &name,
+                                          const EncoderTestConfig &config,
+                                          const ThreadScalingPoint &point)
+    {
+        begin_point("thread_scaling", name, config);
+        field("thread_count", static_cast<int64_t>(point.thread_count));
+        field("thread_type", static_cast<int64_t>(point.thread_type));
+        field("active_thread_type", static_cast<int64_t>(point.active_thread_type));
+        field("fps", point.performance);
+        field("speedup", point.speedup);
+        field("efficiency", point.efficiency);
+        field("fps_per_thread", point.per_thread);
+        end_record();
+    }
+
+    void ReportWriter::WriteAsyncDepth(const std::string &name,
+                                       const EncoderTestConfig &config,
+                                       const AsyncDepthPoint &point,
+                                       bool best)
+    {
+        begin_point("async_depth", name, config);
+        field("async_depth", static_cast<int64_t>(point.async_depth));
+        field("fps", point.performance);
+        field("speedup", point.speedup);
+        flag("best", best);
+        end_record();
+    }
+
+    void ReportWriter::WriteStreamPacking(const std::string &name,
+                                          const EncoderTestConfig &config,
+                                          double target_fps,
+                                          const StreamPackingPoint &point,
+                                          bool best)
+    {
+        begin_point("stream_packing", name, config);
+        field("target_fps", target_fps);
+        field("streams", static_cast<int64_t>(point.streams));
+        field("threads_per_stream", static_cast<int64_t>(point.threads_per_stream));
+        field("aggregate_fps", point.aggregate_performance);
+        field("min_stream_fps", point.min_stream_performance);
+        field("realtime_margin", point.realtime_margin);
+        flag("sustained", point.sustainable);
+        flag("best", best);
+        end_record();
+    }
+
+    void ReportWriter::WriteRealtime(const std::string &name,
+                                     const EncoderTestConfig &config,
+                                     const char *variant,
+                                     const RealtimePoint &point)
+    {
+        begin_point("realtime", name, config);
+        field("variant", std::string(variant));
+        field("async_depth", static_cast<int64_t>(config.async_depth));
+        field("target_fps", point.target_fps);
+        field("frames", static_cast<int64_t>(point.frames));
+        field("deadline_misses", static_cast<int64_t>(point.deadline_misses));
+        field("miss_rate", point.miss_rate);
+        field("latency_budget_ms", 1000.0 * point.latency_budget);
+        field("max_lateness_ms", 1000.0 * point.max_lateness);
+        field("jitter_ms", 1000.0 * point.jitter);
+        flag("sustained", point.sustained);
+        end_record();
+    }
+
+    void ReportWriter::WriteFrameType(const std::string &name,
+                                      const EncoderTestConfig &config,
+                                      const FrameTypeStats &stats)
+    {
+        begin_point("frame_type", name, config);
+        field("gop_size", static_cast<int64_t>(config.gop_size));
+        field("max_b_frames", static_cast<int64_t>(config.max_b_frames));
+        field("frame_type", stats.type);
+        field("count", static_cast<int64_t>(stats.count));
+        field("frame_ms_mean", stats.mean_ms);
+        field("frame_ms_p99", stats.p99_ms);
+        field("frame_ms_max", stats.max_ms);
+        field("mean_bytes", stats.mean_bytes);
+        field("max_bytes", static_cast<int64_t>(stats.max_bytes));
+        end_record();
+    }
+
+    void ReportWriter::WriteSegment(const std::string &name,
+                                    const SegmentEncodeConfig &config,
+                                    const char *variant,
+                                    const SegmentEncodeResult &result,
+                                    double psnr_y,
+                                    double boundary_psnr_y)
+    {
+        begin_point("segment", name, config.encoder);
+        field("variant", std::string(variant));
+        field("frames", static_cast<int64_t>(config.total_frames));
+        field("segment_frames", static_cast<int64_t>(config.segment_frames));
+        field("overlap_frames", static_cast<int64_t>(config.overlap_frames));
+        field("workers", static_cast<int64_t>(config.workers));
+        field("thread_count", static_cast<int64_t>(config.encoder.thread_count));
+        field("segments", static_cast<int64_t>(result.segments));
+        field("seconds", result.seconds);
+        field("fps", result.performance);
+        field("bytes", static_cast<int64_t>(result.bitstream.size()));
+        if (psnr_y >= 0.0)
+            field("psnr_y", psnr_y);
+        if (boundary_psnr_y >= 0.0)
+            field("boundary_psnr_y", boundary_psnr_y);
+        field("peak_memory_bytes", result.peak_memory_bytes);
+        end_record();
+    }
+
+    void ReportWriter::WriteSessionMemory(const std::string &name,
+                                          const EncoderTestConfig &config,
+                                          double fps,
+                                          double target_fps,
+                                          int64_t memory_budget,
+                                          const SessionMemoryModel &model,
+                                          const SessionCapacity &capacity)
+    {
+        begin_point("session_memory", name, config);
+        field("fps", fps);
+        field("target_fps", target_fps);
+        field("memory_budget_bytes", memory_budget);
+        field("sessions", static_cast<int64_t>(model.sessions));
+        flag("session_limit", model.session_limit);
+        field("base_bytes", model.base_bytes);
+        field("per_session_bytes", model.per_session_bytes);
+        if (model.device_per_session_bytes >= 0.0)
+            field("device_per_session_bytes", model.device_per_session_bytes);
+        field("fit_r2", model.fit_r2);
+        field("capacity_by_fps", static_cast<int64_t>(capacity.by_throughput));
+        field("capacity_by_memory", static_cast<int64_t>(capacity.by_memory));
+        field("capacity", static_cast<int64_t>(capacity.sessions));
+        flag("memory_bound", capacity.memory_bound);
+        end_record();
+    }
+
+    void ReportWriter::WriteRace(const CodecPerformance &encoder,
+                                 const char *variant,
+                                 int rank,
+                                 double seconds,
+                                 const RaceStats &stats)
+    {
+        begin_record("race");
+        field("variant", std::string(variant));
+        field("name", encoder.name);
+        field("codec", std::string(avcodec_get_name(encoder.codec_id)));
+        field("codec_id", static_cast<int64_t>(encoder.codec_id));
+        field("hw_type", hw_type_name(encoder.hw_type));
+        field("rank", static_cast<int64_t>(rank));
+        field("fps", encoder.performance);
+        field("race_seconds", seconds);
+        if (std::strcmp(variant, "race") == 0) {
+            field("candidates", static_cast<int64_t>(stats.candidates));
+            field("rounds", static_cast<int64_t>(stats.rounds));
+            field("eliminated", static_cast<int64_t>(stats.eliminated));
+            field("aborted", static_cast<int64_t>(stats.aborted));
+            field("frames", static_cast<int64_t>(stats.frames));
+            field("exhaustive_seconds", stats.exhaustive_seconds);
+        }
+        end_record();
+    }
+
+    void ReportWriter::End()
+    {
+        if (!open_)
+            return;
+        open_ = false;
+        if (format_ == REPORT_FORMAT::JSON)
+            out_ << "]}\n";
+        out_.flush();
+    }
+
+    void ReportWriter::begin_record(const char *type)
+    {
+        line_.clear();
+        for (auto &column : columns_)
+            column.clear();
+        field("type", std::string(type));
+        if (format_ != REPORT_FORMAT::JSON) {
+            field("schema_version", static_cast<int64_t>(REPORT_SCHEMA_VERSION));
+            field("fingerprint", environment_.fingerprint);
+        }
+        if (!run_id_.empty())
+            field("run", run_id_);
+    }
+
+    void ReportWriter::begin_point(const char *type,
+                                   const std::string &name,
+                                   const EncoderTestConfig &config)
+    {
+        begin_record(type);
+        field("name", name);
+        field("media_type", std::string(media_type_name(config.media_type)));
+        field("width", static_cast<int64_t>(config.width));
+        field("height", static_cast<int64_t>(config.height));
+    }
+
+    void ReportWriter::field(const char *key, const std::string &value)
+    {
+        std::string text;
+        if (format_ == REPORT_FORMAT::CSV) {
+            if (value.find_first_of(",\"\r\n") == std::string::npos)
+                return put(key, value);
+            text = "\"";
+            for (const char ch : value) {
+                if (ch == '"')
+                    text += '"';
+                text += ch;
+            }
+            text += "\"";
+            return put(key, text);
+        }
+
+        text = "\"";
+        for (const char ch : value) {
+            if (ch == '"' || ch == '\\') {
+                text += '\\';
+                text += ch;
+            }
+            else if (static_cast<unsigned char>(ch) < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", ch);
+                text += escaped;
+            }
+            else {
+                text += ch;
+            }
+        }
+        text += "\"";
+        put(key, text);
+    }
+
+    void ReportWriter::field(const char *key, double value)
+    {
+        if (!std::isfinite(value))
+            return put(key, format_ == REPORT_FORMAT::CSV ? "" : "null");
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.6g", value);
+        put(key, text);
+    }
+
+    void ReportWriter::field(const char *key, int64_t value) { put(key, std::to_string(value)); }
+
+    void ReportWriter::flag(const char *key, bool value) { put(key, value ? "true" : "false"); }
+
+    void ReportWriter::put(const char *key, const std::string &text)
+    {
+        if (format_ == REPORT_FORMAT::CSV) {
+            const auto &index = report_column_index();
+            const auto column = index.find(key);
+            if (column != index.end())
+                columns_[column->second] = text;
+            return;
+        }
+
+        line_ += line_.empty() ? "{\"" : ",\"";
+        line_ += key;
+        line_ += "\":";
+        line_ += text;
+    }
+
+    void ReportWriter::end_record()
+    {
+        if (format_ == REPORT_FORMAT::CSV) {
+            for (size_t i = 0; i < REPORT_COLUMN_COUNT; i++) {
+                if (i)
+                    out_ << ',';
+                out_ << columns_[i];
+            }
+            out_ << '\n';
+            return;
+        }
+
+        line_ += '}';
+        if (format_ == REPORT_FORMAT::JSON) {
+            out_ << (first_record_ ? "" : ",") << line_;
+            first_record_ = false;
+        }
+        else {
+            out_ << line_ << '\n';
+        }
+    }
+
+} // namespace CODEC_INFO
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "codec_info.h"
+#include "encoder_bench.h"
+#include "segment_encoder.h"
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Bumped whenever a field is renamed or removed, new fields keep the version.
+#define REPORT_SCHEMA_VERSION 1
+
+namespace CODEC_INFO
+{
+    enum class REPORT_FORMAT { TEXT, JSON, CSV, NDJSON };
+
+    // Where the numbers came from, fingerprint is a hash of all other fields.
+    struct EnvironmentInfo {
+        std::string host;
+        std::string os;
+        std::string cpu;
+        int cores = 0;
+        std::string ffmpeg;
+        unsigned avcodec_version = 0;
+        std::string fingerprint;
+    };
+
+    EnvironmentInfo GetEnvironmentInfo();
+
+    struct BenchmarkRecord {
+        CodecPerformance encoder;
+        EncoderTestConfig config;
+        EncoderTestResult result;
+        // fps of every repetition when the test was repeated, result is the median one
+        std::vector<double> fps_samples;
+    };
+
+    // Streams records as they come, nothing is buffered beyond the current line.
+    //   json:   {"schema_version":1,"environment":{...},"records":[{...},...]}
+    //   ndjson: an environment line, then one line per record
+    //   csv:    a header, then one row per record with the environment fingerprint
+    // Records are benchmarks, encoder / decoder devices or the points of the sweep modes, told
+    // apart by "type".
+    class ReportWriter
+    {
+    public:
+        ReportWriter(std::ostream &out, REPORT_FORMAT format);
+        // closes the JSON document if End() wasn't called
+        ~ReportWriter();
+
+        // tag every record with the run, e.g. for the history store, call before Begin()
+        void SetRun(const std::string &run_id) { run_id_ = run_id; }
+        // add the raw per-frame times to benchmark records (not in CSV)
+        void SetIncludeSamples(bool include) { include_samples_ = include; }
+
+        void Begin(const EnvironmentInfo &environment);
+        void WriteBenchmark(const BenchmarkRecord &record);
+        // type is "encoder" or "decoder"
+        void WriteDevice(const char *type,
+                         const std::string &name,
+                         AVCodecID codec_id,
+                         AVHWDeviceType hw_type);
+
+        // sweep points, tagged with the encoder and the configuration they ran at
+        void WriteThreadScaling(const std::string &name,
+                                const EncoderTestConfig &config,
+                                const ThreadScalingPoint &point);
+        void WriteAsyncDepth(const std::string &name,
+                             const EncoderTestConfig &config,
+                             const AsyncDepthPoint &point,
+                             bool best);
+        void WriteStreamPacking(const std::string &name,
+                                const EncoderTestConfig &config,
+                                double target_fps,
+                                const StreamPackingPoint &point,
+                                bool best);
+        // variant is "target" for the requested rate, "bisect" for the search
+        void WriteRealtime(const std::string &name,
+                           const EncoderTestConfig &config,
+                           const char *variant,
+                           const RealtimePoint &point);
+        void WriteFrameType(const std::string &name,
+                            const EncoderTestConfig &config,
+                            const FrameTypeStats &stats);
+        // variant is "single" or "parallel", psnr -1 where the encoder reports none
+        void WriteSegment(const std::string &name,
+                          const SegmentEncodeConfig &config,
+                          const char *variant,
+                          const SegmentEncodeResult &result,
+                          double psnr_y,
+                          double boundary_psnr_y);
+        void WriteSessionMemory(const std::string &name,
+                                const EncoderTestConfig &config,
+                                double fps,
+                                double target_fps,
+                                int64_t memory_budget,
+                                const SessionMemoryModel &model,
+                                const SessionCapacity &capacity);
+        // variant is "race", or "exhaustive" for the full benchmarks of --race_verify
+        void WriteRace(const CodecPerformance &encoder,
+                       const char *variant,
+                       int rank,
+                       double seconds,
+                       const RaceStats &stats);
+        void End();
+
+    private:
+        void begin_record(const char *type);
+        void begin_point(const char *type, const std::string &name, const EncoderTestConfig &config);
+        void field(const char *key, const std::string &value);
+        void field(const char *key, double value);
+        void field(const char *key, int64_t value);
+        void flag(const char *key, bool value);
+        void put(const char *key, const std::string &text);
+        void end_record();
+
+        std::ostream &out_;
+        REPORT_FORMAT format_;
+        EnvironmentInfo environment_;
+        std::string run_id_;
+        bool include_samples_ = false;
+        bool open_ = false;
+        bool first_record_ = true;
+        std::string line_;                // JSON object of the current record
+        std::vector<std::string> columns_; // CSV cells of the current record
+    };
+
+} // namespace CODEC_INFO
@@ -0,0 +1,276 @@
+#include "result_diff.h"
+#include "encoder_bench.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+// Larger samples, or any ties, use the normal approximation.
+#define EXACT_U_MAX_SAMPLES 20
+
+namespace CODEC_INFO
+{
+    std::string BenchmarkCell(const JsonValue &benchmark)
+    {
+        std::string cell =
+            benchmark.String("name") + " " + benchmark.String("media_type") + " " +
+            std::to_string(static_cast<int>(benchmark.Number("width"))) + "x" +
+            std::to_string(static_cast<int>(benchmark.Number("height"))) + " threads:" +
+            std::to_string(static_cast<int>(benchmark.Number("thread_count"))) +
+            " gop:" + std::to_string(static_cast<int>(benchmark.Number("gop_size")));
+        // older results have no B-frames field, their cells stay the same
+        const int b_frames = static_cast<int>(benchmark.Number("max_b_frames"));
+        if (b_frames > 0)
+            cell += " bframes:" + std::to_string(b_frames);
+        // so are those of the default frame count, threading, depth and unpaced runs
+        const int frames = static_cast<int>(benchmark.Number("test_frames"));
+        if (frames > 0 && frames != TEST_FRAMES)
+            cell += " frames:" + std::to_string(frames);
+        const int thread_type = static_cast<int>(benchmark.Number("forced_thread_type"));
+        if (thread_type > 0)
+            cell += " thread_type:" + std::to_string(thread_type);
+        const int depth = static_cast<int>(benchmark.Number("async_depth"));
+        if (depth > 1)
+            cell += " depth:" + std::to_string(depth);
+        const double pace_fps = benchmark.Number("target_fps");
+        if (pace_fps > 0.0) {
+            char text[32];
+            std::snprintf(text, sizeof(text), " paced:%g", pace_fps);
+            cell += text;
+        }
+        return cell;
+    }
+
+    static double median(std::vector<double> values)
+    {
+        if (values.empty())
+            return 0.0;
+        const size_t middle = values.size() / 2;
+        std::nth_element(values.begin(), values.begin() + middle, values.end());
+        if (values.size() % 2)
+            return values[middle];
+        const double upper = values[middle];
+        return (*std::max_element(values.begin(), values.begin() + middle) + upper) / 2.0;
+    }
+
+    bool LoadResultFile(const std::string &path, std::vector<ResultCell> &cells, std::string *error)
+    {
+        std::ifstream file(path);
+        if (!file) {
+            if (error)
+                *error = "can't open " + path;
+            return false;
+        }
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        const std::string text = buffer.str();
+
+        // a JSON document, otherwise one record per line
+        std::vector<JsonValue> records;
+        std::string fingerprint;
+        JsonValue document;
+        if (ParseJson(text, document) && document.Find("records")) {
+            if (const JsonValue *environment = document.Find("environment"))
+                fingerprint = environment->String("fingerprint");
+            records = document.Find("records")->array;
+        }
+        else {
+            std::istringstream lines(text);
+            std::string line;
+            int line_number = 0;
+            while (std::getline(lines, line)) {
+                line_number++;
+                if (line.find_first_not_of(" \t\r") == std::string::npos)
+                    continue;
+                JsonValue value;
+                std::string parse_error;
+                if (!ParseJson(line, value, &parse_error)) {
+                    if (error)
+                        *error = path + ":" + std::to_string(line_number) + ": " + parse_error;
+                    return false;
+                }
+                records.emplace_back(std::move(value));
+            }
+        }
+
+        // a cell seen several times, e.g. in a history file, pools its repetitions
+        std::map<std::string, size_t> index;
+        std::map<std::string, std::vector<double>> frame_fps;
+        for (const auto &record : records) {
+            if (record.String("type") != "benchmark")
+                continue;
+            const auto cell = BenchmarkCell(record);
+            auto found = index.find(cell);
+            if (found == index.end()) {
+                found = index.emplace(cell, cells.size()).first;
+                cells.emplace_back();
+                cells.back().cell = cell;
+            }
+            ResultCell &result = cells[found->second];
+            result.fingerprint = record.String("fingerprint", fingerprint);
+            result.fps = record.Number("fps");
+
+            const JsonValue *samples = record.Find("fps_samples");
+            if (samples && !samples->array.empty()) {
+                for (const auto &sample : samples->array)
+                    result.samples.push_back(sample.number);
+            }
+            else {
+                result.samples.push_back(result.fps);
+            }
+            if (const JsonValue *frame_ms = record.Find("frame_ms")) {
+                for (const auto &sample : frame_ms->array) {
+                    if (sample.number > 0.0)
+                        frame_fps[cell].push_back(1000.0 / sample.number);
+                }
+            }
+        }
+
+        // NOTE:: a single repetition can still be tested on its frame times, they are
+        // autocorrelated though, so such p-values are optimistic and only count on request
+        for (auto &result : cells) {
+            if (result.samples.size() >= 2)
+                continue;
+            auto &frames = frame_fps[result.cell];
+            if (frames.size() < 2)
+                continue;
+            result.samples = std::move(frames);
+            result.per_frame = true;
+        }
+        return true;
+    }
+
+    // two-sided p-value of the Mann-Whitney U test
+    static double mann_whitney(const std::vector<double> &a,
+                               const std::vector<double> &b,
+                               bool &exact)
+    {
+        const size_t n1 = a.size(), n2 = b.size(), n = n1 + n2;
+        std::vector<std::pair<double, int>> values;
+        for (const double value : a)
+            values.emplace_back(value, 0);
+        for (const double value : b)
+            values.emplace_back(value, 1);
+        std::sort(values.begin(), values.end());
+
+        // average ranks over ties
+        double rank_sum = 0.0, tie_term = 0.0;
+        for (size_t i = 0; i < n;) {
+            size_t j = i;
+            while (j < n && values[j].first == values[i].first)
+                j++;
+            const double rank = (i + j + 1) / 2.0;
+            for (size_t k = i; k < j; k++) {
+                if (values[k].second == 0)
+                    rank_sum += rank;
+            }
+            const double ties = static_cast<double>(j - i);
+            tie_term += ties * ties * ties - ties;
+            i = j;
+        }
+        const double u1 = rank_sum - n1 * (n1 + 1) / 2.0;
+        const double u = std::min(u1, n1 * n2 - u1);
+
+        exact = tie_term == 0.0 && n1 <= EXACT_U_MAX_SAMPLES && n2 <= EXACT_U_MAX_SAMPLES;
+        if (exact) {
+            // counts[i][j][k]: orderings of i a's and j b's with U == k,
+            // built from whether the largest value is an a or a b
+            const size_t max_u = n1 * n2;
+            std::vector<std::vector<std::vector<double>>> counts(
+                n1 + 1, std::vector<std::vector<double>>(n2 + 1));
+            for (size_t i = 0; i <= n1; i++) {
+                for (size_t j = 0; j <= n2; j++) {
+                    auto &count = counts[i][j];
+                    count.assign(i * j + 1, 0.0);
+                    if (i == 0 || j == 0) {
+                        count[0] = 1.0;
+                        continue;
+                    }
+                    for (size_t k = 0; k <= i * j; k++) {
+                        if (k >= j && k - j < counts[i - 1][j].size())
+                            count[k] += counts[i - 1][j][k - j];
+                        if (k < counts[i][j - 1].size())
+                            count[k] += counts[i][j - 1][k];
+                    }
+                }
+            }
+            double total = 0.0, tail = 0.0;
+            for (size_t k = 0; k <= max_u; k++) {
+                total += counts[n1][n2][k];
+                if (k <= static_cast<size_t>(u))
+                    tail += counts[n1][n2][k];
+            }
+            return std::min(1.0, 2.0 * tail / total);
+        }
+
+        const double mean = n1 * n2 / 2.0;
+        const double variance =
+            n1 * n2 / 12.0 * ((n + 1) - tie_term / (static_cast<double>(n) * (n - 1)));
+        if (variance <= 0.0)
+            return 1.0;
+        const double z = std::max(0.0, std::fabs(u1 - mean) - 0.5) / std::sqrt(variance);
+        return std::erfc(z / std::sqrt(2.0));
+    }
+
+    void DiffResults(const std::vector<ResultCell> &a,
+                     const std::vector<ResultCell> &b,
+                     double alpha,
+                     std::vector<CellDiff> &diffs,
+                     bool test_per_frame)
+    {
+        std::vector<size_t> tested;
+        for (const auto &before : a) {
+            const auto after = std::find_if(b.begin(),
+                                            b.end(),
+                                            [&](const ResultCell &cell)
+                                            { return cell.cell == before.cell; });
+            if (after == b.end())
+                continue;
+
+            CellDiff diff;
+            diff.cell = before.cell;
+            // the median frame rate isn't the reported one
+            diff.a_fps = before.samples.empty() || before.per_frame ? before.fps
+                                                                     : median(before.samples);
+            diff.b_fps = after->samples.empty() || after->per_frame ? after->fps
+                                                                     : median(after->samples);
+            diff.change = diff.a_fps > 0.0 ? diff.b_fps / diff.a_fps - 1.0 : 0.0;
+            diff.a_samples = before.samples.size();
+            diff.b_samples = after->samples.size();
+            diff.environment_changed = before.fingerprint != after->fingerprint;
+            diff.per_frame = before.per_frame || after->per_frame;
+            // frame times against repetitions compare different quantities
+            if (diff.a_samples >= 2 && diff.b_samples >= 2 &&
+                before.per_frame == after->per_frame) {
+                diff.p_value = mann_whitney(before.samples, after->samples, diff.exact);
+                if (!diff.per_frame || test_per_frame)
+                    tested.push_back(diffs.size());
+            }
+            diffs.push_back(diff);
+        }
+
+        // Holm-Bonferroni, so a long table doesn't turn up changes by chance
+        std::sort(tested.begin(),
+                  tested.end(),
+                  [&](size_t x, size_t y) { return diffs[x].p_value < diffs[y].p_value; });
+        double running = 0.0;
+        for (size_t i = 0; i < tested.size(); i++) {
+            auto &diff = diffs[tested[i]];
+            running = std::max(running, std::min(1.0, (tested.size() - i) * diff.p_value));
+            diff.adjusted = running;
+            diff.significant = diff.adjusted < alpha;
+        }
+
+        std::stable_sort(diffs.begin(),
+                         diffs.end(),
+                         [](const CellDiff &x, const CellDiff &y)
+                         {
+                             if (x.significant != y.significant)
+                                 return x.significant;
+                             return std::fabs(x.change) > std::fabs(y.change);
+                         });
+    }
+
+} // namespace CODEC_INFO
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "json_reader.h"
+#include <string>
+#include <vector>
+
+namespace CODEC_INFO
+{
+    // Encoder and configuration of a benchmark record, what results of different runs are
+    // matched on.
+    std::string BenchmarkCell(const JsonValue &benchmark);
+
+    // One benchmark cell of a report file.
+    struct ResultCell {
+        std::string cell;
+        std::string fingerprint;
+        double fps = 0.0;
+        // fps of every repetition (--repeat), or of every frame when the report only has
+        // frame_ms, empty for a plain report
+        std::vector<double> samples;
+        bool per_frame = false;
+    };
+
+    // Benchmark records of a JSON document or an NDJSON stream as written by ReportWriter.
+    bool LoadResultFile(const std::string &path,
+                        std::vector<ResultCell> &cells,
+                        std::string *error = nullptr);
+
+    struct CellDiff {
+        std::string cell;
+        double a_fps = 0.0; // median of the samples, the reported fps without any
+        double b_fps = 0.0;
+        double change = 0.0; // relative, negative if b is slower
+        size_t a_samples = 0;
+        size_t b_samples = 0;
+        double p_value = 1.0;  // two-sided Mann-Whitney U, 1 without samples on both sides
+        double adjusted = 1.0; // Holm-Bonferroni over all matched cells
+        bool exact = false;    // exact U distribution instead of the normal approximation
+        bool environment_changed = false;
+        // a side has no repetitions and its samples are autocorrelated frame times, only
+        // tested with DiffResults' test_per_frame
+        bool per_frame = false;
+        bool significant = false;
+    };
+
+    // Match the cells of two result files and test every pair, significant changes first,
+    // then by size of the change. Cells only in one of the files are skipped.
+    void DiffResults(const std::vector<ResultCell> &a,
+                     const std::vector<ResultCell> &b,
+                     double alpha,
+                     std::vector<CellDiff> &diffs,
+                     bool test_per_frame = false);
+
+} // namespace CODEC_INFO
@@ -0,0 +1,165 @@
+#include "segment_encoder.h"
+#include "process_stats.h"
+#include "trace.h"
+#include "usdt.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace CODEC_INFO
+{
+    SegmentEncoder::SegmentEncoder(std::string name, SegmentEncodeConfig config)
+        : name_(std::move(name)), config_(std::move(config))
+    {
+    }
+
+    SegmentEncoder::~SegmentEncoder() {}
+
+    bool SegmentEncoder::encode_range(const EncoderTestConfig &config, int begin, int keep_from,
+                                      int end, Segment &segment)
+    {
+        AVCodecContext *c = OpenTestEncoder(name_, config);
+        if (!c)
+            return false;
+
+        AVFrame *frame = AllocTestFrame(c);
+        AVPacket *pkt = av_packet_alloc();
+        if (!frame || !pkt) {
+            av_frame_free(&frame);
+            av_packet_free(&pkt);
+            avcodec_free_context(&c);
+            return false;
+        }
+
+        const bool is_hdr = config.media_type == CODEC_INFO::MEDIA_TYPE::HDR;
+        const auto drain = [&]()
+        {
+            int ret = 0;
+            while ((ret = avcodec_receive_packet(c, pkt)) >= 0) {
+                USDT_PROBE4(receive_packet, name_.c_str(), pkt->pts, pkt->size, ret);
+                // Warm-up frames only feed the lookahead, their packets are dropped.
+                if (pkt->pts >= keep_from) {
+                    segment.bitstream.insert(
+                        segment.bitstream.end(), pkt->data, pkt->data + pkt->size);
+                    segment.frames.push_back({ pkt->pts, pkt->size, PacketPsnrY(c, pkt) });
+                }
+                av_packet_unref(pkt);
+            }
+            USDT_PROBE4(receive_packet, name_.c_str(), -1, 0, ret);
+            return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF;
+        };
+
+        const auto send = [&](AVFrame *input, int index)
+        {
+            const int ret = avcodec_send_frame(c, input);
+            USDT_PROBE3(send_frame, name_.c_str(), index, ret);
+            return ret >= 0;
+        };
+
+        bool ok = true;
+        for (int i = begin; i < end && ok; i++) {
+            FillTestFrame(frame, i, is_hdr);
+            frame->pts = i;
+            frame->pict_type = i == keep_from ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+            ok = send(frame, i) && drain();
+        }
+        if (ok)
+            ok = send(nullptr, -1) && drain();
+
+        av_frame_free(&frame);
+        av_packet_free(&pkt);
+        USDT_PROBE2(encoder_close, name_.c_str(), end - begin);
+        avcodec_free_context(&c);
+        return ok;
+    }
+
+    SegmentEncodeResult SegmentEncoder::Encode()
+    {
+        SegmentEncodeResult result;
+        const int segment_frames = std::max(1, config_.segment_frames);
+        const int count = (config_.total_frames + segment_frames - 1) / segment_frames;
+        if (count < 1)
+            return result;
+
+        EncoderTestConfig config = config_.encoder;
+        config.gop_size = segment_frames;
+        config.codec_flags |= AV_CODEC_FLAG_CLOSED_GOP | AV_CODEC_FLAG_PSNR;
+        // A segment has to start on an IDR, not just an I frame, to decode on its own.
+        config.codec_options.emplace_back("forced-idr", "1");
+
+        std::vector<Segment> segments(count);
+        std::atomic<int> next { 0 };
+
+        const int64_t rss_before = GetResidentBytes();
+        ResetPeakResidentBytes();
+        const auto start = std::chrono::high_resolution_clock::now();
+
+        std::vector<std::thread> workers;
+        const int worker_count = std::min(std::max(1, config_.workers), count);
+        for (int w = 0; w < worker_count; w++) {
+            workers.emplace_back(
+                [&]()
+                {
+                    Trace::SetThreadName("segment worker");
+                    int index = 0;
+                    while ((index = next.fetch_add(1)) < count) {
+                        TRACE_SCOPE("encode_segment");
+                        const int keep_from = index * segment_frames;
+                        const int begin = std::max(0, keep_from - config_.overlap_frames);
+                        const int end = std::min(config_.total_frames, keep_from + segment_frames);
+                        auto &segment = segments[index];
+                        segment.ok = encode_range(config, begin, keep_from, end, segment);
+                    }
+                });
+        }
+        for (auto &worker : workers)
+            worker.join();
+
+        result.ok = true;
+        for (auto &segment : segments) {
+            result.ok = result.ok && segment.ok;
+            result.bitstream.insert(
+                result.bitstream.end(), segment.bitstream.begin(), segment.bitstream.end());
+            result.frames.insert(result.frames.end(), segment.frames.begin(), segment.frames.end());
+        }
+
+        const auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> diff = end - start;
+
+        result.segments = count;
+        result.seconds = diff.count();
+        result.performance = config_.total_frames / diff.count();
+        result.peak_memory_bytes = std::max<int64_t>(0, GetPeakResidentBytes() - rss_before);
+        return result;
+    }
+
+    SegmentEncodeResult SegmentEncoder::EncodeSingle()
+    {
+        SegmentEncodeResult result;
+
+        // no IDR at the segment boundaries, or the boundary PSNR couldn't show the seam cost
+        EncoderTestConfig config = config_.encoder;
+        config.gop_size = std::max(1, config_.total_frames);
+        config.codec_flags |= AV_CODEC_FLAG_PSNR;
+
+        Segment segment;
+        const int64_t rss_before = GetResidentBytes();
+        ResetPeakResidentBytes();
+        const auto start = std::chrono::high_resolution_clock::now();
+
+        result.ok = encode_range(config, 0, 0, config_.total_frames, segment);
+
+        const auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> diff = end - start;
+
+        result.segments = 1;
+        result.seconds = diff.count();
+        result.performance = config_.total_frames / diff.count();
+        result.peak_memory_bytes = std::max<int64_t>(0, GetPeakResidentBytes() - rss_before);
+        result.bitstream = std::move(segment.bitstream);
+        result.frames = std::move(segment.frames);
+        return result;
+    }
+
+} // namespace CODEC_INFO
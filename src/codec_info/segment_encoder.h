@@ -0,0 +1,61 @@
+#pragma once
+
+#include "encoder_bench.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace CODEC_INFO
+{
+    struct SegmentEncodeConfig {
+        EncoderTestConfig encoder;
+        int total_frames = TEST_FRAMES * 8;
+        int segment_frames = TEST_FRAMES; // also the closed-GOP length
+        int overlap_frames = 8;           // lookahead warm-up encoded and dropped before a segment
+        int workers = 4;
+    };
+
+    struct SegmentFrameStat {
+        int64_t pts;
+        int size;
+        double psnr_y; // 0 when the encoder doesn't report quality stats
+    };
+
+    struct SegmentEncodeResult {
+        bool ok = false;
+        int segments = 0;
+        double seconds = 0.0;
+        double performance = 0.0;
+        int64_t peak_memory_bytes = 0; // peak RSS growth over the run
+        std::vector<uint8_t> bitstream;
+        std::vector<SegmentFrameStat> frames; // presentation order
+    };
+
+    // Encodes closed-GOP segments in parallel on a pool of encoder contexts and concatenates the
+    // bitstreams in order.
+    class SegmentEncoder
+    {
+    public:
+        SegmentEncoder(std::string name, SegmentEncodeConfig config);
+        ~SegmentEncoder();
+
+        SegmentEncodeResult Encode();
+        // Same frames on a single encoder instance with one long GOP and the same threads per
+        // context, the baseline for the speedup and for what the segment seams cost.
+        SegmentEncodeResult EncodeSingle();
+
+    private:
+        struct Segment {
+            bool ok = false;
+            std::vector<uint8_t> bitstream;
+            std::vector<SegmentFrameStat> frames;
+        };
+
+        bool encode_range(const EncoderTestConfig &config, int begin, int keep_from, int end,
+                          Segment &segment);
+
+        std::string name_;
+        SegmentEncodeConfig config_;
+    };
+
+} // namespace CODEC_INFO
@@ -0,0 +1,272 @@
+#include "shm_ranking.h"
+#include <algorithm>
+#include <cstring>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace CODEC_INFO
+{
+    // A write holds the seqlock for microseconds; still odd after this many polls means the
+    // writer died in the middle of one.
+    static constexpr int MAX_SEQUENCE_SPINS = 1 << 20;
+    // How often a closed reader tries to open its segment again.
+    static constexpr std::chrono::milliseconds SHM_REOPEN_INTERVAL { 100 };
+
+    static const ShmRankingTable::Section &table_section(const ShmRankingTable &table, int index)
+    {
+        return index < 3 ? table.encoders[index] : table.decoders;
+    }
+
+    static void fill_section(ShmRankingTable::Section &section,
+                             const std::vector<std::tuple<std::string, int, int, double>> &items,
+                             int64_t probed_at_ms)
+    {
+        section.count = 0;
+        section.probed_at_ms = probed_at_ms;
+        for (const auto &item : items) {
+            if (section.count == SHM_RANKING_ENTRIES)
+                break;
+            ProbeEntry entry {};
+            std::strncpy(entry.name, std::get<0>(item).c_str(), sizeof(entry.name) - 1);
+            entry.codec_id = std::get<1>(item);
+            entry.hw_type = std::get<2>(item);
+            entry.performance = std::get<3>(item);
+            section.entries[section.count++] = entry;
+        }
+    }
+
+    ShmRankingWriter::ShmRankingWriter() {}
+
+    ShmRankingWriter::~ShmRankingWriter() { Close(); }
+
+    void ShmRankingWriter::Publish(const ProbeResults &results)
+    {
+        if (!table_)
+            return;
+
+        const int64_t probed_at_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                         results.probed_at.time_since_epoch())
+                                         .count();
+        std::vector<std::tuple<std::string, int, int, double>> encoders;
+        for (const auto &encoder : results.encoders)
+            encoders.emplace_back(encoder.name, encoder.codec_id, encoder.hw_type,
+                                  encoder.performance);
+        std::vector<std::tuple<std::string, int, int, double>> decoders;
+        for (const auto &decoder : results.device_decoders)
+            decoders.emplace_back(std::get<0>(decoder), std::get<1>(decoder),
+                                  std::get<2>(decoder), 0.0);
+
+        const uint64_t sequence = table_->sequence.load(std::memory_order_relaxed);
+        table_->sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        fill_section(table_->encoders[static_cast<int>(results.media_type)], encoders,
+                     probed_at_ms);
+        fill_section(table_->decoders, decoders, probed_at_ms);
+
+        table_->sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    ShmRankingReader::ShmRankingReader() {}
+
+    ShmRankingReader::~ShmRankingReader() { Close(); }
+
+    bool ShmRankingReader::read_section(int index, std::vector<ProbeEntry> &entries)
+    {
+        entries.reserve(SHM_RANKING_ENTRIES);
+        bool reopened = false;
+        for (bool retry = false;; retry = true) {
+            if (retry)
+                retries_++;
+
+            uint64_t before = 0;
+            int spins = 0;
+            while (((before = table_->sequence.load(std::memory_order_acquire)) & 1) &&
+                   spins < MAX_SEQUENCE_SPINS)
+                spins++;
+
+            if ((before & 1) || table_->retired.load(std::memory_order_acquire)) {
+                // The daemon restarted or died: follow the name to its current table, once.
+                const std::string name = name_;
+                if (reopened || !Open(name)) {
+                    // nothing usable behind the name now, reads retry it later
+                    Close();
+                    next_open_ = std::chrono::steady_clock::now() + SHM_REOPEN_INTERVAL;
+                    entries.clear();
+                    return false;
+                }
+                reopened = true;
+                continue;
+            }
+
+            const auto &section = table_section(*table_, index);
+            const uint32_t count = std::min(section.count, SHM_RANKING_ENTRIES);
+            entries.resize(count);
+            std::memcpy(entries.data(), section.entries, count * sizeof(ProbeEntry));
+            const int64_t probed_at_ms = section.probed_at_ms;
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (table_->sequence.load(std::memory_order_relaxed) == before)
+                return probed_at_ms != 0;
+        }
+    }
+
+    bool ShmRankingReader::reopen()
+    {
+        const auto now = std::chrono::steady_clock::now();
+        if (name_.empty() || now < next_open_)
+            return false;
+        next_open_ = now + SHM_REOPEN_INTERVAL;
+        return Open(name_);
+    }
+
+    bool ShmRankingReader::ReadEncoders(MEDIA_TYPE media_type, std::vector<ProbeEntry> &entries)
+    {
+        if (!table_ && !reopen())
+            return false;
+        return read_section(static_cast<int>(media_type), entries);
+    }
+
+    bool ShmRankingReader::ReadDecoders(std::vector<ProbeEntry> &entries)
+    {
+        if (!table_ && !reopen())
+            return false;
+        return read_section(3, entries);
+    }
+
+    bool ShmRankingReader::FindBestHwVideoEncoder(CODEC_INFO::MEDIA_TYPE media_type,
+                                                  CODEC_INFO::CodecPerformance &find_codec_info)
+    {
+        std::vector<ProbeEntry> entries;
+        if (!ReadEncoders(media_type, entries) || entries.empty())
+            return false;
+
+        find_codec_info.name = entries[0].name;
+        find_codec_info.codec_id = static_cast<AVCodecID>(entries[0].codec_id);
+        find_codec_info.hw_type = static_cast<AVHWDeviceType>(entries[0].hw_type);
+        find_codec_info.performance = entries[0].performance;
+        return true;
+    }
+
+    uint64_t ShmRankingReader::Generation() const
+    {
+        return table_ ? table_->sequence.load(std::memory_order_acquire) / 2 : 0;
+    }
+
+#if !defined(_WIN32)
+    // Mark a table left behind by an earlier writer, e.g. one that crashed, as retired.
+    static void retire_table(const std::string &name)
+    {
+        const int fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0)
+            return;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size >= static_cast<off_t>(sizeof(ShmRankingTable))) {
+            void *memory =
+                mmap(nullptr, sizeof(ShmRankingTable), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (memory != MAP_FAILED) {
+                static_cast<ShmRankingTable *>(memory)->retired.store(1,
+                                                                      std::memory_order_release);
+                munmap(memory, sizeof(ShmRankingTable));
+            }
+        }
+        close(fd);
+    }
+
+    bool ShmRankingWriter::Open(const std::string &name)
+    {
+        Close();
+
+        // Readers of the old table see `retired` and re-open by name. A new object, rather than
+        // the old one reset in place, keeps them from reading a table being cleared under them.
+        retire_table(name);
+        shm_unlink(name.c_str());
+        const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0)
+            return false;
+        if (ftruncate(fd, sizeof(ShmRankingTable)) < 0) {
+            close(fd);
+            return false;
+        }
+        void *memory =
+            mmap(nullptr, sizeof(ShmRankingTable), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (memory == MAP_FAILED)
+            return false;
+
+        // Readers check magic and version before trusting the layout, so write those last.
+        table_ = static_cast<ShmRankingTable *>(memory);
+        std::memset(static_cast<void *>(table_), 0, sizeof(ShmRankingTable));
+        table_->version = SHM_RANKING_VERSION;
+        std::atomic_thread_fence(std::memory_order_release);
+        table_->magic = SHM_RANKING_MAGIC;
+        name_ = name;
+        return true;
+    }
+
+    void ShmRankingWriter::Close()
+    {
+        if (!table_)
+            return;
+        table_->retired.store(1, std::memory_order_release);
+        munmap(table_, sizeof(ShmRankingTable));
+        shm_unlink(name_.c_str());
+        table_ = nullptr;
+    }
+
+    bool ShmRankingReader::Open(const std::string &name)
+    {
+        Close();
+        // kept when the table isn't there (yet), reads retry it
+        name_ = name;
+
+        const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0)
+            return false;
+        // a writer between creating and sizing the segment
+        struct stat info;
+        if (fstat(fd, &info) < 0 || info.st_size < static_cast<off_t>(sizeof(ShmRankingTable))) {
+            close(fd);
+            return false;
+        }
+        void *memory = mmap(nullptr, sizeof(ShmRankingTable), PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (memory == MAP_FAILED)
+            return false;
+
+        table_ = static_cast<const ShmRankingTable *>(memory);
+        if (table_->magic != SHM_RANKING_MAGIC || table_->version != SHM_RANKING_VERSION ||
+            table_->retired.load(std::memory_order_acquire)) {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void ShmRankingReader::Close()
+    {
+        if (table_)
+            munmap(const_cast<ShmRankingTable *>(table_), sizeof(ShmRankingTable));
+        table_ = nullptr;
+    }
+#else
+    // NOTE::Only POSIX shared memory is implemented.
+    bool ShmRankingWriter::Open(const std::string &) { return false; }
+
+    void ShmRankingWriter::Close() { table_ = nullptr; }
+
+    bool ShmRankingReader::Open(const std::string &name)
+    {
+        name_ = name;
+        return false;
+    }
+
+    void ShmRankingReader::Close() { table_ = nullptr; }
+#endif
+
+} // namespace CODEC_INFO
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "codec_info.h"
+#include "probe_cache.h"
+#include "probe_protocol.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace CODEC_INFO
+{
+    constexpr const char *SHM_RANKING_DEFAULT_NAME = "/ffmpeg_tools_ranking";
+    constexpr uint32_t SHM_RANKING_MAGIC = 0x4b4e5246; // "FRNK"
+    constexpr uint16_t SHM_RANKING_VERSION = 2;
+    constexpr uint32_t SHM_RANKING_ENTRIES = 64;
+
+    // Layout of the shared segment. A single writer updates it under a seqlock: `sequence` is odd
+    // while a write is in progress and readers retry when it changed under them. A writer that
+    // replaces or removes the segment sets `retired` first, so readers still mapping it re-open.
+    struct ShmRankingTable {
+        struct Section {
+            uint32_t count;
+            uint32_t reserved;
+            int64_t probed_at_ms;
+            ProbeEntry entries[SHM_RANKING_ENTRIES];
+        };
+
+        uint32_t magic;
+        uint16_t version;
+        uint16_t reserved;
+        std::atomic<uint64_t> sequence;
+        std::atomic<uint32_t> retired;
+        uint32_t padding;
+        Section encoders[3]; // ranked hardware encoders per MEDIA_TYPE
+        Section decoders;    // device decoders
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                      std::atomic<uint32_t>::is_always_lock_free,
+                  "the seqlock counter is shared between processes");
+
+    class ShmRankingWriter
+    {
+    public:
+        ShmRankingWriter();
+        ~ShmRankingWriter();
+
+        bool Open(const std::string &name = SHM_RANKING_DEFAULT_NAME);
+        void Close();
+        void Publish(const ProbeResults &results);
+
+    private:
+        std::string name_;
+        ShmRankingTable *table_ = nullptr;
+    };
+
+    // Reads the table with plain loads only, no syscalls or locks after Open() unless the table was
+    // retired or its writer died mid-update; then it re-opens the segment once. If that doesn't
+    // help the reader is closed (fall back to the daemon socket) and later reads try to open the
+    // name again, at most every SHM_REOPEN_INTERVAL, so a restarted daemon is picked up.
+    class ShmRankingReader
+    {
+    public:
+        ShmRankingReader();
+        ~ShmRankingReader();
+
+        bool Open(const std::string &name = SHM_RANKING_DEFAULT_NAME);
+        void Close();
+        bool IsOpen() const { return table_ != nullptr; }
+
+        // consistent copy of the ranked encoders, false if nothing was published yet or, with
+        // IsOpen() false, if there is no table to read
+        bool ReadEncoders(MEDIA_TYPE media_type, std::vector<ProbeEntry> &entries);
+        bool ReadDecoders(std::vector<ProbeEntry> &entries);
+
+        bool FindBestHwVideoEncoder(CODEC_INFO::MEDIA_TYPE media_type,
+                                    CODEC_INFO::CodecPerformance &find_codec_info);
+
+        // number of completed writes, changes on every publish
+        uint64_t Generation() const;
+        // seqlock retries so far, for the contention benchmark
+        uint64_t Retries() const { return retries_; }
+
+    private:
+        // section 0 ... 2 are the encoders per MEDIA_TYPE, 3 the decoders
+        bool read_section(int section, std::vector<ProbeEntry> &entries);
+        // Open(name_) when closed, rate limited
+        bool reopen();
+
+        std::string name_;
+        std::chrono::steady_clock::time_point next_open_;
+        const ShmRankingTable *table_ = nullptr;
+        uint64_t retries_ = 0;
+    };
+
+} // namespace CODEC_INFO
@@ -0,0 +1,201 @@
+#include "trace.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define TRACE_CHUNK_EVENTS 1024
+#define TRACE_DETAIL_SIZE 48
+
+namespace CODEC_INFO
+{
+    struct TraceEvent {
+        const char *name;
+        char detail[TRACE_DETAIL_SIZE];
+        int64_t start_ns;
+        int64_t end_ns;
+    };
+
+    // Events are published by bumping count, full chunks get a successor and stay immutable.
+    struct TraceChunk {
+        TraceEvent events[TRACE_CHUNK_EVENTS];
+        std::atomic<size_t> count { 0 };
+        std::atomic<TraceChunk *> next { nullptr };
+    };
+
+    struct TraceThread {
+        int tid = 0;
+        std::atomic<const char *> name { nullptr };
+        TraceChunk head;
+        TraceChunk *tail = &head; // owner thread only
+
+        ~TraceThread()
+        {
+            TraceChunk *chunk = head.next.load();
+            while (chunk) {
+                TraceChunk *next = chunk->next.load();
+                delete chunk;
+                chunk = next;
+            }
+        }
+    };
+
+    // Buffers outlive their threads so the export still sees finished workers.
+    struct TraceRegistry {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<TraceThread>> threads;
+        const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    };
+
+    static TraceRegistry &trace_registry()
+    {
+        static TraceRegistry registry;
+        return registry;
+    }
+
+    static TraceThread *trace_thread()
+    {
+        thread_local TraceThread *thread = nullptr;
+        if (!thread) {
+            auto &registry = trace_registry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.threads.emplace_back(new TraceThread());
+            thread = registry.threads.back().get();
+            thread->tid = static_cast<int>(registry.threads.size());
+        }
+        return thread;
+    }
+
+    static void append_json_string(std::string &out, const char *text)
+    {
+        out += '"';
+        for (; *text; text++) {
+            if (*text == '"' || *text == '\\')
+                out += '\\';
+            if (static_cast<unsigned char>(*text) >= 0x20)
+                out += *text;
+        }
+        out += '"';
+    }
+
+    std::atomic<bool> Trace::enabled_ { false };
+
+    void Trace::Enable(bool enable)
+    {
+        trace_registry(); // fix the epoch before the first event
+        enabled_.store(enable, std::memory_order_relaxed);
+    }
+
+    int64_t Trace::Now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now() - trace_registry().epoch)
+            .count();
+    }
+
+    void Trace::Record(const char *name, const char *detail, int64_t start_ns, int64_t end_ns)
+    {
+        TraceThread *thread = trace_thread();
+        TraceChunk *chunk = thread->tail;
+        size_t index = chunk->count.load(std::memory_order_relaxed);
+        if (index == TRACE_CHUNK_EVENTS) {
+            TraceChunk *next = new TraceChunk();
+            chunk->next.store(next, std::memory_order_release);
+            thread->tail = chunk = next;
+            index = 0;
+        }
+
+        TraceEvent &event = chunk->events[index];
+        event.name = name;
+        event.detail[0] = '\0';
+        if (detail) {
+            std::strncpy(event.detail, detail, TRACE_DETAIL_SIZE - 1);
+            event.detail[TRACE_DETAIL_SIZE - 1] = '\0';
+        }
+        event.start_ns = start_ns;
+        event.end_ns = end_ns;
+        chunk->count.store(index + 1, std::memory_order_release);
+    }
+
+    void Trace::SetThreadName(const char *name)
+    {
+        if (Enabled())
+            trace_thread()->name.store(name, std::memory_order_relaxed);
+    }
+
+    bool Trace::WriteChromeTrace(const std::string &path)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+
+        auto &registry = trace_registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+
+        std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        out += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+               "\"args\":{\"name\":\"ffmpeg_tools\"}}";
+        char number[96];
+        for (const auto &thread : registry.threads) {
+            const char *name = thread->name.load(std::memory_order_relaxed);
+            std::snprintf(number, sizeof(number), "thread %d", thread->tid);
+            out += ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":";
+            out += std::to_string(thread->tid);
+            out += ",\"args\":{\"name\":";
+            append_json_string(out, name ? name : number);
+            out += "}}";
+
+            for (const TraceChunk *chunk = &thread->head; chunk;
+                 chunk = chunk->next.load(std::memory_order_acquire)) {
+                const size_t count = chunk->count.load(std::memory_order_acquire);
+                for (size_t i = 0; i < count; i++) {
+                    const TraceEvent &event = chunk->events[i];
+                    out += ",{\"name\":";
+                    append_json_string(out, event.name);
+                    std::snprintf(number,
+                                  sizeof(number),
+                                  ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                                  thread->tid,
+                                  event.start_ns / 1000.0,
+                                  (event.end_ns - event.start_ns) / 1000.0);
+                    out += number;
+                    if (event.detail[0]) {
+                        out += ",\"args\":{\"detail\":";
+                        append_json_string(out, event.detail);
+                        out += "}";
+                    }
+                    out += "}";
+                }
+                if (out.size() > (1 << 20)) {
+                    file << out;
+                    out.clear();
+                }
+            }
+        }
+        out += "]}\n";
+        file << out;
+        return static_cast<bool>(file);
+    }
+
+    TraceSession::TraceSession(std::string path) : path_(std::move(path))
+    {
+        if (path_.empty())
+            return;
+        Trace::Enable(true);
+        Trace::SetThreadName("main");
+    }
+
+    TraceSession::~TraceSession()
+    {
+        if (path_.empty())
+            return;
+        Trace::Enable(false);
+        if (!Trace::WriteChromeTrace(path_))
+            std::cerr << "Can't write trace " << path_ << std::endl;
+    }
+
+} // namespace CODEC_INFO
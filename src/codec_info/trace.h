@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace CODEC_INFO
+{
+    // Scoped timeline events in per-thread buffers, exported as Chrome trace JSON for
+    // chrome://tracing or Perfetto. Only the owning thread appends to a buffer, so recording
+    // takes no lock; with tracing off a scope costs one relaxed load.
+    class Trace
+    {
+    public:
+        static void Enable(bool enable);
+        static bool Enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+        // nanoseconds on the trace clock
+        static int64_t Now();
+        // append to the calling thread's buffer, detail is copied (truncated to 47 chars)
+        static void Record(const char *name, const char *detail, int64_t start_ns, int64_t end_ns);
+        // label of the calling thread's timeline, name must outlive the trace (a literal)
+        static void SetThreadName(const char *name);
+
+        // every thread's events so far, threads may keep tracing meanwhile
+        static bool WriteChromeTrace(const std::string &path);
+
+    private:
+        static std::atomic<bool> enabled_;
+    };
+
+    class TraceScope
+    {
+    public:
+        explicit TraceScope(const char *name, const char *detail = nullptr)
+            : name_(Trace::Enabled() ? name : nullptr), detail_(detail),
+              start_(name_ ? Trace::Now() : 0)
+        {
+        }
+        ~TraceScope()
+        {
+            if (name_)
+                Trace::Record(name_, detail_, start_, Trace::Now());
+        }
+
+        TraceScope(const TraceScope &) = delete;
+        TraceScope &operator=(const TraceScope &) = delete;
+
+    private:
+        const char *name_;
+        const char *detail_;
+        int64_t start_;
+    };
+
+    // Traces for its lifetime and writes the file at the end, does nothing for an empty path.
+    class TraceSession
+    {
+    public:
+        explicit TraceSession(std::string path);
+        ~TraceSession();
+
+    private:
+        std::string path_;
+    };
+
+} // namespace CODEC_INFO
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+// TRACE_SCOPE("phase") or TRACE_SCOPE("phase", detail) until the end of the enclosing block
+#define TRACE_SCOPE(...) CODEC_INFO::TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(__VA_ARGS__)
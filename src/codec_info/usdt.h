@@ -0,0 +1,28 @@
+#pragma once
+
+// USDT probes of provider "codec_info" for bpftrace, perf or SystemTap, e.g.
+//   bpftrace -e 'usdt:./ffmpeg_tools:codec_info:send_frame { @[str(arg0)] = count(); }'
+// With sys/sdt.h (CODEC_INFO_HAVE_SDT, set by the build) a probe is one nop plus an ELF note,
+// its arguments are only read by an attached tracer. Without it the probes are compiled out.
+//
+//   encoder_open    name, width, height, ret        avcodec_open2 of an encoder
+//   encoder_close   name, frames                     frames sent before avcodec_free_context
+//   send_frame      name, frame index, ret           index -1 flushes
+//   receive_packet  name, pts, size, ret             size 0 unless ret >= 0
+//   device_init     hw type, ret                     av_hwdevice_ctx_create
+//   decoder_open    name, hw type, ret
+//   phase_begin     phase, detail                    EncodersInfo / DecodersInfo probe phases
+//   phase_end       phase, count                     count of results of the phase
+
+#if defined(CODEC_INFO_HAVE_SDT)
+#include <sys/sdt.h>
+
+#define USDT_PROBE2(name, a, b) DTRACE_PROBE2(codec_info, name, a, b)
+#define USDT_PROBE3(name, a, b, c) DTRACE_PROBE3(codec_info, name, a, b, c)
+#define USDT_PROBE4(name, a, b, c, d) DTRACE_PROBE4(codec_info, name, a, b, c, d)
+#else
+// unevaluated, only keeps arguments that exist for the probes from being unused
+#define USDT_PROBE2(name, a, b) ((void)sizeof((a), (b)))
+#define USDT_PROBE3(name, a, b, c) ((void)sizeof((a), (b), (c)))
+#define USDT_PROBE4(name, a, b, c, d) ((void)sizeof((a), (b), (c), (d)))
+#endif
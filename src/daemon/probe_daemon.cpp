@@ -0,0 +1,289 @@
+#include "probe_daemon.h"
+#include "codec_info/trace.h"
+#include <cstring>
+#include <iostream>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace DAEMON
+{
+    using namespace CODEC_INFO;
+
+    static const MEDIA_TYPE PROBED_MEDIA_TYPES[] = { MEDIA_TYPE::NONE, MEDIA_TYPE::SDR,
+                                                     MEDIA_TYPE::HDR };
+
+    ProbeDaemon::ProbeDaemon(std::string socket_path, std::chrono::seconds revalidate_interval)
+        : socket_path_(std::move(socket_path)), revalidate_interval_(revalidate_interval)
+    {
+    }
+
+    ProbeDaemon::~ProbeDaemon() {}
+
+    void ProbeDaemon::AddProbeListener(ProbeListener listener)
+    {
+        listeners_.emplace_back(std::move(listener));
+    }
+
+    void ProbeDaemon::WatchDevices(bool enable) { watch_devices_ = enable; }
+
+    void ProbeDaemon::notify(const ProbeResults &results)
+    {
+        std::lock_guard<std::mutex> lock(listener_mutex_);
+        generation_++;
+        for (const auto &listener : listeners_)
+            listener(results);
+    }
+
+    void ProbeDaemon::on_devices_changed(const std::vector<AVHWDeviceType> &hw_types)
+    {
+        std::cout << "Device change, re-probing";
+        for (const auto hw_type : hw_types)
+            std::cout << " " << av_hwdevice_get_type_name(hw_type);
+        std::cout << std::endl;
+
+        for (const auto &results : cache_.UpdateDevices(hw_types))
+            notify(*results);
+    }
+
+    void ProbeDaemon::revalidate_loop()
+    {
+        CODEC_INFO::Trace::SetThreadName("revalidate");
+        std::unique_lock<std::mutex> lock(stop_mutex_);
+        while (!stopping_) {
+            lock.unlock();
+            for (const auto media_type : PROBED_MEDIA_TYPES) {
+                TRACE_SCOPE("revalidate");
+                notify(*cache_.Probe(media_type, true));
+            }
+            lock.lock();
+            stop_cv_.wait_for(lock, revalidate_interval_, [&]() { return stopping_; });
+        }
+    }
+
+    EncoderTelemetry *ProbeDaemon::telemetry(MEDIA_TYPE media_type,
+                                             const std::shared_ptr<const ProbeResults> &results)
+    {
+        auto &live = live_[static_cast<int>(media_type)];
+        if (live.results != results) {
+            live.results = results;
+            live.telemetry.reset(new EncoderTelemetry(results->encoders));
+        }
+        return live.telemetry.get();
+    }
+
+    size_t ProbeDaemon::build_response(const char *message, size_t size, char *buffer)
+    {
+        ProbeResponseHeader header { PROBE_PROTOCOL_MAGIC, PROBE_PROTOCOL_VERSION, 0, 0, 0, 0 };
+        header.generation = generation_.load();
+
+        ProbeRequest request {};
+        if (size >= sizeof(request))
+            std::memcpy(&request, message, sizeof(request));
+        const auto op = static_cast<PROBE_OP>(request.op);
+        const size_t expected =
+            sizeof(request) + (op == PROBE_OP::REPORT_SESSION ? sizeof(ProbeSessionReport) : 0);
+        if (size != expected || request.magic != PROBE_PROTOCOL_MAGIC ||
+            request.version != PROBE_PROTOCOL_VERSION ||
+            request.media_type > static_cast<uint32_t>(MEDIA_TYPE::HDR) ||
+            op < PROBE_OP::RANKED_ENCODERS || op > PROBE_OP::LIVE_RANKED_ENCODERS) {
+            header.status = static_cast<int16_t>(PROBE_STATUS::BAD_REQUEST);
+            std::memcpy(buffer, &header, sizeof(header));
+            return sizeof(header);
+        }
+
+        const auto results = cache_.Get(static_cast<MEDIA_TYPE>(request.media_type));
+        if (!results) {
+            header.status = static_cast<int16_t>(PROBE_STATUS::PENDING);
+            std::memcpy(buffer, &header, sizeof(header));
+            return sizeof(header);
+        }
+        header.probed_at_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                  results->probed_at.time_since_epoch())
+                                  .count();
+
+        const uint32_t max_entries = std::min(request.max_entries, PROBE_MAX_ENTRIES);
+        auto *entries = reinterpret_cast<ProbeEntry *>(buffer + sizeof(header));
+        const auto add = [&](const std::string &name, int codec_id, int hw_type, double fps)
+        {
+            if (header.count >= max_entries)
+                return;
+            ProbeEntry entry {};
+            std::strncpy(entry.name, name.c_str(), sizeof(entry.name) - 1);
+            entry.codec_id = codec_id;
+            entry.hw_type = hw_type;
+            entry.performance = fps;
+            std::memcpy(&entries[header.count++], &entry, sizeof(entry));
+        };
+
+        switch (op) {
+        case PROBE_OP::BEST_ENCODER:
+        case PROBE_OP::RANKED_ENCODERS:
+            for (const auto &encoder : results->encoders) {
+                if (op == PROBE_OP::BEST_ENCODER && header.count == 1)
+                    break;
+                add(encoder.name, encoder.codec_id, encoder.hw_type, encoder.performance);
+            }
+            break;
+        case PROBE_OP::DEVICE_ENCODERS:
+            for (const auto &item : results->device_encoders)
+                add(std::get<0>(item), std::get<1>(item), std::get<2>(item), 0.0);
+            break;
+        case PROBE_OP::DEVICE_DECODERS:
+            for (const auto &item : results->device_decoders)
+                add(std::get<0>(item), std::get<1>(item), std::get<2>(item), 0.0);
+            break;
+        case PROBE_OP::REPORT_SESSION: {
+            ProbeSessionReport report;
+            std::memcpy(&report, message + sizeof(request), sizeof(report));
+            report.name[sizeof(report.name) - 1] = 0;
+            auto *live = telemetry(static_cast<MEDIA_TYPE>(request.media_type), results);
+            const int encoder = live->Find(report.name);
+            if (encoder < 0 || report.frames < 0 || report.nanoseconds < 0 ||
+                report.queue_depth < 0)
+                header.status = static_cast<int16_t>(PROBE_STATUS::NOT_FOUND);
+            else
+                live->Report(encoder, report.frames, report.nanoseconds, report.queue_depth);
+            break;
+        }
+        case PROBE_OP::LIVE_RANKED_ENCODERS:
+            for (const auto &live :
+                 telemetry(static_cast<MEDIA_TYPE>(request.media_type), results)->Ranking())
+                add(live.codec.name,
+                    live.codec.codec_id,
+                    live.codec.hw_type,
+                    live.codec.performance);
+            break;
+        }
+
+        if (header.count == 0 && op == PROBE_OP::BEST_ENCODER)
+            header.status = static_cast<int16_t>(PROBE_STATUS::NOT_FOUND);
+        std::memcpy(buffer, &header, sizeof(header));
+        return sizeof(header) + header.count * sizeof(ProbeEntry);
+    }
+
+#if defined(__linux__)
+    void ProbeDaemon::Stop()
+    {
+        if (stop_fd_ >= 0) {
+            const uint64_t one = 1;
+            (void)!write(stop_fd_, &one, sizeof(one));
+        }
+    }
+
+    bool ProbeDaemon::Run()
+    {
+        sockaddr_un addr {};
+        addr.sun_family = AF_UNIX;
+        if (socket_path_.size() >= sizeof(addr.sun_path)) {
+            std::cerr << "Socket path too long: " << socket_path_ << std::endl;
+            return false;
+        }
+        std::memcpy(addr.sun_path, socket_path_.c_str(), socket_path_.size() + 1);
+
+        const int listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        unlink(socket_path_.c_str());
+        if (listen_fd < 0 ||
+            bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+            listen(listen_fd, SOMAXCONN) < 0) {
+            std::cerr << "Can't listen on " << socket_path_ << ": " << std::strerror(errno)
+                      << std::endl;
+            if (listen_fd >= 0)
+                close(listen_fd);
+            return false;
+        }
+
+        stop_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        const int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.fd = listen_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+        event.data.fd = stop_fd_;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stop_fd_, &event);
+
+        std::thread revalidate([this]() { revalidate_loop(); });
+        if (watch_devices_ &&
+            !device_watcher_.Start([this](const std::vector<AVHWDeviceType> &hw_types)
+                                   { on_devices_changed(hw_types); }))
+            std::cerr << "Can't watch devices, relying on periodic re-probes" << std::endl;
+
+        std::vector<char> response(sizeof(ProbeResponseHeader) +
+                                   PROBE_MAX_ENTRIES * sizeof(ProbeEntry));
+        char request[sizeof(ProbeRequest) + sizeof(ProbeSessionReport)];
+        epoll_event events[64];
+        bool running = true;
+        while (running) {
+            const int count = epoll_wait(epoll_fd, events, 64, -1);
+            for (int i = 0; i < count; i++) {
+                const int fd = events[i].data.fd;
+                if (fd == stop_fd_) {
+                    running = false;
+                }
+                else if (fd == listen_fd) {
+                    int client = -1;
+                    while ((client = accept4(listen_fd,
+                                             nullptr,
+                                             nullptr,
+                                             SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                        event.data.fd = client;
+                        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client, &event);
+                    }
+                }
+                else {
+                    iovec buffer { request, sizeof(request) };
+                    msghdr message {};
+                    message.msg_iov = &buffer;
+                    message.msg_iovlen = 1;
+                    const ssize_t size = recvmsg(fd, &message, 0);
+                    if (size <= 0) {
+                        close(fd);
+                        continue;
+                    }
+                    // an oversized message arrives cut to the buffer, a valid looking prefix
+                    // must not pass for a request: size 0 answers BAD_REQUEST
+                    const size_t length = build_response(
+                        request, message.msg_flags & MSG_TRUNC ? 0 : size, response.data());
+                    // One thread serves everybody: a client that doesn't read its answers, or
+                    // sends garbage, is dropped instead of being waited for.
+                    ProbeResponseHeader header;
+                    std::memcpy(&header, response.data(), sizeof(header));
+                    if (send(fd, response.data(), length, MSG_NOSIGNAL) !=
+                            static_cast<ssize_t>(length) ||
+                        header.status == static_cast<int16_t>(PROBE_STATUS::BAD_REQUEST))
+                        close(fd);
+                }
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(stop_mutex_);
+            stopping_ = true;
+        }
+        stop_cv_.notify_all();
+        revalidate.join();
+        device_watcher_.Stop();
+
+        close(epoll_fd);
+        close(listen_fd);
+        close(stop_fd_);
+        stop_fd_ = -1;
+        unlink(socket_path_.c_str());
+        return true;
+    }
+#else
+    void ProbeDaemon::Stop() {}
+
+    bool ProbeDaemon::Run()
+    {
+        std::cerr << "Daemon mode needs AF_UNIX SOCK_SEQPACKET (Linux)." << std::endl;
+        return false;
+    }
+#endif
+
+} // namespace DAEMON
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "codec_info/device_watcher.h"
+#include "codec_info/encoder_telemetry.h"
+#include "codec_info/probe_cache.h"
+#include "codec_info/probe_protocol.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace DAEMON
+{
+    // Keeps probe and benchmark results in memory and answers ProbeClient queries over a Unix
+    // socket. Results are re-validated in the background; queries keep being answered from the
+    // previous snapshot until the new one is swapped in.
+    class ProbeDaemon
+    {
+    public:
+        using ProbeListener = std::function<void(const CODEC_INFO::ProbeResults &)>;
+
+        ProbeDaemon(std::string socket_path, std::chrono::seconds revalidate_interval);
+        ~ProbeDaemon();
+
+        // called on the re-validation thread after every probe, register before Run()
+        void AddProbeListener(ProbeListener listener);
+
+        // re-probe only the affected device types on hot-plug or driver changes, call before Run()
+        void WatchDevices(bool enable);
+
+        // model the encoders' memory per session in every probe, call before Run()
+        void MeasureSessionMemory(bool enable) { cache_.SetSessionMemory(enable); }
+
+        // serve until Stop(), false if the socket can't be set up
+        bool Run();
+        // safe to call from a signal handler
+        void Stop();
+
+    private:
+        void revalidate_loop();
+        void on_devices_changed(const std::vector<AVHWDeviceType> &hw_types);
+        void notify(const CODEC_INFO::ProbeResults &results);
+        size_t build_response(const char *message, size_t size, char *buffer);
+        // telemetry seeded from results, started over whenever a re-probe replaces them
+        CODEC_INFO::EncoderTelemetry *
+        telemetry(CODEC_INFO::MEDIA_TYPE media_type,
+                  const std::shared_ptr<const CODEC_INFO::ProbeResults> &results);
+
+        std::string socket_path_;
+        std::chrono::seconds revalidate_interval_;
+        CODEC_INFO::ProbeCache cache_;
+        std::atomic<uint32_t> generation_ { 0 };
+        std::vector<ProbeListener> listeners_;
+        // listeners run on the re-validation and the device watcher threads
+        std::mutex listener_mutex_;
+        bool watch_devices_ = false;
+        CODEC_INFO::DeviceWatcher device_watcher_;
+
+        // session feedback per media type, only the serving thread touches it
+        struct LiveRanking {
+            std::shared_ptr<const CODEC_INFO::ProbeResults> results;
+            std::unique_ptr<CODEC_INFO::EncoderTelemetry> telemetry;
+        };
+        LiveRanking live_[static_cast<int>(CODEC_INFO::MEDIA_TYPE::HDR) + 1];
+
+        int stop_fd_ = -1;
+        std::mutex stop_mutex_;
+        std::condition_variable stop_cv_;
+        bool stopping_ = false;
+    };
+
+} // namespace DAEMON
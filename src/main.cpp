@@ -1,12 +1,29 @@
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <csignal>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
+#include <thread>
 #include <vector>
 
 #include "CLI11.hpp"
+#include "codec_info/anytime_probe.h"
 #include "codec_info/codec_info.h"
 #include "codec_info/decoders_info.h"
 #include "codec_info/encoders_info.h"
+#include "codec_info/history_store.h"
+#include "codec_info/metrics_exporter.h"
+#include "codec_info/probe_client.h"
+#include "codec_info/process_stats.h"
+#include "codec_info/report_writer.h"
+#include "codec_info/result_diff.h"
+#include "codec_info/segment_encoder.h"
+#include "codec_info/shm_ranking.h"
+#include "codec_info/trace.h"
+#include "daemon/probe_daemon.h"
 #include "third_party/ff_include.h"
 
 namespace parse_args
@@ -25,21 +42,1348 @@ namespace parse_args
             ->transform(CLI::CheckedTransformer(mode_map, CLI::ignore_case));
     };
 
-    void parse_options(CLI::App &app) { parse_media_type(app); }
+    static std::string HISTORY_PATH;
+    static CLI::App *COMPARE_COMMAND = nullptr;
+    static CODEC_INFO::RegressionOptions REGRESSION_OPTIONS;
+
+    void parse_history(CLI::App &app)
+    {
+        app.add_option("--history", HISTORY_PATH, "Append benchmark results to a history file");
+
+        COMPARE_COMMAND =
+            app.add_subcommand("compare", "Check the latest history run for regressions");
+        COMPARE_COMMAND->fallthrough();
+        COMPARE_COMMAND->add_option("--run", REGRESSION_OPTIONS.run, "Run id to check");
+        COMPARE_COMMAND->add_option(
+            "--baseline", REGRESSION_OPTIONS.baseline_run, "Pinned baseline run id");
+        COMPARE_COMMAND
+            ->add_option("--last", REGRESSION_OPTIONS.last_runs, "Baseline runs without a pin")
+            ->check(CLI::PositiveNumber);
+        COMPARE_COMMAND
+            ->add_option("--min_drop",
+                         REGRESSION_OPTIONS.min_drop,
+                         "Smallest relative fps drop that counts")
+            ->check(CLI::Range(0.0, 1.0));
+    }
+
+    static int REPEAT_COUNT = 1;
+    static CLI::App *DIFF_COMMAND = nullptr;
+    static std::vector<std::string> DIFF_FILES;
+    static double DIFF_ALPHA = 0.05;
+    static bool DIFF_ALL = false;
+    static bool DIFF_PER_FRAME = false;
+
+    void parse_diff(CLI::App &app)
+    {
+        app.add_option("--repeat", REPEAT_COUNT, "Repeat every encoder test, for diff")
+            ->check(CLI::Range(1, 100));
+
+        DIFF_COMMAND = app.add_subcommand("diff", "Compare two json/ndjson result files");
+        DIFF_COMMAND->add_option("files", DIFF_FILES, "Result files a and b")
+            ->required()
+            ->expected(2)
+            ->check(CLI::ExistingFile);
+        DIFF_COMMAND->add_option("--alpha", DIFF_ALPHA, "Significance level")
+            ->check(CLI::Range(0.0, 1.0));
+        DIFF_COMMAND->add_flag("--all", DIFF_ALL, "Also list the unchanged cells");
+        DIFF_COMMAND->add_flag("--per_frame",
+                               DIFF_PER_FRAME,
+                               "Also test cells without repetitions on their frame times");
+    }
+
+    static CODEC_INFO::SELECTION_OBJECTIVE OBJECTIVE = CODEC_INFO::SELECTION_OBJECTIVE::THROUGHPUT;
+    static double MAX_DELAY_FRAMES = -1.0;
+    static int MAX_B_FRAMES = 0;
+
+    void parse_objective(CLI::App &app)
+    {
+        std::map<std::string, CODEC_INFO::SELECTION_OBJECTIVE> objective_map {
+            { "throughput", CODEC_INFO::SELECTION_OBJECTIVE::THROUGHPUT },
+            { "cpu", CODEC_INFO::SELECTION_OBJECTIVE::HOST_CPU },
+            { "energy", CODEC_INFO::SELECTION_OBJECTIVE::ENERGY },
+            { "latency", CODEC_INFO::SELECTION_OBJECTIVE::LOW_LATENCY },
+        };
+        app.add_option("--objective",
+                       OBJECTIVE,
+                       "What the best encoder is picked by (throughput, cpu, energy, latency), "
+                       "among those keeping --target_fps")
+            ->transform(CLI::CheckedTransformer(objective_map, CLI::ignore_case));
+        app.add_option("--max_delay_frames",
+                       MAX_DELAY_FRAMES,
+                       "With --objective latency, the fastest encoder whose delay + reorder "
+                       "depth stays within this many frames")
+            ->check(CLI::NonNegativeNumber);
+        app.add_option("--b_frames", MAX_B_FRAMES, "B-frames the benchmarks allow")
+            ->check(CLI::NonNegativeNumber);
+    }
+
+    static bool PERF_COUNTERS = false;
+
+    void parse_counters(CLI::App &app)
+    {
+        app.add_flag("--perf_counters",
+                     PERF_COUNTERS,
+                     "Collect cycles, IPC, cache and branch misses per benchmark (Linux perf)");
+    }
+
+    static std::string TRACE_PATH;
+
+    void parse_trace(CLI::App &app)
+    {
+        app.add_option("--trace", TRACE_PATH, "Write a Chrome trace (chrome://tracing, Perfetto)");
+    }
+
+    static CODEC_INFO::REPORT_FORMAT OUTPUT_FORMAT = CODEC_INFO::REPORT_FORMAT::TEXT;
+
+    void parse_format(CLI::App &app)
+    {
+        std::map<std::string, CODEC_INFO::REPORT_FORMAT> format_map {
+            { "text", CODEC_INFO::REPORT_FORMAT::TEXT },
+            { "json", CODEC_INFO::REPORT_FORMAT::JSON },
+            { "csv", CODEC_INFO::REPORT_FORMAT::CSV },
+            { "ndjson", CODEC_INFO::REPORT_FORMAT::NDJSON },
+        };
+        app.add_option("--format", OUTPUT_FORMAT, "Output format (text, json, csv, ndjson)")
+            ->transform(CLI::CheckedTransformer(format_map, CLI::ignore_case));
+    }
+
+    static std::string THREAD_SCALING_ENCODER;
+    static int MAX_THREADS = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+    void parse_thread_scaling(CLI::App &app)
+    {
+        app.add_option("--thread_scaling",
+                       THREAD_SCALING_ENCODER,
+                       "Measure fps of a software encoder for 1, 2, 4, ... threads");
+        app.add_option("--max_threads", MAX_THREADS, "Upper thread count for --thread_scaling")
+            ->check(CLI::PositiveNumber);
+    }
+
+    static std::string ASYNC_DEPTH_ENCODER;
+    static int ASYNC_DEPTH = 1;
+    static int MAX_ASYNC_DEPTH = 16;
+
+    void parse_async_depth(CLI::App &app)
+    {
+        app.add_option("--async_depth",
+                       ASYNC_DEPTH,
+                       "Frames the benchmarked encoders keep in flight, as their async_depth option "
+                       "(ignored by encoders without one)")
+            ->check(CLI::PositiveNumber);
+        app.add_option("--async_sweep",
+                       ASYNC_DEPTH_ENCODER,
+                       "Measure fps of an encoder with 1, 2, 4, ... frames in flight");
+        app.add_option("--max_async_depth", MAX_ASYNC_DEPTH, "Upper depth for --async_sweep")
+            ->check(CLI::PositiveNumber);
+    }
+
+    static std::string PACKING_ENCODER;
+    static std::string RESOLUTION_PROFILE = "1080p";
+    static double TARGET_FPS = 30.0;
+
+    static const std::map<std::string, std::pair<int, int>> PROFILE_MAP {
+        { "720p", { 1280, 720 } },
+        { "1080p", { 1920, 1080 } },
+        { "1440p", { 2560, 1440 } },
+        { "2160p", { 3840, 2160 } },
+    };
+
+    void parse_packing(CLI::App &app)
+    {
+        app.add_option("--packing",
+                       PACKING_ENCODER,
+                       "Find the streams x threads packing that sustains the most streams");
+        app.add_option("--profile", RESOLUTION_PROFILE, "Resolution profile (720p ... 2160p)")
+            ->transform(CLI::IsMember(PROFILE_MAP, CLI::ignore_case));
+        app.add_option("--target_fps", TARGET_FPS, "Real-time fps each stream has to keep")
+            ->check(CLI::PositiveNumber);
+    }
+
+    static std::string REALTIME_ENCODER;
+    static double REALTIME_SECONDS = 5.0;
+    static double MAX_MISS_RATE = 0.01;
+    static double LATENCY_BUDGET_MS = -1.0;
+
+    void parse_realtime(CLI::App &app)
+    {
+        app.add_option("--realtime",
+                       REALTIME_ENCODER,
+                       "Feed an encoder at --target_fps like a live source, report missed "
+                       "deadlines and jitter, and bisect the highest fps it sustains");
+        app.add_option("--realtime_seconds", REALTIME_SECONDS, "Duration of every paced run")
+            ->check(CLI::PositiveNumber);
+        app.add_option("--max_miss_rate",
+                       MAX_MISS_RATE,
+                       "Share of frames that may miss their deadline at a sustained fps")
+            ->check(CLI::Range(0.0, 1.0));
+        app.add_option("--latency_budget_ms",
+                       LATENCY_BUDGET_MS,
+                       "Time a frame may take from arrival to packet, by default one frame "
+                       "interval plus the encoder's pipeline delay")
+            ->check(CLI::NonNegativeNumber);
+    }
+
+    static std::string FRAME_TRACE_ENCODER;
+    static std::string FRAME_TRACE_CSV;
+    static int FRAME_TRACE_FRAMES = 600;
+    static int FRAME_TRACE_GOP = 30;
+
+    void parse_frame_trace(CLI::App &app)
+    {
+        app.add_option("--frame_trace",
+                       FRAME_TRACE_ENCODER,
+                       "Time every frame of a long run with short GOPs, summarized per frame type");
+        app.add_option("--frame_trace_frames", FRAME_TRACE_FRAMES, "Frames of the traced run")
+            ->check(CLI::PositiveNumber);
+        app.add_option("--frame_trace_gop", FRAME_TRACE_GOP, "GOP size of the traced run")
+            ->check(CLI::PositiveNumber);
+        app.add_option("--frame_trace_csv", FRAME_TRACE_CSV, "Write the per-frame trace as CSV");
+    }
+
+    static std::string SEGMENT_ENCODER;
+    static std::string SEGMENT_OUTPUT;
+    static CODEC_INFO::SegmentEncodeConfig SEGMENT_CONFIG;
+
+    void parse_segment(CLI::App &app)
+    {
+        app.add_option("--segment",
+                       SEGMENT_ENCODER,
+                       "Benchmark segment-parallel encoding against a single instance");
+        app.add_option("--segment_total", SEGMENT_CONFIG.total_frames, "Frames to encode")
+            ->check(CLI::PositiveNumber);
+        app.add_option("--segment_frames", SEGMENT_CONFIG.segment_frames, "Frames per segment")
+            ->check(CLI::PositiveNumber);
+        app.add_option("--segment_overlap",
+                       SEGMENT_CONFIG.overlap_frames,
+                       "Lookahead frames encoded and dropped before each segment")
+            ->check(CLI::NonNegativeNumber);
+        app.add_option("--segment_workers", SEGMENT_CONFIG.workers, "Parallel encoder contexts")
+            ->check(CLI::PositiveNumber);
+        app.add_option("--segment_output", SEGMENT_OUTPUT, "Write the concatenated bitstream");
+    }
+
+    static bool SESSION_MEMORY = false;
+    static int MAX_SESSIONS = 8;
+    static double MEMORY_BUDGET_MB = 0.0;
+
+    void parse_session_memory(CLI::App &app)
+    {
+        app.add_flag("--session_memory",
+                     SESSION_MEMORY,
+                     "Model memory per encoder session and the sessions a node fits "
+                     "(also cached by --daemon and --metrics)");
+        app.add_option("--max_sessions", MAX_SESSIONS, "Sessions opened at most per encoder")
+            ->check(CLI::Range(1, 256));
+        app.add_option("--memory_budget",
+                       MEMORY_BUDGET_MB,
+                       "MB the sessions may use, available memory if not set")
+            ->check(CLI::PositiveNumber);
+    }
+
+    static bool DAEMON_MODE = false;
+    static std::string SOCKET_PATH = CODEC_INFO::PROBE_DEFAULT_SOCKET;
+    static int REVALIDATE_SECONDS = 300;
+    static bool WATCH_DEVICES = false;
+    static int DAEMON_BENCH_THREADS = 0;
+    static int DAEMON_BENCH_QUERIES = 100000;
+
+    void parse_daemon(CLI::App &app)
+    {
+        app.add_flag("--daemon", DAEMON_MODE, "Serve probe results over a Unix socket");
+        app.add_option("--socket", SOCKET_PATH, "Unix socket of the probe daemon");
+        app.add_option("--revalidate", REVALIDATE_SECONDS, "Seconds between background re-probes")
+            ->check(CLI::PositiveNumber);
+        app.add_flag("--watch_devices",
+                     WATCH_DEVICES,
+                     "Re-probe only the affected devices on hot-plug or driver changes");
+        app.add_option("--daemon_bench",
+                       DAEMON_BENCH_THREADS,
+                       "Load-test a running daemon with N client threads")
+            ->check(CLI::PositiveNumber);
+        app.add_option("--daemon_queries", DAEMON_BENCH_QUERIES, "Queries per client thread")
+            ->check(CLI::PositiveNumber);
+    }
+
+    static std::string METRICS_PATH;
+
+    void parse_metrics(CLI::App &app)
+    {
+        app.add_option("--metrics",
+                       METRICS_PATH,
+                       "Write a Prometheus textfile (.prom), refreshed on every daemon re-probe");
+    }
+
+    static bool SHM_PUBLISH = false;
+    static std::string SHM_NAME = CODEC_INFO::SHM_RANKING_DEFAULT_NAME;
+    static int SHM_BENCH_READERS = 0;
+    static double SHM_BENCH_SECONDS = 2.0;
+
+    void parse_shm(CLI::App &app)
+    {
+        app.add_flag("--shm", SHM_PUBLISH, "Publish daemon results to a shared-memory table");
+        app.add_option("--shm_name", SHM_NAME, "Shared-memory segment name");
+        app.add_option("--shm_bench",
+                       SHM_BENCH_READERS,
+                       "Measure shared-memory table reads with N readers and one writer")
+            ->check(CLI::PositiveNumber);
+        app.add_option("--shm_seconds", SHM_BENCH_SECONDS, "Duration of --shm_bench")
+            ->check(CLI::PositiveNumber);
+    }
+
+    static bool RACE_MODE = false;
+    static bool RACE_VERIFY = false;
+
+    void parse_race(CLI::App &app)
+    {
+        app.add_flag("--race",
+                     RACE_MODE,
+                     "Race the hw encoders, ordered by the daemon's cached ranking if it runs");
+        app.add_flag("--race_verify",
+                     RACE_VERIFY,
+                     "Also benchmark every encoder fully and compare the winners");
+    }
+
+    static int BUDGET_MS = 0;
+
+    void parse_budget(CLI::App &app)
+    {
+        app.add_option("--budget",
+                       BUDGET_MS,
+                       "Pick an encoder within N ms, stream results as NDJSON while refining")
+            ->check(CLI::PositiveNumber);
+    }
+
+    // Reject report flags a mode can't honour rather than silently running something else.
+    // Services have output of their own; the sweeps write their points with --format and every
+    // benchmark to --history, but run each point once.
+    void parse_exclusions(CLI::App &app)
+    {
+        static const char *const SERVICE_MODES[] = {
+            "--daemon", "--daemon_bench", "--shm_bench", "--metrics", "--budget",
+        };
+        static const char *const SWEEP_MODES[] = {
+            "--thread_scaling", "--async_sweep", "--packing", "--realtime",
+            "--frame_trace",    "--segment",     "--race",    "--session_memory",
+        };
+        for (const char *report : { "--format", "--history", "--repeat" }) {
+            for (const char *mode : SERVICE_MODES)
+                app.get_option(report)->excludes(app.get_option(mode));
+        }
+        for (const char *mode : SWEEP_MODES)
+            app.get_option("--repeat")->excludes(app.get_option(mode));
+    }
+
+    void parse_options(CLI::App &app)
+    {
+        parse_media_type(app);
+        parse_format(app);
+        parse_trace(app);
+        parse_history(app);
+        parse_diff(app);
+        parse_counters(app);
+        parse_objective(app);
+        parse_thread_scaling(app);
+        parse_async_depth(app);
+        parse_packing(app);
+        parse_realtime(app);
+        parse_frame_trace(app);
+        parse_segment(app);
+        parse_session_memory(app);
+        parse_budget(app);
+        parse_race(app);
+        parse_daemon(app);
+        parse_shm(app);
+        parse_metrics(app);
+        parse_exclusions(app);
+    }
 
 }; // namespace parse_args
 
+namespace modes
+{
+    // messages go to stderr while stdout carries report records
+    std::ostream &text_out(const CODEC_INFO::ReportWriter *writer)
+    {
+        return writer ? std::cerr : std::cout;
+    }
+
+    const char *thread_type_name(int thread_type)
+    {
+        switch (thread_type) {
+        case FF_THREAD_FRAME:
+            return "frame";
+        case FF_THREAD_SLICE:
+            return "slice";
+        default:
+            return "codec";
+        }
+    }
+
+    int run_thread_scaling(CODEC_INFO::EncodersInfo &encoders, CODEC_INFO::ReportWriter *writer)
+    {
+        const auto points = encoders.TestThreadScaling(
+            parse_args::THREAD_SCALING_ENCODER, parse_args::E_MEDIA_TYPE, parse_args::MAX_THREADS);
+        if (points.empty()) {
+            text_out(writer) << "Encoder " << parse_args::THREAD_SCALING_ENCODER
+                             << " can't be opened." << std::endl;
+            return 1;
+        }
+        if (writer) {
+            CODEC_INFO::EncoderTestConfig config;
+            config.media_type = parse_args::E_MEDIA_TYPE;
+            for (const auto &point : points)
+                writer->WriteThreadScaling(parse_args::THREAD_SCALING_ENCODER, config, point);
+            return 0;
+        }
+
+        std::cout << "Thread scaling: " << parse_args::THREAD_SCALING_ENCODER << std::endl;
+        std::cout << std::left << std::setw(8) << "type" << std::setw(8) << "active"
+                  << std::right << std::setw(8) << "threads" << std::setw(10) << "fps"
+                  << std::setw(10) << "speedup" << std::setw(12) << "efficiency" << std::setw(12)
+                  << "fps/thread" << std::endl;
+        std::cout << std::fixed << std::setprecision(2);
+        for (const auto &point : points) {
+            // a single thread leaves libavcodec's threading off
+            const char *active = point.thread_type && !point.active_thread_type
+                                     ? "-"
+                                     : thread_type_name(point.active_thread_type);
+            std::cout << std::left << std::setw(8) << thread_type_name(point.thread_type)
+                      << std::setw(8) << active << std::right
+                      << std::setw(8) << point.thread_count << std::setw(10) << point.performance
+                      << std::setw(10) << point.speedup << std::setw(12) << point.efficiency
+                      << std::setw(12) << point.per_thread << std::endl;
+        }
+        return 0;
+    }
+
+    int run_async_sweep(CODEC_INFO::EncodersInfo &encoders, CODEC_INFO::ReportWriter *writer)
+    {
+        if (!CODEC_INFO::EncoderHasOption(parse_args::ASYNC_DEPTH_ENCODER, "async_depth")) {
+            text_out(writer) << "Encoder " << parse_args::ASYNC_DEPTH_ENCODER
+                             << " has no async_depth option, there is no depth to sweep."
+                             << std::endl;
+            return 1;
+        }
+        const auto points = encoders.TestAsyncDepth(
+            parse_args::ASYNC_DEPTH_ENCODER, parse_args::E_MEDIA_TYPE, parse_args::MAX_ASYNC_DEPTH);
+        if (points.empty()) {
+            text_out(writer) << "Encoder " << parse_args::ASYNC_DEPTH_ENCODER << " can't be opened."
+                             << std::endl;
+            return 1;
+        }
+        if (writer) {
+            CODEC_INFO::EncoderTestConfig config;
+            config.media_type = parse_args::E_MEDIA_TYPE;
+            CODEC_INFO::AsyncDepthPoint best;
+            CODEC_INFO::EncodersInfo::FindBestAsyncDepth(points, best);
+            for (const auto &point : points)
+                writer->WriteAsyncDepth(parse_args::ASYNC_DEPTH_ENCODER,
+                                        config,
+                                        point,
+                                        point.async_depth == best.async_depth);
+            return 0;
+        }
+
+        std::cout << "Async depth: " << parse_args::ASYNC_DEPTH_ENCODER << std::endl;
+        std::cout << std::right << std::setw(8) << "depth" << std::setw(10) << "fps"
+                  << std::setw(10) << "speedup" << std::endl;
+        std::cout << std::fixed << std::setprecision(2);
+        for (const auto &point : points) {
+            std::cout << std::setw(8) << point.async_depth << std::setw(10) << point.performance
+                      << std::setw(10) << point.speedup << std::endl;
+        }
+
+        CODEC_INFO::AsyncDepthPoint best;
+        CODEC_INFO::EncodersInfo::FindBestAsyncDepth(points, best);
+        std::cout << "Best depth: " << best.async_depth << " (" << best.performance << " fps)"
+                  << std::endl;
+        return 0;
+    }
+
+    int run_packing(CODEC_INFO::EncodersInfo &encoders, CODEC_INFO::ReportWriter *writer)
+    {
+        CODEC_INFO::EncoderTestConfig config;
+        config.media_type = parse_args::E_MEDIA_TYPE;
+        const auto resolution = parse_args::PROFILE_MAP.at(parse_args::RESOLUTION_PROFILE);
+        config.width = resolution.first;
+        config.height = resolution.second;
+
+        const auto points = encoders.TestStreamPacking(
+            parse_args::PACKING_ENCODER, config, parse_args::TARGET_FPS, parse_args::MAX_THREADS);
+        if (points.empty()) {
+            text_out(writer) << "Encoder " << parse_args::PACKING_ENCODER << " can't be opened."
+                             << std::endl;
+            return 1;
+        }
+        if (writer) {
+            CODEC_INFO::StreamPackingPoint best;
+            const bool found = CODEC_INFO::EncodersInfo::FindBestStreamPacking(points, best);
+            for (const auto &point : points)
+                writer->WriteStreamPacking(parse_args::PACKING_ENCODER,
+                                           config,
+                                           parse_args::TARGET_FPS,
+                                           point,
+                                           found && point.streams == best.streams &&
+                                               point.threads_per_stream == best.threads_per_stream);
+            return found ? 0 : 1;
+        }
+
+        std::cout << "Stream packing: " << parse_args::PACKING_ENCODER << " " << config.width
+                  << "x" << config.height << " @ " << parse_args::TARGET_FPS << " fps"
+                  << std::endl;
+        std::cout << std::setw(8) << "streams" << std::setw(8) << "threads" << std::setw(14)
+                  << "aggregate fps" << std::setw(12) << "min fps" << std::setw(10) << "margin"
+                  << std::endl;
+        std::cout << std::fixed << std::setprecision(2);
+        for (const auto &point : points) {
+            std::cout << std::setw(8) << point.streams << std::setw(8) << point.threads_per_stream
+                      << std::setw(14) << point.aggregate_performance << std::setw(12)
+                      << point.min_stream_performance << std::setw(10) << point.realtime_margin
+                      << (point.sustainable ? "" : "  (below target)") << std::endl;
+        }
+
+        CODEC_INFO::StreamPackingPoint best;
+        if (!CODEC_INFO::EncodersInfo::FindBestStreamPacking(points, best)) {
+            std::cout << "\nNo packing keeps " << parse_args::TARGET_FPS << " fps." << std::endl;
+            return 1;
+        }
+        std::cout << "\nRecommended packing: " << best.streams << " streams x "
+                  << best.threads_per_stream << " threads (margin " << best.realtime_margin
+                  << ")" << std::endl;
+        return 0;
+    }
+
+    void print_realtime_point(const CODEC_INFO::RealtimePoint &point)
+    {
+        std::cout << std::setprecision(2) << std::setw(10) << point.target_fps << std::setw(8)
+                  << point.frames << std::setw(8) << point.deadline_misses << std::setw(10)
+                  << 100.0 * point.miss_rate << std::setw(12) << 1000.0 * point.latency_budget
+                  << std::setw(12) << 1000.0 * point.max_lateness
+                  << std::setw(12) << 1000.0 * point.jitter << std::setw(6)
+                  << (point.sustained ? "yes" : "no") << std::endl;
+    }
+
+    int run_realtime(CODEC_INFO::EncodersInfo &encoders, CODEC_INFO::ReportWriter *writer)
+    {
+        CODEC_INFO::EncoderTestConfig config;
+        config.media_type = parse_args::E_MEDIA_TYPE;
+        const auto resolution = parse_args::PROFILE_MAP.at(parse_args::RESOLUTION_PROFILE);
+        config.width = resolution.first;
+        config.height = resolution.second;
+        config.async_depth = parse_args::ASYNC_DEPTH;
+        if (parse_args::LATENCY_BUDGET_MS >= 0.0)
+            config.latency_budget_seconds = parse_args::LATENCY_BUDGET_MS / 1000.0;
+        encoders.SetLogStream(nullptr);
+
+        const auto &name = parse_args::REALTIME_ENCODER;
+        const auto target = encoders.TestRealtime(name,
+                                                  config,
+                                                  parse_args::TARGET_FPS,
+                                                  parse_args::REALTIME_SECONDS,
+                                                  parse_args::MAX_MISS_RATE);
+        if (target.frames == 0) {
+            text_out(writer) << "Encoder " << name << " can't be opened." << std::endl;
+            return 1;
+        }
+        if (writer) {
+            writer->WriteRealtime(name, config, "target", target);
+            std::vector<CODEC_INFO::RealtimePoint> points;
+            encoders.FindMaxRealtimeFps(
+                name, config, parse_args::REALTIME_SECONDS, parse_args::MAX_MISS_RATE, points);
+            for (const auto &point : points)
+                writer->WriteRealtime(name, config, "bisect", point);
+            return target.sustained ? 0 : 1;
+        }
+
+        std::cout << "Real-time: " << name << " " << config.width << "x" << config.height
+                  << ", " << parse_args::REALTIME_SECONDS << " s per run" << std::endl;
+        std::cout << std::right << std::setw(10) << "fps" << std::setw(8) << "frames"
+                  << std::setw(8) << "missed" << std::setw(10) << "miss %" << std::setw(12)
+                  << "budget ms" << std::setw(12) << "max late ms" << std::setw(12) << "jitter ms"
+                  << std::setw(6) << "ok" << std::endl;
+        std::cout << std::fixed;
+        print_realtime_point(target);
+
+        std::vector<CODEC_INFO::RealtimePoint> points;
+        const double max_fps = encoders.FindMaxRealtimeFps(
+            name, config, parse_args::REALTIME_SECONDS, parse_args::MAX_MISS_RATE, points);
+        std::cout << "Bisection:" << std::endl;
+        for (const auto &point : points)
+            print_realtime_point(point);
+        std::cout << "Max sustained fps: " << std::setprecision(1) << max_fps << std::endl;
+        return target.sustained ? 0 : 1;
+    }
+
+    int run_frame_trace(CODEC_INFO::EncodersInfo &encoders, CODEC_INFO::ReportWriter *writer)
+    {
+        CODEC_INFO::EncoderTestConfig config;
+        config.media_type = parse_args::E_MEDIA_TYPE;
+        const auto resolution = parse_args::PROFILE_MAP.at(parse_args::RESOLUTION_PROFILE);
+        config.width = resolution.first;
+        config.height = resolution.second;
+        config.frames = parse_args::FRAME_TRACE_FRAMES;
+        config.gop_size = parse_args::FRAME_TRACE_GOP;
+        config.max_b_frames = parse_args::MAX_B_FRAMES;
+        config.async_depth = parse_args::ASYNC_DEPTH;
+        config.frame_trace = true;
+
+        const auto &name = parse_args::FRAME_TRACE_ENCODER;
+        const auto result = encoders.RunTest(name, config);
+        if (!result.opened || result.frame_trace.empty()) {
+            text_out(writer) << "Encoder " << name << " can't be opened." << std::endl;
+            return 1;
+        }
+
+        if (!parse_args::FRAME_TRACE_CSV.empty()) {
+            std::ofstream csv(parse_args::FRAME_TRACE_CSV);
+            if (!csv) {
+                std::cerr << "Can't open " << parse_args::FRAME_TRACE_CSV << std::endl;
+                return 1;
+            }
+            csv << "pts,send_ms,receive_ms,encode_ms,size,key,pict_type\n";
+            for (const auto &entry : result.frame_trace) {
+                csv << entry.pts << "," << 1000.0 * entry.send_seconds << ","
+                    << 1000.0 * entry.receive_seconds << "," << 1000.0 * entry.encode_seconds
+                    << "," << entry.size << "," << (entry.key ? 1 : 0) << ","
+                    << entry.pict_type << "\n";
+            }
+        }
+        if (writer) {
+            for (const auto &stats : CODEC_INFO::SummarizeFrameTypes(result.frame_trace))
+                writer->WriteFrameType(name, config, stats);
+            return 0;
+        }
+
+        std::cout << "Frame trace: " << name << " " << config.width << "x" << config.height
+                  << ", " << result.frame_trace.size() << " packets, GOP " << config.gop_size
+                  << ", " << result.performance << " fps" << std::endl;
+        std::cout << std::left << std::setw(6) << "type" << std::right << std::setw(8) << "count"
+                  << std::setw(10) << "mean ms" << std::setw(10) << "p99 ms" << std::setw(10)
+                  << "max ms" << std::setw(12) << "mean bytes" << std::setw(12) << "max bytes"
+                  << std::endl;
+        std::cout << std::fixed << std::setprecision(2);
+        for (const auto &stats : CODEC_INFO::SummarizeFrameTypes(result.frame_trace)) {
+            std::cout << std::left << std::setw(6) << stats.type << std::right << std::setw(8)
+                      << stats.count << std::setw(10) << stats.mean_ms << std::setw(10)
+                      << stats.p99_ms << std::setw(10) << stats.max_ms << std::setprecision(0)
+                      << std::setw(12) << stats.mean_bytes << std::setw(12) << stats.max_bytes
+                      << std::setprecision(2) << std::endl;
+        }
+        return 0;
+    }
+
+    int run_session_memory(CODEC_INFO::EncodersInfo &encoders, CODEC_INFO::ReportWriter *writer)
+    {
+        CODEC_INFO::EncoderTestConfig config;
+        config.media_type = parse_args::E_MEDIA_TYPE;
+        const auto resolution = parse_args::PROFILE_MAP.at(parse_args::RESOLUTION_PROFILE);
+        config.width = resolution.first;
+        config.height = resolution.second;
+        const int64_t budget = parse_args::MEMORY_BUDGET_MB > 0.0
+                                   ? static_cast<int64_t>(parse_args::MEMORY_BUDGET_MB * 1048576.0)
+                                   : CODEC_INFO::GetAvailableMemoryBytes();
+        encoders.SetLogStream(nullptr);
+        if (writer) {
+            for (const auto &item : encoders.GetHwEncoders(AVMediaType::AVMEDIA_TYPE_VIDEO)) {
+                const auto &name = std::get<0>(item);
+                const auto result = encoders.RunTest(name, config);
+                if (!result.opened || result.frames == 0)
+                    continue;
+                const auto model =
+                    encoders.MeasureSessionMemory(name, config, parse_args::MAX_SESSIONS);
+                writer->WriteSessionMemory(
+                    name,
+                    config,
+                    result.performance,
+                    parse_args::TARGET_FPS,
+                    budget,
+                    model,
+                    CODEC_INFO::EncodersInfo::EstimateCapacity(
+                        model, result.performance, parse_args::TARGET_FPS, budget));
+            }
+            return 0;
+        }
+
+        std::cout << "Session memory: " << config.width << "x" << config.height << " @ "
+                  << parse_args::TARGET_FPS << " fps, " << budget / 1048576 << " MB budget"
+                  << std::endl;
+        std::cout << std::left << std::setw(20) << "encoder" << std::right << std::setw(9)
+                  << "sessions" << std::setw(9) << "base MB" << std::setw(12) << "MB/session"
+                  << std::setw(12) << "device MB" << std::setw(7) << "r2" << std::setw(10)
+                  << "fps" << std::setw(8) << "by fps" << std::setw(8) << "by mem"
+                  << std::setw(10) << "capacity" << std::endl;
+        std::cout << std::fixed;
+        bool session_limit = false;
+        for (const auto &item : encoders.GetHwEncoders(AVMediaType::AVMEDIA_TYPE_VIDEO)) {
+            const auto &name = std::get<0>(item);
+            const auto result = encoders.RunTest(name, config);
+            if (!result.opened || result.frames == 0)
+                continue;
+            const auto model = encoders.MeasureSessionMemory(name, config, parse_args::MAX_SESSIONS);
+            const auto capacity = CODEC_INFO::EncodersInfo::EstimateCapacity(
+                model, result.performance, parse_args::TARGET_FPS, budget);
+            session_limit = session_limit || model.session_limit;
+
+            std::cout << std::left << std::setw(20) << name << std::right << std::setw(8)
+                      << model.sessions << (model.session_limit ? "!" : " ")
+                      << std::setprecision(1) << std::setw(9) << model.base_bytes / 1048576
+                      << std::setw(12) << model.per_session_bytes / 1048576 << std::setw(12);
+            if (model.device_per_session_bytes >= 0.0)
+                std::cout << model.device_per_session_bytes / 1048576;
+            else
+                std::cout << "-";
+            std::cout << std::setprecision(2) << std::setw(7) << model.fit_r2
+                      << std::setprecision(1) << std::setw(10) << result.performance
+                      << std::setw(8) << capacity.by_throughput << std::setw(8)
+                      << capacity.by_memory << std::setw(10) << capacity.sessions
+                      << (capacity.memory_bound ? "  memory bound" : "") << std::endl;
+        }
+        if (session_limit)
+            std::cout << "(! the encoder refused more sessions)" << std::endl;
+        return 0;
+    }
+
+    // mean luma PSNR over all frames and over the first frame of every segment but the first,
+    // -1 where the encoder attached no quality stats
+    std::pair<double, double> segment_psnr(const CODEC_INFO::SegmentEncodeResult &result,
+                                           int segment_frames)
+    {
+        double all = 0.0, boundary = 0.0;
+        int all_count = 0, boundary_count = 0;
+        for (const auto &frame : result.frames) {
+            if (frame.psnr_y <= 0.0)
+                continue;
+            all += frame.psnr_y;
+            all_count++;
+            if (frame.pts > 0 && frame.pts % segment_frames == 0) {
+                boundary += frame.psnr_y;
+                boundary_count++;
+            }
+        }
+        return { all_count ? all / all_count : -1.0,
+                 boundary_count ? boundary / boundary_count : -1.0 };
+    }
+
+    std::string psnr_text(double psnr)
+    {
+        if (psnr < 0.0)
+            return "n/a";
+        std::ostringstream text;
+        text << std::fixed << std::setprecision(2) << psnr;
+        return text.str();
+    }
+
+    int run_race(CODEC_INFO::EncodersInfo &encoders, CODEC_INFO::ReportWriter *writer)
+    {
+        std::vector<CODEC_INFO::CodecPerformance> priors;
+        CODEC_INFO::ProbeClient client;
+        std::vector<CODEC_INFO::ProbeEntry> entries;
+        if (client.Connect(parse_args::SOCKET_PATH) &&
+            client.Query(CODEC_INFO::PROBE_OP::RANKED_ENCODERS, parse_args::E_MEDIA_TYPE, entries) ==
+                CODEC_INFO::PROBE_STATUS::OK) {
+            for (const auto &entry : entries) {
+                CODEC_INFO::CodecPerformance prior;
+                prior.name = entry.name;
+                prior.performance = entry.performance;
+                priors.push_back(prior);
+            }
+        }
+        text_out(writer) << "Priors: " << priors.size() << " cached encoders" << std::endl;
+
+        CODEC_INFO::RaceStats stats;
+        const auto ranked = encoders.RaceHwVideoEncoders(parse_args::E_MEDIA_TYPE, priors, stats);
+        if (ranked.empty() || ranked.front().performance <= 0.0) {
+            text_out(writer) << "No hardware encoders found." << std::endl;
+            return 1;
+        }
+        if (writer) {
+            for (size_t i = 0; i < ranked.size(); i++)
+                writer->WriteRace(ranked[i], "race", static_cast<int>(i) + 1, stats.seconds, stats);
+            if (parse_args::RACE_VERIFY) {
+                const auto start = std::chrono::steady_clock::now();
+                auto list = encoders.DetectHwVideoEncoders(parse_args::E_MEDIA_TYPE);
+                const double seconds =
+                    std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+                        .count();
+                std::stable_sort(
+                    list.begin(),
+                    list.end(),
+                    [](const CODEC_INFO::CodecPerformance &a, const CODEC_INFO::CodecPerformance &b)
+                    { return a.performance > b.performance; });
+                for (size_t i = 0; i < list.size(); i++)
+                    writer->WriteRace(
+                        list[i], "exhaustive", static_cast<int>(i) + 1, seconds, stats);
+            }
+            return 0;
+        }
+
+        std::cout << std::fixed << std::setprecision(2);
+        std::cout << "\nWinner: " << ranked.front().name << " with performance "
+                  << ranked.front().performance << " fps" << std::endl;
+        std::cout << "Candidates: " << stats.candidates << ", rounds: " << stats.rounds
+                  << ", eliminated: " << stats.eliminated << " (" << stats.aborted
+                  << " aborted), frames: " << stats.frames << std::endl;
+        std::cout << "Race: " << stats.seconds << " s, exhaustive estimate: "
+                  << stats.exhaustive_seconds << " s, saved: "
+                  << stats.exhaustive_seconds - stats.seconds << " s" << std::endl;
+
+        if (parse_args::RACE_VERIFY) {
+            const auto start = std::chrono::steady_clock::now();
+            auto list = encoders.DetectHwVideoEncoders(parse_args::E_MEDIA_TYPE);
+            const double seconds =
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            const auto best = std::max_element(
+                list.begin(),
+                list.end(),
+                [](const CODEC_INFO::CodecPerformance &a, const CODEC_INFO::CodecPerformance &b)
+                { return a.performance < b.performance; });
+            if (best == list.end()) {
+                std::cout << "Exhaustive: " << seconds << " s, exhaustive run found no encoders"
+                          << std::endl;
+                return 0;
+            }
+            std::cout << "Exhaustive: " << seconds << " s, winner: " << best->name
+                      << (best->name == ranked.front().name ? " (same)" : " (differs)")
+                      << ", saved: " << seconds - stats.seconds << " s" << std::endl;
+        }
+        return 0;
+    }
+
+    // Benchmark every hw encoder and list the device encoders and decoders as structured records,
+    // progress goes to stderr. The median repetition goes to the history.
+    int run_report(CODEC_INFO::EncodersInfo &encoders,
+                   CODEC_INFO::ReportWriter *writer,
+                   CODEC_INFO::ReportWriter *history)
+    {
+        encoders.SetLogStream(&std::cerr);
+
+        CODEC_INFO::BenchmarkRecord record;
+        record.config.media_type = parse_args::E_MEDIA_TYPE;
+        record.config.codec_flags = AV_CODEC_FLAG_PSNR;
+        record.config.perf_counters = parse_args::PERF_COUNTERS;
+        record.config.async_depth = parse_args::ASYNC_DEPTH;
+        record.config.max_b_frames = parse_args::MAX_B_FRAMES;
+        for (const auto &item : encoders.GetHwEncoders(AVMediaType::AVMEDIA_TYPE_VIDEO)) {
+            record.encoder.name = std::get<0>(item);
+            record.encoder.codec_id = std::get<1>(item);
+            record.encoder.hw_type = CODEC_INFO::EncodersInfo::GetEncoderDeviceType(
+                record.encoder.name);
+            std::cerr << "Testing encoder:" << record.encoder.name << std::endl;
+            // repetitions give the diff mode samples to test on, the median one is reported
+            std::vector<CODEC_INFO::EncoderTestResult> results;
+            record.fps_samples.clear();
+            for (int i = 0; i < parse_args::REPEAT_COUNT; i++) {
+                results.push_back(CODEC_INFO::RunEncoderTest(record.encoder.name, record.config));
+                if (!results.back().opened)
+                    break;
+                if (parse_args::REPEAT_COUNT > 1)
+                    record.fps_samples.push_back(results.back().performance);
+            }
+            if (!results.back().opened)
+                continue;
+            std::sort(results.begin(),
+                      results.end(),
+                      [](const CODEC_INFO::EncoderTestResult &a,
+                         const CODEC_INFO::EncoderTestResult &b)
+                      { return a.performance < b.performance; });
+            record.result = results[results.size() / 2];
+            if (writer)
+                writer->WriteBenchmark(record);
+            else
+                std::cout << record.encoder.name << ": " << record.result.performance << " fps"
+                          << std::endl;
+            if (history)
+                history->WriteBenchmark(record);
+        }
+        if (!writer)
+            return 0;
+
+        for (const auto &item : encoders.GetDeviceHwEncoders(AVMediaType::AVMEDIA_TYPE_VIDEO))
+            writer->WriteDevice("encoder", std::get<0>(item), std::get<1>(item), std::get<2>(item));
+        CODEC_INFO::DecodersInfo decoders;
+        for (const auto &item : decoders.GetDeviceHwDecoders(AVMediaType::AVMEDIA_TYPE_VIDEO))
+            writer->WriteDevice("decoder", std::get<0>(item), std::get<1>(item), std::get<2>(item));
+        writer->End();
+        return 0;
+    }
+
+    int run_compare()
+    {
+        if (parse_args::HISTORY_PATH.empty()) {
+            std::cout << "compare needs --history" << std::endl;
+            return 2;
+        }
+        CODEC_INFO::HistoryStore store(parse_args::HISTORY_PATH);
+        std::vector<CODEC_INFO::HistoryRecord> records;
+        std::string error;
+        if (!store.Load(records, &error)) {
+            std::cout << error << std::endl;
+            return 2;
+        }
+
+        std::vector<CODEC_INFO::RegressionCheck> checks;
+        if (!CODEC_INFO::HistoryStore::Compare(records, parse_args::REGRESSION_OPTIONS, checks)) {
+            std::cout << "No run or no baseline to compare in " << parse_args::HISTORY_PATH
+                      << std::endl;
+            return 2;
+        }
+
+        int regressions = 0;
+        std::cout << std::left << std::setw(44) << "cell" << std::right << std::setw(6) << "runs"
+                  << std::setw(12) << "baseline" << std::setw(12) << "current" << std::setw(9)
+                  << "change" << std::setw(8) << "z" << "  verdict" << std::endl;
+        std::cout << std::fixed << std::setprecision(2);
+        for (const auto &check : checks) {
+            regressions += check.regression;
+            std::cout << std::left << std::setw(44) << check.cell << std::right << std::setw(6)
+                      << check.baseline_runs << std::setw(12) << check.baseline_fps
+                      << std::setw(12) << check.current_fps << std::setw(8)
+                      << 100.0 * check.change << "%" << std::setw(8) << check.z << "  "
+                      << (check.regression ? "REGRESSION" : "ok")
+                      << (check.environment_changed ? " (environment changed)" : "")
+                      << std::endl;
+        }
+        std::cout << regressions << " regression(s) in " << checks.size() << " cells" << std::endl;
+        return regressions ? 1 : 0;
+    }
+
+    int run_diff()
+    {
+        std::vector<CODEC_INFO::ResultCell> before, after;
+        std::string error;
+        if (!CODEC_INFO::LoadResultFile(parse_args::DIFF_FILES[0], before, &error) ||
+            !CODEC_INFO::LoadResultFile(parse_args::DIFF_FILES[1], after, &error)) {
+            std::cout << error << std::endl;
+            return 2;
+        }
+
+        std::vector<CODEC_INFO::CellDiff> diffs;
+        CODEC_INFO::DiffResults(
+            before, after, parse_args::DIFF_ALPHA, diffs, parse_args::DIFF_PER_FRAME);
+        if (diffs.empty()) {
+            std::cout << "No matching benchmark cells" << std::endl;
+            return 2;
+        }
+
+        int significant = 0, per_frame = 0;
+        std::cout << std::left << std::setw(44) << "cell" << std::right << std::setw(12) << "a fps"
+                  << std::setw(12) << "b fps" << std::setw(9) << "change" << std::setw(8) << "n"
+                  << std::setw(10) << "p" << std::setw(10) << "p holm" << std::endl;
+        std::cout << std::fixed;
+        for (const auto &diff : diffs) {
+            significant += diff.significant;
+            per_frame += diff.per_frame;
+            if (!diff.significant && !parse_args::DIFF_ALL)
+                continue;
+            const auto samples = std::to_string(diff.a_samples) + "/" +
+                                 std::to_string(diff.b_samples);
+            std::cout << std::left << std::setw(44) << diff.cell << std::right
+                      << std::setprecision(2) << std::setw(12) << diff.a_fps << std::setw(12)
+                      << diff.b_fps << std::setw(8) << 100.0 * diff.change << "%" << std::setw(8)
+                      << samples << std::setprecision(4) << std::setw(10) << diff.p_value
+                      << std::setw(10) << diff.adjusted << (diff.exact ? "  exact" : "")
+                      << (diff.per_frame ? "  per-frame" : "")
+                      << (diff.environment_changed ? "  (environment changed)" : "")
+                      << std::endl;
+        }
+        std::cout << significant << " significant change(s) in " << diffs.size() << " cells"
+                  << std::endl;
+        if (per_frame && !parse_args::DIFF_PER_FRAME)
+            std::cout << per_frame << " cell(s) without repetitions not tested, see --repeat"
+                      << " or --per_frame" << std::endl;
+        return significant ? 1 : 0;
+    }
+
+    int run_metrics()
+    {
+        CODEC_INFO::MetricsExporter metrics(parse_args::METRICS_PATH);
+        metrics.Update(*CODEC_INFO::RunProbe(
+            parse_args::E_MEDIA_TYPE, true, parse_args::SESSION_MEMORY));
+        if (!metrics.Write()) {
+            std::cout << "Can't write " << parse_args::METRICS_PATH << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote " << parse_args::METRICS_PATH << std::endl;
+        return 0;
+    }
+
+    int run_budget()
+    {
+        CODEC_INFO::AnytimeProbe probe(parse_args::E_MEDIA_TYPE,
+                                       std::chrono::milliseconds(parse_args::BUDGET_MS));
+        probe.Start([](const std::string &line) { std::cout << line << std::endl; });
+
+        // The deadline line carries the answer, refinement keeps streaming after it.
+        CODEC_INFO::CodecPerformance best;
+        const bool found = probe.WaitBest(best);
+        probe.Wait();
+        return found ? 0 : 1;
+    }
+
+    int run_segment(CODEC_INFO::ReportWriter *writer)
+    {
+        auto config = parse_args::SEGMENT_CONFIG;
+        config.encoder.media_type = parse_args::E_MEDIA_TYPE;
+        config.encoder.thread_count = std::max(1, parse_args::MAX_THREADS / config.workers);
+
+        CODEC_INFO::SegmentEncoder encoder(parse_args::SEGMENT_ENCODER, config);
+        const auto single = encoder.EncodeSingle();
+        const auto parallel = encoder.Encode();
+        if (!single.ok || !parallel.ok) {
+            text_out(writer) << "Encoder " << parse_args::SEGMENT_ENCODER << " failed."
+                             << std::endl;
+            return 1;
+        }
+
+        const auto single_psnr = segment_psnr(single, config.segment_frames);
+        const auto parallel_psnr = segment_psnr(parallel, config.segment_frames);
+        if (!parse_args::SEGMENT_OUTPUT.empty()) {
+            std::ofstream output(parse_args::SEGMENT_OUTPUT, std::ios::binary);
+            output.write(reinterpret_cast<const char *>(parallel.bitstream.data()),
+                         parallel.bitstream.size());
+        }
+        if (writer) {
+            writer->WriteSegment(parse_args::SEGMENT_ENCODER,
+                                 config,
+                                 "single",
+                                 single,
+                                 single_psnr.first,
+                                 single_psnr.second);
+            writer->WriteSegment(parse_args::SEGMENT_ENCODER,
+                                 config,
+                                 "parallel",
+                                 parallel,
+                                 parallel_psnr.first,
+                                 parallel_psnr.second);
+            return 0;
+        }
+
+        std::cout << "Segment-parallel: " << parse_args::SEGMENT_ENCODER << ", "
+                  << parallel.segments << " segments of " << config.segment_frames
+                  << " frames, overlap " << config.overlap_frames << ", " << config.workers
+                  << " workers x " << config.encoder.thread_count << " threads" << std::endl;
+        std::cout << std::setw(10) << "" << std::setw(10) << "fps" << std::setw(12) << "bytes"
+                  << std::setw(10) << "psnr" << std::setw(14) << "boundary psnr" << std::setw(14)
+                  << "peak mem MB" << std::endl;
+        std::cout << std::fixed << std::setprecision(2);
+        const auto print_row = [](const char *label,
+                                  const CODEC_INFO::SegmentEncodeResult &result,
+                                  const std::pair<double, double> &psnr)
+        {
+            std::cout << std::setw(10) << label << std::setw(10) << result.performance
+                      << std::setw(12) << result.bitstream.size() << std::setw(10)
+                      << psnr_text(psnr.first) << std::setw(14) << psnr_text(psnr.second)
+                      << std::setw(14)
+                      << result.peak_memory_bytes / (1024.0 * 1024.0) << std::endl;
+        };
+        print_row("single", single, single_psnr);
+        print_row("parallel", parallel, parallel_psnr);
+
+        std::cout << "\nSpeedup: " << single.seconds / parallel.seconds << "x" << std::endl;
+        std::cout << "Bitrate cost: "
+                  << 100.0 * (static_cast<double>(parallel.bitstream.size()) /
+                                  std::max<size_t>(1, single.bitstream.size()) -
+                              1.0)
+                  << "%" << std::endl;
+        std::cout << "Boundary PSNR cost: ";
+        if (single_psnr.second < 0.0 || parallel_psnr.second < 0.0)
+            std::cout << "n/a" << std::endl;
+        else
+            std::cout << single_psnr.second - parallel_psnr.second << " dB" << std::endl;
+        return 0;
+    }
+
+    static DAEMON::ProbeDaemon *RUNNING_DAEMON = nullptr;
+
+    int run_daemon()
+    {
+        DAEMON::ProbeDaemon daemon(parse_args::SOCKET_PATH,
+                                   std::chrono::seconds(parse_args::REVALIDATE_SECONDS));
+        daemon.WatchDevices(parse_args::WATCH_DEVICES);
+        daemon.MeasureSessionMemory(parse_args::SESSION_MEMORY);
+        daemon.AddProbeListener(
+            [](const CODEC_INFO::ProbeResults &results)
+            {
+                std::cout << "Probed media_type:" << static_cast<int>(results.media_type) << ", "
+                          << results.encoders.size() << " encoders" << std::endl;
+            });
+
+        CODEC_INFO::ShmRankingWriter shm;
+        if (parse_args::SHM_PUBLISH) {
+            if (!shm.Open(parse_args::SHM_NAME)) {
+                std::cout << "Can't create shared memory " << parse_args::SHM_NAME << std::endl;
+                return 1;
+            }
+            daemon.AddProbeListener([&shm](const CODEC_INFO::ProbeResults &results)
+                                    { shm.Publish(results); });
+        }
+
+        CODEC_INFO::MetricsExporter metrics(parse_args::METRICS_PATH);
+        if (!parse_args::METRICS_PATH.empty()) {
+            daemon.AddProbeListener(
+                [&metrics](const CODEC_INFO::ProbeResults &results)
+                {
+                    metrics.Update(results);
+                    if (!metrics.Write())
+                        std::cout << "Can't write " << parse_args::METRICS_PATH << std::endl;
+                });
+        }
+
+        RUNNING_DAEMON = &daemon;
+        const auto stop = [](int) { RUNNING_DAEMON->Stop(); };
+        std::signal(SIGINT, stop);
+        std::signal(SIGTERM, stop);
+
+        std::cout << "Listening on " << parse_args::SOCKET_PATH << std::endl;
+        const bool ok = daemon.Run();
+        RUNNING_DAEMON = nullptr;
+        return ok ? 0 : 1;
+    }
+
+    int run_daemon_bench()
+    {
+        const int threads = parse_args::DAEMON_BENCH_THREADS;
+        const int queries = parse_args::DAEMON_BENCH_QUERIES;
+        std::vector<std::vector<double>> latencies(threads);
+        std::atomic<int> failures { 0 };
+
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> clients;
+        for (int t = 0; t < threads; t++) {
+            clients.emplace_back(
+                [&, t]()
+                {
+                    CODEC_INFO::ProbeClient client;
+                    if (!client.Connect(parse_args::SOCKET_PATH)) {
+                        failures += queries;
+                        return;
+                    }
+                    std::vector<CODEC_INFO::ProbeEntry> entries;
+                    latencies[t].reserve(queries);
+                    for (int i = 0; i < queries; i++) {
+                        const auto begin = std::chrono::steady_clock::now();
+                        const auto status = client.Query(
+                            CODEC_INFO::PROBE_OP::BEST_ENCODER, parse_args::E_MEDIA_TYPE, entries);
+                        const std::chrono::duration<double, std::micro> latency =
+                            std::chrono::steady_clock::now() - begin;
+                        if (status == CODEC_INFO::PROBE_STATUS::BAD_REQUEST)
+                            failures++;
+                        else
+                            latencies[t].push_back(latency.count());
+                    }
+                });
+        }
+        for (auto &client : clients)
+            client.join();
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        std::vector<double> all;
+        for (const auto &thread_latencies : latencies)
+            all.insert(all.end(), thread_latencies.begin(), thread_latencies.end());
+        if (all.empty()) {
+            std::cout << "No answers from " << parse_args::SOCKET_PATH << std::endl;
+            return 1;
+        }
+        std::sort(all.begin(), all.end());
+        const auto percentile = [&](double p)
+        { return all[static_cast<size_t>(p * (all.size() - 1))]; };
+
+        std::cout << std::fixed << std::setprecision(2);
+        std::cout << "Queries: " << all.size() << " ok, " << failures << " failed, " << threads
+                  << " clients" << std::endl;
+        std::cout << "Throughput: " << all.size() / elapsed.count() << " queries/s" << std::endl;
+        std::cout << "Latency us: p50 " << percentile(0.5) << ", p99 " << percentile(0.99)
+                  << ", max " << all.back() << std::endl;
+        return failures ? 1 : 0;
+    }
+
+    int run_shm_bench()
+    {
+        const std::string name = parse_args::SHM_NAME + "_bench";
+        CODEC_INFO::ShmRankingWriter writer;
+        if (!writer.Open(name)) {
+            std::cout << "Can't create shared memory " << name << std::endl;
+            return 1;
+        }
+
+        // Synthetic results of realistic size, re-published as fast as the writer can.
+        CODEC_INFO::ProbeResults results;
+        results.media_type = parse_args::E_MEDIA_TYPE;
+        for (int i = 0; i < 8; i++) {
+            CODEC_INFO::CodecPerformance encoder;
+            encoder.name = "encoder_" + std::to_string(i);
+            encoder.performance = 100.0 * (8 - i);
+            results.encoders.emplace_back(encoder);
+        }
+        results.probed_at = std::chrono::system_clock::now();
+        writer.Publish(results);
+
+        std::atomic<bool> running { true };
+        std::atomic<uint64_t> publishes { 0 };
+        std::thread publisher(
+            [&]()
+            {
+                while (running.load(std::memory_order_relaxed)) {
+                    writer.Publish(results);
+                    publishes.fetch_add(1, std::memory_order_relaxed);
+                }
+            });
+
+        const int readers = parse_args::SHM_BENCH_READERS;
+        std::vector<uint64_t> reads(readers), retries(readers);
+        std::vector<std::thread> threads;
+        for (int r = 0; r < readers; r++) {
+            threads.emplace_back(
+                [&, r]()
+                {
+                    CODEC_INFO::ShmRankingReader reader;
+                    if (!reader.Open(name))
+                        return;
+                    std::vector<CODEC_INFO::ProbeEntry> entries;
+                    uint64_t count = 0;
+                    while (running.load(std::memory_order_relaxed)) {
+                        reader.ReadEncoders(parse_args::E_MEDIA_TYPE, entries);
+                        count++;
+                    }
+                    reads[r] = count;
+                    retries[r] = reader.Retries();
+                });
+        }
+
+        std::this_thread::sleep_for(std::chrono::duration<double>(parse_args::SHM_BENCH_SECONDS));
+        running = false;
+        publisher.join();
+        for (auto &thread : threads)
+            thread.join();
+
+        uint64_t total_reads = 0, total_retries = 0;
+        for (int r = 0; r < readers; r++) {
+            total_reads += reads[r];
+            total_retries += retries[r];
+        }
+        const double seconds = parse_args::SHM_BENCH_SECONDS;
+
+        std::cout << std::fixed << std::setprecision(2);
+        std::cout << "Readers: " << readers << ", writer publishes: " << publishes / seconds
+                  << "/s" << std::endl;
+        std::cout << "Reads: " << total_reads / seconds << "/s total, "
+                  << total_reads / seconds / std::max(1, readers) << "/s per reader, "
+                  << (total_reads ? 1e9 * seconds * readers / total_reads : 0.0)
+                  << " ns per read" << std::endl;
+        std::cout << "Seqlock retries: " << total_retries << " ("
+                  << (total_reads ? 100.0 * total_retries / total_reads : 0.0) << "% of reads)"
+                  << std::endl;
+        return 0;
+    }
+
+}; // namespace modes
+
 int main(int argc, char **argv)
 {
     CLI::App app { "Video Tools" };
     parse_args::parse_options(app);
     CLI11_PARSE(app, argc, argv);
 
-    std::cout << "media_type:" << static_cast<int>(parse_args::E_MEDIA_TYPE) << std::endl;
+    if (parse_args::COMPARE_COMMAND->parsed())
+        return modes::run_compare();
+    if (parse_args::DIFF_COMMAND->parsed())
+        return modes::run_diff();
 
     avcodec_register_all();
+    // written when main returns, whichever mode ran
+    CODEC_INFO::TraceSession trace(parse_args::TRACE_PATH);
+
+    // keep stdout pure NDJSON
+    if (parse_args::BUDGET_MS > 0)
+        return modes::run_budget();
+    const bool report = parse_args::OUTPUT_FORMAT != CODEC_INFO::REPORT_FORMAT::TEXT ||
+                        !parse_args::HISTORY_PATH.empty() || parse_args::REPEAT_COUNT > 1;
+
+    if (!report)
+        std::cout << "media_type:" << static_cast<int>(parse_args::E_MEDIA_TYPE) << std::endl;
+
+    if (parse_args::DAEMON_MODE)
+        return modes::run_daemon();
+    if (parse_args::DAEMON_BENCH_THREADS > 0)
+        return modes::run_daemon_bench();
+    if (parse_args::SHM_BENCH_READERS > 0)
+        return modes::run_shm_bench();
+    if (!parse_args::METRICS_PATH.empty())
+        return modes::run_metrics();
 
     auto encoders = new CODEC_INFO::EncodersInfo();
+    encoders->SetCollectCounters(parse_args::PERF_COUNTERS);
+    encoders->SetObjective(parse_args::OBJECTIVE);
+    encoders->SetRequiredFps(parse_args::TARGET_FPS);
+    encoders->SetAsyncDepth(parse_args::ASYNC_DEPTH);
+    encoders->SetMaxDelayFrames(parse_args::MAX_DELAY_FRAMES);
+    encoders->SetMaxBFrames(parse_args::MAX_B_FRAMES);
+
+    // records of whichever mode runs go to stdout, progress to stderr
+    CODEC_INFO::ReportWriter report_writer(std::cout, parse_args::OUTPUT_FORMAT);
+    CODEC_INFO::ReportWriter *writer = nullptr;
+    if (parse_args::OUTPUT_FORMAT != CODEC_INFO::REPORT_FORMAT::TEXT) {
+        report_writer.Begin(CODEC_INFO::GetEnvironmentInfo());
+        writer = &report_writer;
+        encoders->SetLogStream(&std::cerr);
+    }
+
+    // every run goes to the history as its own NDJSON stream
+    std::ofstream history_file;
+    CODEC_INFO::ReportWriter history_writer(history_file, CODEC_INFO::REPORT_FORMAT::NDJSON);
+    CODEC_INFO::ReportWriter *history = nullptr;
+    if (!parse_args::HISTORY_PATH.empty()) {
+        history_file.open(parse_args::HISTORY_PATH, std::ios::app);
+        if (!history_file) {
+            std::cerr << "Can't open history " << parse_args::HISTORY_PATH << std::endl;
+            return 1;
+        }
+        const auto run = CODEC_INFO::HistoryStore::NewRunId();
+        std::cerr << "History run: " << run << std::endl;
+        history_writer.SetRun(run);
+        history_writer.SetIncludeSamples(true);
+        history_writer.Begin(CODEC_INFO::GetEnvironmentInfo());
+        history = &history_writer;
+        // the report mode writes its median repetitions itself, the other modes every run
+        // that encoded all its frames; aborted race trials and failed opens aren't comparable
+        encoders->SetResultListener(
+            [history](const std::string &name,
+                      const CODEC_INFO::EncoderTestConfig &config,
+                      const CODEC_INFO::EncoderTestResult &result)
+            {
+                if (!result.opened ||
+                    static_cast<int>(result.frame_seconds.size()) != config.frames)
+                    return;
+                CODEC_INFO::BenchmarkRecord record;
+                record.encoder.name = name;
+                if (const AVCodec *codec = avcodec_find_encoder_by_name(name.c_str()))
+                    record.encoder.codec_id = codec->id;
+                record.encoder.hw_type = CODEC_INFO::EncodersInfo::GetEncoderDeviceType(name);
+                record.config = config;
+                record.result = result;
+                history->WriteBenchmark(record);
+            });
+    }
+
+    if (!parse_args::THREAD_SCALING_ENCODER.empty())
+        return modes::run_thread_scaling(*encoders, writer);
+    if (!parse_args::ASYNC_DEPTH_ENCODER.empty())
+        return modes::run_async_sweep(*encoders, writer);
+    if (!parse_args::PACKING_ENCODER.empty())
+        return modes::run_packing(*encoders, writer);
+    if (!parse_args::REALTIME_ENCODER.empty())
+        return modes::run_realtime(*encoders, writer);
+    if (!parse_args::FRAME_TRACE_ENCODER.empty())
+        return modes::run_frame_trace(*encoders, writer);
+    if (!parse_args::SEGMENT_ENCODER.empty())
+        return modes::run_segment(writer);
+    if (parse_args::RACE_MODE)
+        return modes::run_race(*encoders, writer);
+    if (parse_args::SESSION_MEMORY)
+        return modes::run_session_memory(*encoders, writer);
+    if (report)
+        return modes::run_report(*encoders, writer, history);
+
     CODEC_INFO::CodecPerformance codec_info;
     const auto find_encoder =
         encoders->FindBestHwVideoEncoder(parse_args::E_MEDIA_TYPE, codec_info);
@@ -49,7 +1393,19 @@ int main(int argc, char **argv)
     }
     else {
         std::cout << "\nBest device encoder: " << codec_info.name << " with performance "
-                  << codec_info.performance << " fps" << std::endl;
+                  << codec_info.performance << " fps, " << 1000.0 * codec_info.cpu_per_frame
+                  << " ms CPU per frame" << std::endl;
+        if (codec_info.joules_per_frame >= 0.0)
+            std::cout << "Energy: " << codec_info.joules_per_frame << " J per frame, "
+                      << codec_info.joules_per_frame * codec_info.performance << " W" << std::endl;
+        const auto &counters = codec_info.counters;
+        if (counters.collected)
+            std::cout << "Counters: " << counters.cycles << " cycles, " << counters.instructions
+                      << " instructions, IPC " << counters.ipc << ", " << counters.llc_misses
+                      << " LLC misses, " << counters.branch_misses << " branch misses, "
+                      << counters.context_switches << " context switches" << std::endl;
+        if (parse_args::PERF_COUNTERS && !counters.error.empty())
+            std::cout << "Counters: " << counters.error << std::endl;
     }
     std::cout << std::endl;
     const auto encoders_list = encoders->GetDeviceHwEncoders(AVMediaType::AVMEDIA_TYPE_VIDEO);
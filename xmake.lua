@@ -1,17 +1,34 @@
 add_rules("mode.debug", "mode.release")
+includes("@builtin/check")
 
 add_includedirs("./deps/CLI11")
 add_includedirs("./deps/ffmpeg/include")
 add_includedirs("./src")
 add_includedirs("./src/codec_info")
 
+target("codec_info")
+    set_kind("$(kind)")
+
+    add_files("src/codec_info/*.cpp")
+    add_defines("CODEC_INFO_BUILD")
+    if is_kind("shared") then
+        add_defines("CODEC_INFO_SHARED", {public = true})
+        add_rules("utils.symbols.export_all", {export_classes = true})
+    end
+
+    add_linkdirs("./deps/ffmpeg/lib/x64/windows", {public = true})
+    add_links("avcodec", "avdevice", "avfilter", "avformat", "avutil", "postproc", "swresample" ,"swscale", {public = true})
+    if is_plat("linux") then
+        add_syslinks("pthread", "rt", {public = true})
+        -- USDT probes, see src/codec_info/usdt.h
+        check_cxxincludes("CODEC_INFO_HAVE_SDT", "sys/sdt.h")
+    end
+
 target("ffmpeg_tools")
     set_kind("binary")
+    add_deps("codec_info")
 
-    add_files("src/**.cpp")
-    
-    add_linkdirs("./deps/ffmpeg/lib/x64/windows")
-    add_links("avcodec", "avdevice", "avfilter", "avformat", "avutil", "postproc", "swresample" ,"swscale")
+    add_files("src/**.cpp|codec_info/*.cpp")
 
 --
 -- If you want to known more usage about xmake, please see https://xmake.io